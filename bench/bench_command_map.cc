@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+// Compares command lookups through CommandMap with lookups in the
+// plain ordered map it used before.
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rpc/command_map.h"
+
+static constexpr size_t command_count = 1000;
+static constexpr size_t rounds        = 2000;
+
+torrent::Object
+bench_command(rpc::target_type, const torrent::Object& obj) {
+  return obj;
+}
+
+template<typename Lookup>
+static double
+lookups_per_second(const std::vector<std::string>& names, Lookup lookup) {
+  size_t found = 0;
+  auto   start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < rounds; ++i)
+    for (const auto& name : names)
+      found += lookup(name.c_str());
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  if (found != rounds * names.size())
+    std::printf("lookup failed\n");
+
+  return (rounds * names.size()) / elapsed.count();
+}
+
+int
+main() {
+  std::vector<std::string> names;
+
+  // Resemble the real command names, which share long prefixes.
+  static const char* prefixes[] = { "d.", "f.", "p.", "t.", "system.",
+                                    "network.", "throttle.", "view." };
+
+  for (size_t i = 0; i < command_count; ++i)
+    names.push_back(std::string(prefixes[i % 8]) + "command_" +
+                    std::to_string(i) + (i % 3 ? ".set" : ""));
+
+  rpc::CommandMap commands;
+  std::map<const char*, int, rpc::command_map_comp> ordered;
+
+  for (const auto& name : names) {
+    commands.insert_slot<rpc::command_base_is_type<
+      rpc::command_base_call<rpc::target_type>>::type>(
+      name.c_str(),
+      &bench_command,
+      &rpc::command_base_call<rpc::target_type>,
+      rpc::CommandMap::flag_dont_delete,
+      nullptr,
+      nullptr);
+    ordered.emplace(name.c_str(), 0);
+  }
+
+  // Copies, so lookups can't compare pointers.
+  std::vector<std::string> keys(names.begin(), names.end());
+
+  double before = lookups_per_second(keys, [&ordered](const char* key) {
+    return ordered.find(key) != ordered.end();
+  });
+  double after = lookups_per_second(keys, [&commands](const char* key) {
+    return commands.find(key) != commands.end();
+  });
+
+  std::printf("std::map:   %12.0f lookups/s\n", before);
+  std::printf("CommandMap: %12.0f lookups/s\n", after);
+
+  return 0;
+}
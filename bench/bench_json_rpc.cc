@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+// Compares allocations and time per JSON-RPC call when going through
+// nlohmann::json DOMs, as before, with JsonRpc2Server reading the
+// request into torrent::Object and writing the result directly.
+
+#include "buildinfo.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#ifdef HAVE_JSON
+
+#include "rpc/json_codec.h"
+#include "utils/jsonrpc/server.h"
+
+using nlohmann::json;
+
+static constexpr size_t rows   = 500;
+static constexpr size_t rounds = 200;
+
+static size_t allocations = 0;
+
+void*
+operator new(size_t size) {
+  allocations++;
+
+  if (void* ptr = std::malloc(size))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+// Not inlined, which would let GCC pair the free with a new expression
+// and warn.
+__attribute__((noinline)) void
+operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+__attribute__((noinline)) void
+operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+// Result shaped like a 'd.multicall2' reply.
+static torrent::Object
+make_result() {
+  torrent::Object result = torrent::Object::create_list();
+
+  for (size_t i = 0; i < rows; ++i) {
+    torrent::Object row = torrent::Object::create_list();
+
+    row.as_list().push_back(std::string(40, 'A' + i % 26));
+    row.as_list().push_back(std::string("Some.Torrent.Name.") +
+                            std::to_string(i) + ".mkv");
+    row.as_list().push_back(int64_t(i) << 20);
+    row.as_list().push_back(int64_t(i % 2));
+    row.as_list().push_back(std::string("/downloads/complete"));
+
+    result.as_list().push_back(row);
+  }
+
+  return result;
+}
+
+static torrent::Object
+dom_to_object(const json& value) {
+  switch (value.type()) {
+    case json::value_t::number_integer:
+    case json::value_t::number_unsigned:
+      return torrent::Object(value.get<int64_t>());
+    case json::value_t::string:
+      return torrent::Object(value.get<std::string>());
+    case json::value_t::array: {
+      torrent::Object result = torrent::Object::create_list();
+
+      for (const auto& item : value)
+        result.as_list().push_back(dom_to_object(item));
+
+      return result;
+    }
+    default:
+      return torrent::Object();
+  }
+}
+
+static json
+object_to_dom(const torrent::Object& object) {
+  switch (object.type()) {
+    case torrent::Object::TYPE_VALUE:
+      return object.as_value();
+    case torrent::Object::TYPE_STRING:
+      return object.as_string();
+    case torrent::Object::TYPE_LIST: {
+      json result = json::array();
+
+      for (const auto& item : object.as_list())
+        result.push_back(object_to_dom(item));
+
+      return result;
+    }
+    default:
+      return 0;
+  }
+}
+
+template<typename Call>
+static void
+measure(const char* name, Call call) {
+  size_t bytes = 0;
+
+  // Warm up, and check that both produce output.
+  bytes += call();
+
+  size_t start_allocations = allocations;
+  auto   start             = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < rounds; ++i)
+    bytes += call();
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  std::printf("%-10s %10.0f allocations/call %10.1f us/call (%zu bytes)\n",
+              name,
+              double(allocations - start_allocations) / rounds,
+              elapsed.count() * 1e6 / rounds,
+              bytes / (rounds + 1));
+}
+
+int
+main() {
+  const torrent::Object result = make_result();
+  const std::string     request =
+    R"({"jsonrpc":"2.0","id":1,"method":"d.multicall2","params":)"
+    R"(["","main","d.hash=","d.name=","d.size_bytes=","d.complete=",)"
+    R"("d.directory="]})";
+
+  measure("dom", [&]() {
+    json            dom    = json::parse(request);
+    torrent::Object params = dom_to_object(dom["params"]);
+
+    json response = { { "jsonrpc", "2.0" },
+                      { "id", dom["id"] },
+                      { "result", object_to_dom(result) } };
+
+    return response.dump(-1, ' ', false, json::error_handler_t::replace)
+      .size();
+  });
+
+  jsonrpccxx::JsonRpc2Server server(
+    [&result](const std::string&, torrent::Object& params) {
+      torrent::Object args;
+      args.swap(params);
+
+      return [&result]() -> jsonrpccxx::JsonRpcServer::JsonRpcResult {
+        return [&result](std::string* output) {
+          rpc::json_write_object(output, result);
+        };
+      };
+    });
+
+  measure("streaming", [&]() {
+    size_t size = 0;
+
+    server.HandleRequest(request,
+                         [&size](std::string&& piece) { size += piece.size(); });
+
+    return size;
+  });
+
+  return 0;
+}
+
+#else
+
+int
+main() {
+  std::printf("JSON-RPC support is disabled.\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+// Producer/consumer throughput of the queue behind
+// ThreadBase::queue_item, compared with a mutex guarded deque, for a
+// single consumer and a growing number of producers.
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utils/mpsc_queue.h"
+
+using item_type = std::function<void(int*)>;
+
+static constexpr int items = 1000000;
+
+class locked_queue {
+public:
+  void push(item_type value) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_queue.push_back(std::move(value));
+  }
+
+  bool pop(item_type* value) {
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (m_queue.empty())
+      return false;
+
+    *value = std::move(m_queue.front());
+    m_queue.pop_front();
+    return true;
+  }
+
+private:
+  std::mutex            m_lock;
+  std::deque<item_type> m_queue;
+};
+
+template<typename Queue>
+static void
+measure(const char* name, int producers) {
+  Queue                    queue;
+  std::vector<std::thread> threads;
+
+  const int per_producer = items / producers;
+  const int total        = per_producer * producers;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (int p = 0; p < producers; p++)
+    threads.emplace_back([&queue, per_producer] {
+      for (int i = 0; i < per_producer; i++)
+        queue.push([](int* count) { (*count)++; });
+    });
+
+  item_type item;
+  int       count = 0;
+
+  while (count != total) {
+    if (queue.pop(&item))
+      item(&count);
+    else
+      std::this_thread::yield();
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  std::printf("%-8s %2d producers %8.2f Mitems/s\n",
+              name,
+              producers,
+              total / elapsed.count() / 1e6);
+}
+
+int
+main() {
+  for (int producers : { 1, 2, 4, 8 }) {
+    measure<utils::mpsc_queue<item_type>>("mpsc", producers);
+    measure<locked_queue>("mutex", producers);
+  }
+
+  return 0;
+}
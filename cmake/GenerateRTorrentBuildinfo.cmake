@@ -33,7 +33,7 @@ if(USE_JSONRPC)
 endif()
 
 if(USE_XMLRPC)
-  file(APPEND ${BUILDINFO_H} "/* Support for XMLRPC-C */\n")
+  file(APPEND ${BUILDINFO_H} "/* Support for XML-RPC */\n")
   file(APPEND ${BUILDINFO_H} "#define HAVE_XMLRPC_C 1\n\n")
 endif()
 
@@ -86,7 +86,7 @@ cleanup_commands();
 #define CMD2_DL_V(key, slot)                                                   \
   CMD2_A_FUNCTION(key,                                                         \
                   command_base_call<core::Download*>,                          \
-                  object_convert_void(slot),                                   \
+                  download_convert_void(slot),                                 \
                   "i:",                                                        \
                   "")
 #define CMD2_DL_VALUE(key, slot)                                               \
@@ -94,7 +94,7 @@ cleanup_commands();
 #define CMD2_DL_VALUE_V(key, slot)                                             \
   CMD2_A_FUNCTION(key,                                                         \
                   command_base_call_value<core::Download*>,                    \
-                  object_convert_void(slot),                                   \
+                  download_convert_void(slot),                                 \
                   "i:",                                                        \
                   "")
 #define CMD2_DL_STRING(key, slot)                                              \
@@ -103,7 +103,7 @@ cleanup_commands();
 #define CMD2_DL_STRING_V(key, slot)                                            \
   CMD2_A_FUNCTION(key,                                                         \
                   command_base_call_string<core::Download*>,                   \
-                  object_convert_void(slot),                                   \
+                  download_convert_void(slot),                                 \
                   "i:",                                                        \
                   "")
 #define CMD2_DL_LIST(key, slot)                                                \
@@ -333,6 +333,17 @@ object_convert_void(T f) {
   return f;
 }
 
+// Download commands without a result change the download, so mark its
+// session state for saving.
+template<typename T>
+auto
+download_convert_void(T f) {
+  return object_convert_void([f](const auto& download, const auto& arg) {
+    download->set_session_dirty();
+    f(download, arg);
+  });
+}
+
 //
 // Key creation:
 //
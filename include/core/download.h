@@ -150,6 +150,25 @@ public:
 
   float distributed_copies() const;
 
+  // Dense index assigned by DownloadList, reused after erase. Views
+  // use it to index their visibility bitmaps.
+  uint32_t id() const {
+    return m_id;
+  }
+  void set_id(uint32_t id) {
+    m_id = id;
+  }
+
+  // Changes to the session state that aren't visible in the progress,
+  // transfer totals or tracker states bump the session generation.
+  // 'is_session_dirty' compares all of these with the last save.
+  //
+  // The views are also told to re-filter the download on their next
+  // pass.
+  void set_session_dirty();
+  bool is_session_dirty() const;
+  void set_session_saved();
+
   // HACK: Choke group setting.
   unsigned int group() const {
     return m_group;
@@ -159,6 +178,17 @@ public:
   }
 
 private:
+  struct session_state {
+    uint64_t generation{ 0 };
+    uint32_t chunks_done{ 0 };
+    uint32_t chunks_wanted{ 0 };
+    uint64_t total_uploaded{ 0 };
+    uint64_t total_downloaded{ 0 };
+    uint32_t trackers{ 0 };
+
+    bool operator==(const session_state& state) const;
+  };
+
   Download(const Download&);
   void operator()(const Download&);
 
@@ -166,12 +196,19 @@ private:
 
   void receive_chunk_failed(uint32_t idx);
 
+  session_state current_session_state() const;
+
   // Store the FileList instance so we can use slots etc on it.
   download_type m_download;
   bool          m_hashFailed;
   std::string   m_message;
   uint32_t      m_resumeFlags;
   unsigned int  m_group;
+  uint32_t      m_id;
+
+  // Starts ahead of the saved state, so new downloads get saved.
+  uint64_t      m_sessionGeneration{ 1 };
+  session_state m_sessionSaved;
 };
 
 inline bool
@@ -36,6 +36,13 @@ public:
   void load_raw_data(const std::string& input);
   void commit();
 
+  // Takes a session torrent already read from 'uri', with its session
+  // sections. Empty sections are treated as missing files.
+  void load_session(const std::string& uri,
+                    torrent::Object&   torrent,
+                    torrent::Object&   rtorrent,
+                    torrent::Object&   resume);
+
   command_list_type& commands() {
     return m_commands;
   }
@@ -104,6 +111,10 @@ private:
   bool        m_immediate{ false };
   bool        m_isFile{ false };
 
+  bool            m_sessionLoaded{ false };
+  torrent::Object m_sessionRtorrent;
+  torrent::Object m_sessionResume;
+
   command_list_type         m_commands;
   torrent::Object::map_type m_variables;
 
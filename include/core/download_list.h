@@ -4,13 +4,14 @@
 #ifndef RTORRENT_CORE_DOWNLOAD_LIST_H
 #define RTORRENT_CORE_DOWNLOAD_LIST_H
 
+#include <cstring>
 #include <iosfwd>
 #include <list>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
-namespace torrent {
-class HashString;
-}
+#include <torrent/hash_string.h>
 
 namespace core {
 
@@ -47,8 +48,12 @@ public:
 
   void clear();
 
-  void session_save();
+  // Saves downloads changed since their last save, returning the
+  // number skipped.
+  unsigned int session_save();
 
+  // Lookups by info-hash go through an index kept in sync by
+  // 'insert' and 'erase'.
   iterator find(const torrent::HashString& hash);
 
   iterator  find_hex(const char* hash);
@@ -60,6 +65,10 @@ public:
 
   iterator insert(Download* d);
 
+  // Marks the download dirty in every view, unless it hasn't been
+  // inserted yet.
+  void mark_changed(Download* d);
+
   void     erase_ptr(Download* d);
   iterator erase(iterator itr);
 
@@ -142,6 +151,19 @@ public:
   // after a shutdown.
 
 private:
+  // Info-hashes are uniformly distributed, so any part of one makes a
+  // good hash value.
+  struct info_hash_hash {
+    size_t operator()(const torrent::HashString& hash) const {
+      size_t value;
+      std::memcpy(&value, hash.data(), sizeof(value));
+      return value;
+    }
+  };
+
+  using index_type =
+    std::unordered_map<torrent::HashString, iterator, info_hash_hash>;
+
   void hash_done(Download* d);
   void hash_queue(Download* d, int type);
 
@@ -154,6 +176,12 @@ private:
   void received_inactive(Download* d);
 
   void process_meta_download(Download* d);
+
+  index_type m_index;
+
+  // Ids of erased downloads, handed out again before new ones.
+  std::vector<uint32_t> m_freeIds;
+  uint32_t              m_nextId{ 0 };
 };
 
 }
@@ -5,7 +5,9 @@
 #define RTORRENT_CORE_DOWNLOAD_STORE_H
 
 #include <string>
+#include <vector>
 
+#include "core/session_log.h"
 #include "utils/lockfile.h"
 
 namespace utils {
@@ -20,6 +22,10 @@ class DownloadStore {
 public:
   static constexpr int flag_skip_static = 0x1;
 
+  // Session torrents are either kept as three files per download in
+  // the session directory, or as records in a single session log.
+  enum format_type { format_files, format_log };
+
   bool is_enabled() {
     return m_lockfile.is_locked();
   }
@@ -32,6 +38,26 @@ public:
   }
   void set_path(const std::string& path);
 
+  // Append a CRC-32 trailer to the session files written.
+  bool checksum() const {
+    return m_checksum;
+  }
+  void set_checksum(bool state) {
+    m_checksum = state;
+  }
+
+  format_type format() const {
+    return m_format;
+  }
+  void set_format(format_type format);
+
+  // Saves between 'begin_batch' and 'end_batch' are committed to the
+  // session log in a single checkpoint.
+  void begin_batch() {
+    m_batch++;
+  }
+  bool end_batch();
+
   bool save(Download* d, int flags);
   bool save_full(Download* d) {
     return save(d, 0);
@@ -46,15 +72,37 @@ public:
 
   static bool is_correct_format(const std::string& f);
 
+  // The trailer is "\ncrc32:" followed by the CRC-32 of the preceding
+  // data in hex, bencode readers ignore it.
+  static void append_checksum(std::string* data);
+
+  // Strips a matching trailer. Returns false if the data has a
+  // trailer that doesn't match.
+  static bool verify_checksum(std::string* data);
+
+  std::string session_log_filename() const {
+    return m_path + "rtorrent.session_log";
+  }
+
 private:
   std::string create_filename(Download* d);
 
+  bool checkpoint();
+
   bool write_bencode(const std::string&     filename,
                      const torrent::Object& obj,
                      uint32_t               skip_mask);
 
   std::string     m_path;
   utils::Lockfile m_lockfile;
+
+  bool        m_checksum{ false };
+  format_type m_format{ format_files };
+  SessionLog  m_log;
+  int         m_batch{ 0 };
+
+  // Files of downloads whose torrent is waiting for a checkpoint.
+  std::vector<std::string> m_migrated;
 };
 
 }
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_CORE_SESSION_LOADER_H
+#define RTORRENT_CORE_SESSION_LOADER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <torrent/object.h>
+
+namespace core {
+
+// Reads and decodes session torrents, along with their '.rtorrent' and
+// '.libtorrent_resume' files, on a pool of threads. The main thread
+// takes the results in order through 'next' and creates the downloads
+// from them.
+class SessionLoader {
+public:
+  struct entry_type {
+    std::string     path;
+    torrent::Object torrent;
+    torrent::Object rtorrent;
+    torrent::Object resume;
+
+    // The torrent file was read and decoded, the session sections are
+    // left empty if their files were missing or invalid.
+    bool loaded{ false };
+
+    // The torrent file has a checksum trailer that doesn't match.
+    bool corrupted{ false };
+  };
+
+  // How far the readers may get ahead of the main thread, bounding
+  // the memory held by decoded torrents.
+  static constexpr size_t max_pending = 256;
+
+  SessionLoader(std::vector<std::string> paths, unsigned int threads);
+  ~SessionLoader();
+  SessionLoader(const SessionLoader&) = delete;
+  void operator=(const SessionLoader&) = delete;
+
+  size_t size() const {
+    return m_entries.size();
+  }
+
+  // Blocks until the next entry has been read. Returns false once all
+  // entries have been handed out.
+  bool next(entry_type* entry);
+
+private:
+  void read_entries();
+
+  std::vector<entry_type>  m_entries;
+  std::vector<char>        m_done;
+  std::vector<std::thread> m_threads;
+
+  std::mutex              m_lock;
+  std::condition_variable m_condition;
+
+  size_t m_nextRead{ 0 };
+  size_t m_nextTaken{ 0 };
+  bool   m_stopped{ false };
+};
+
+}
+
+#endif
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_CORE_SESSION_LOG_H
+#define RTORRENT_CORE_SESSION_LOG_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <torrent/object.h>
+
+namespace core {
+
+// Session store keeping every session torrent in a single append-only
+// file, used instead of the three files per download when
+// 'session.format' is "log".
+//
+// The file starts with a header, followed by records of a 32 bit body
+// size, the CRC-32 of the body, and a body of the record type, the
+// info hash and a bencoded object. Appended records are buffered and
+// only become part of the session once 'checkpoint' writes them along
+// with a checkpoint record, in a single write followed by
+// fdatasync. Anything after the last checkpoint is discarded when the
+// log is opened or read.
+//
+// The log is compacted into a new file, holding only the latest
+// records of downloads that haven't been erased, once most of it is
+// made up of superseded records.
+class SessionLog {
+public:
+  enum record_type : uint8_t {
+    record_torrent = 1,
+    record_rtorrent,
+    record_resume,
+    record_erase,
+    record_checkpoint
+  };
+
+  struct entry_type {
+    std::string     hash;
+    torrent::Object torrent;
+    torrent::Object rtorrent;
+    torrent::Object resume;
+  };
+
+  using entry_list = std::vector<entry_type>;
+
+  static constexpr uint32_t version          = 1;
+  static constexpr size_t   header_size      = 8;
+  static constexpr size_t   hash_size        = 20;
+  static constexpr size_t   compact_min_size = 1 << 20;
+
+  SessionLog() = default;
+  ~SessionLog();
+  SessionLog(const SessionLog&) = delete;
+  void operator=(const SessionLog&) = delete;
+
+  bool is_open() const {
+    return m_fd != -1;
+  }
+
+  const std::string& filename() const {
+    return m_filename;
+  }
+
+  // Creates the file if it doesn't exist, and truncates records after
+  // the last checkpoint. Throws storage_error on failure.
+  void open(const std::string& filename);
+  void close();
+
+  bool has_torrent(const std::string& hash) const;
+
+  void append(record_type            type,
+              const std::string&     hash,
+              const torrent::Object& object,
+              uint32_t               skip_mask);
+  void append_erase(const std::string& hash);
+
+  // Writes the appended records, and compacts the log if needed.
+  // Returns false if the records could not be written, the log is
+  // left as of the previous checkpoint and the records are kept for
+  // the next one.
+  bool checkpoint();
+
+  // Reads the session from a single mapping of the file, in info hash
+  // order. Downloads without a torrent record are skipped.
+  static bool read(const std::string& filename, entry_list* entries);
+
+private:
+  // Size of the latest record of each type, indexed by type - 1.
+  using sizes_type = std::array<uint32_t, 3>;
+  using index_type = std::map<std::string, sizes_type>;
+
+  bool compact();
+
+  std::string m_filename;
+  int         m_fd{ -1 };
+
+  std::string m_buffer;
+  uint64_t    m_fileSize{ 0 };
+  uint64_t    m_liveSize{ 0 };
+  index_type  m_index;
+
+  // Set when a failed checkpoint couldn't cut off its partial write,
+  // and when the rename of a compacted log couldn't be synced.
+  bool m_truncate{ false };
+  bool m_syncDirectory{ false };
+};
+
+}
+
+#endif
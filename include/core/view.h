@@ -19,11 +19,13 @@
 #include <functional>
 #include <list>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include <torrent/object.h>
 #include <torrent/utils/timer.h>
 
+#include "core/view_expression.h"
 #include "globals.h"
 
 namespace core {
@@ -108,11 +110,12 @@ public:
     emit_changed();
   }
 
-  void insert(Download* download) {
-    base_type::push_back(download);
-  }
+  // New downloads are added as not visible.
+  void insert(Download* download);
   void erase(Download* download);
 
+  bool is_visible(Download* download) const;
+
   void set_visible(Download* download);
   void set_not_visible(Download* download);
 
@@ -122,28 +125,38 @@ public:
   void sort();
 
   void set_sort_new(const torrent::Object& s) {
-    m_sortNew = s;
+    m_sortNew.set_command(s);
+    m_sortedNew = m_size <= 1;
   }
   void set_sort_current(const torrent::Object& s) {
-    m_sortCurrent = s;
+    m_sortCurrent.set_command(s);
   }
 
-  // Need to explicity trigger filtering.
+  // Need to explicity trigger filtering. Only the downloads marked
+  // dirty since the last pass are re-filtered, unless the filter has
+  // changed since. 'filter_all' always re-filters every download.
   void filter();
+  void filter_all();
   void filter_by(const torrent::Object& condition, base_type& result);
   void filter_download(core::Download* download);
 
+  void mark_dirty(Download* download) {
+    m_dirty.insert(download);
+  }
+
   const torrent::Object& get_filter() const {
-    return m_filter;
+    return m_filter.command();
   }
   void set_filter(const torrent::Object& s) {
-    m_filter = s;
+    m_filter.set_command(s);
+    m_filterStale = true;
   }
   const torrent::Object& get_filter_temp() const {
-    return m_temp_filter;
+    return m_temp_filter.command();
   }
   void set_filter_temp(const torrent::Object& s) {
-    m_temp_filter = s;
+    m_temp_filter.set_command(s);
+    m_filterStale = true;
   }
   void set_filter_on_event(const std::string& event);
 
@@ -186,9 +199,15 @@ private:
     base_type::push_back(d);
   }
 
+  // Run the view's event commands and notify RPC subscribers.
+  void event_added(Download* download);
+  void event_removed(Download* download);
+
   inline void insert_visible(Download* d);
   inline void erase_internal(iterator itr);
 
+  void set_visible_bit(Download* download, bool state);
+
   void emit_changed();
   void emit_changed_now();
 
@@ -200,20 +219,35 @@ private:
 
   std::string m_name;
 
-  size_type m_size;
-  size_type m_focus;
+  size_type m_size{ 0 };
+  size_type m_focus{ 0 };
+
+  ViewExpression m_sortNew;
+  ViewExpression m_sortCurrent;
 
-  // These should be replaced by a faster non-string command type.
-  torrent::Object m_sortNew;
-  torrent::Object m_sortCurrent;
+  // Whether the visible range is in 'sort_new' order, so insertions
+  // can binary search it. Full filter passes append newly visible
+  // downloads unsorted, and 'sort_current' may be a different sort.
+  bool m_sortedNew{ true };
 
-  torrent::Object m_filter;
-  torrent::Object
+  ViewExpression m_filter;
+  ViewExpression
     m_temp_filter; // Temporary view filter (eg: name based filter)
 
   torrent::Object m_event_added;
   torrent::Object m_event_removed;
 
+  // Visibility of each download in the view, indexed by
+  // Download::id().
+  std::vector<bool> m_visibleIds;
+
+  // Downloads that triggered a download event or were modified by a
+  // command since the last filter pass, and those left to re-filter
+  // in the current pass.
+  std::unordered_set<Download*> m_dirty;
+  std::unordered_set<Download*> m_pending;
+  bool                          m_filterStale{ true };
+
   torrent::utils::timer m_lastChanged;
 
   signal_void                   m_signal_changed;
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_CORE_VIEW_EXPRESSION_H
+#define RTORRENT_CORE_VIEW_EXPRESSION_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <torrent/object.h>
+
+#include "rpc/command.h"
+
+namespace core {
+
+class Download;
+
+// A view filter or sort command, such as 'd.complete=' or
+// 'and={d.is_open=,not=$d.is_active=}', compiled into a tree of
+// resolved commands and constants the first time it is evaluated.
+//
+// The logic commands 'and', 'or', 'not', 'less', 'greater' and 'equal'
+// are evaluated in the tree with the same semantics as the commands,
+// others are called through their command map entry. Commands that
+// can't be compiled are parsed on each call as before, so errors are
+// still reported when the view is filtered or sorted.
+class ViewExpression {
+public:
+  class node;
+  class sort_plan;
+
+  using iterator = std::vector<Download*>::iterator;
+
+  ViewExpression();
+  ~ViewExpression();
+  ViewExpression(const ViewExpression&) = delete;
+  void operator=(const ViewExpression&) = delete;
+
+  bool empty() const {
+    return m_command.is_empty();
+  }
+
+  const torrent::Object& command() const {
+    return m_command;
+  }
+  void set_command(const torrent::Object& command);
+
+  torrent::Object evaluate(rpc::target_type target) const;
+
+  // Returns true for an empty filter, and false if the command
+  // failed.
+  bool filter(Download* download) const;
+
+  // Returns true if 'download1' should be placed before 'download2'.
+  bool compare(Download* download1, Download* download2) const;
+
+  // Stable sort of the range for commands that compare fields of the
+  // downloads, 'less' or 'greater' on a single command or 'compare'.
+  // Each field is evaluated once per download, rather than twice per
+  // comparison. Returns false if the command isn't such a sort.
+  bool sort(iterator first, iterator last) const;
+
+  // Binary search for the first download in a range ordered by this
+  // sort that should be placed after 'download'.
+  iterator upper_bound(iterator first, iterator last, Download* download) const;
+
+  // Linear search for the same position, for ranges that might not be
+  // ordered by this sort.
+  iterator find_after(iterator first, iterator last, Download* download) const;
+
+private:
+  void prepare() const;
+  void compile() const;
+
+  torrent::Object m_command;
+
+  // Recompiled if commands were added or erased since, the tree holds
+  // command map iterators.
+  mutable std::unique_ptr<node>      m_root;
+  mutable std::unique_ptr<sort_plan> m_sortPlan;
+  mutable uint64_t                   m_generation{ 0 };
+};
+
+}
+
+#endif
@@ -5,6 +5,7 @@
 #define RTORRENT_CORE_VIEW_MANAGER_H
 
 #include <string>
+#include <unordered_map>
 #include <torrent/utils/unordered_vector.h>
 
 #include "core/view.h"
@@ -78,6 +79,10 @@ public:
   void set_event_removed(const std::string& name, const torrent::Object& cmd) {
     (*find_throw(name))->set_event_removed(cmd);
   }
+
+private:
+  // Position of each view by name, views are only ever appended.
+  std::unordered_map<std::string, size_type> m_index;
 };
 
 }
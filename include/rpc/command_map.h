@@ -4,9 +4,12 @@
 #ifndef RTORRENT_RPC_COMMAND_MAP_H
 #define RTORRENT_RPC_COMMAND_MAP_H
 
+#include <cstdint>
 #include <cstring>
 #include <map>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 #include <torrent/object.h>
 
@@ -61,7 +64,6 @@ public:
 
   using base_type::begin;
   using base_type::end;
-  using base_type::find;
 
   static constexpr int flag_dont_delete   = 0x1;
   static constexpr int flag_delete_key    = 0x2;
@@ -74,18 +76,39 @@ public:
   static constexpr int flag_file_target    = 0x200;
   static constexpr int flag_tracker_target = 0x400;
 
+  // Set on registration for commands untrusted connections may not
+  // call, such as 'execute'.
+  static constexpr int flag_untrusted_denied = 0x800;
+
   CommandMap() = default;
   ~CommandMap();
   CommandMap(const CommandMap&) = delete;
   void operator=(const CommandMap&) = delete;
 
+  // Lookups go through a hash index of the keys, the ordered map
+  // keeps the entries and gives stable iterators and sorted listings.
+  iterator find(key_type key) {
+    index_type::const_iterator itr = m_index.find(key);
+    return itr != m_index.end() ? itr->second : end();
+  }
+  const_iterator find(key_type key) const {
+    index_type::const_iterator itr = m_index.find(key);
+    return itr != m_index.end() ? const_iterator(itr->second) : end();
+  }
+
   bool has(const char* key) const {
-    return base_type::find(key) != base_type::end();
+    return m_index.find(key) != m_index.end();
   }
   bool has(const std::string& key) const {
     return has(key.c_str());
   }
 
+  // Changes whenever commands are added or erased, for callers that
+  // keep iterators or failed lookups around.
+  uint64_t generation() const {
+    return m_generation;
+  }
+
   bool is_modifiable(const_iterator itr) {
     return itr != end() && (itr->second.m_flags & flag_modifiable);
   }
@@ -161,6 +184,12 @@ public:
     return call_command(
       key, arg, target_type((int)command_base::target_file, file, nullptr));
   }
+
+private:
+  using index_type = std::unordered_map<std::string_view, iterator>;
+
+  index_type m_index;
+  uint64_t   m_generation{ 0 };
 };
 
 inline target_type
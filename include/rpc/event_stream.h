@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_RPC_EVENT_STREAM_H
+#define RTORRENT_RPC_EVENT_STREAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ThreadWorker;
+
+namespace core {
+class Download;
+}
+
+namespace rpc {
+
+class SCgiTask;
+
+// Notifications queued for one subscriber, written out in batches by
+// the thread serving it.
+class EventQueue {
+public:
+  // Subscribers that fall this far behind are disconnected.
+  static constexpr size_t max_size = 16 << 20;
+
+  bool empty() const {
+    return m_pending.empty();
+  }
+  size_t size() const {
+    return m_pending.size();
+  }
+
+  // Past the limit the queue stops growing but stays overflowed, so
+  // the subscriber gets dropped on delivery. Returns true if the queue
+  // was empty, as only then does the subscriber's thread need waking.
+  bool push(const std::string& notification);
+
+  bool is_overflowed() const {
+    return m_pending.size() > max_size;
+  }
+
+  // Takes all the queued notifications as a single batch.
+  std::string take();
+
+private:
+  std::string m_pending;
+};
+
+// Connections that called 'system.subscribe' are kept open after the
+// response, and receive one JSON-RPC notification per line for each
+// event they subscribed to:
+//
+//   {"jsonrpc":"2.0","method":"event.download.finished","params":["<hash>"]}
+//   {"jsonrpc":"2.0","method":"view.added","params":["main","<hash>"]}
+//
+// Events are published by the main thread and queued per subscriber,
+// the RPC thread serving each subscriber then writes them out in
+// batches.
+class EventStream {
+public:
+  using topic_list = std::vector<std::string>;
+
+  static constexpr size_t max_pending_size = EventQueue::max_size;
+
+  // Global lock:
+  bool has_subscribers() const {
+    return m_size != 0;
+  }
+
+  void publish(std::string_view                        topic,
+               std::string_view                        method,
+               std::initializer_list<std::string_view> params);
+
+  // Thread of the task:
+  void subscribe(SCgiTask* task, const topic_list& topics);
+  void unsubscribe(SCgiTask* task);
+
+  // Writes out the events queued for the subscribers served by
+  // 'thread'.
+  void deliver(ThreadWorker* thread);
+
+private:
+  struct subscriber_type {
+    SCgiTask*  task;
+    topic_list topics;
+    EventQueue queue;
+  };
+
+  std::mutex                   m_lock;
+  std::vector<subscriber_type> m_subscribers;
+
+  std::atomic<unsigned int> m_size{ 0 };
+};
+
+// Helpers for the event sources, these do nothing unless an RPC
+// listener with subscribers is open.
+void
+publish_download_event(const char* event, core::Download* download);
+void
+publish_view_event(const char*        event,
+                   const std::string& view,
+                   core::Download*    download);
+
+}
+
+#endif
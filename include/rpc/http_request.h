@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_RPC_HTTP_REQUEST_H
+#define RTORRENT_RPC_HTTP_REQUEST_H
+
+#include <string_view>
+
+namespace rpc {
+
+// Header of a request received by an HTTP listener. Only
+// 'POST <target> HTTP/1.x' requests with a Content-Length are
+// accepted, the target itself is ignored.
+struct HttpRequest {
+  static constexpr unsigned int max_header_size  = 16 << 10;
+  static constexpr unsigned int max_request_size = 1u << 30;
+
+  // Size of the header, including the blank line that ends it.
+  unsigned int header_size{ 0 };
+  unsigned int content_length{ 0 };
+
+  bool json{ false };
+  bool keep_alive{ false };
+  bool expect_continue{ false };
+};
+
+// Returns 0 if the header hasn't been fully received, 200 once it has
+// been parsed into 'request', else the status of the error response to
+// send before closing the connection.
+int http_parse_header(std::string_view received, HttpRequest* request);
+
+// Complete response for an error status, telling the client the
+// connection is being closed.
+std::string_view http_error_response(int status);
+
+}
+
+#endif
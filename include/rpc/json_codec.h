@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_RPC_JSON_CODEC_H
+#define RTORRENT_RPC_JSON_CODEC_H
+
+#include <string>
+
+#include <torrent/object.h>
+
+namespace rpc {
+
+// Writes torrent::Object as JSON straight into the output string,
+// producing the same text as nlohmann::json::dump with invalid UTF-8
+// replaced by U+FFFD. Maps are written in key order and dictionary
+// keys as an array of the key and its arguments.
+void
+json_write_object(std::string* output, const torrent::Object& object);
+
+void
+json_write_string(std::string* output, const std::string& str);
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_RPC_MULTICALL_PLAN_H
+#define RTORRENT_RPC_MULTICALL_PLAN_H
+
+#include <utility>
+#include <vector>
+
+#include <torrent/object.h>
+
+#include "rpc/command_map.h"
+
+namespace rpc {
+
+// The commands given to d.multicall2 and friends, parsed and looked up
+// in the command map once per call instead of once per row.
+class MulticallPlan {
+public:
+  using command_type = std::pair<CommandMap::iterator, torrent::Object>;
+  using command_list = std::vector<command_type>;
+
+  // Each element is a command string such as 'd.name=' or
+  // 'f.size_chunks='. Empty strings give empty results.
+  MulticallPlan(torrent::Object::list_const_iterator first,
+                torrent::Object::list_const_iterator last);
+
+  bool empty() const {
+    return m_commands.empty();
+  }
+  size_t size() const {
+    return m_commands.size();
+  }
+
+  const command_list& commands() const {
+    return m_commands;
+  }
+
+  // Calls every command on 'target', appending the results to 'row'.
+  void call(target_type target, torrent::Object::list_type& row) const;
+
+  // Adds a row to 'result' with the results for 'target'.
+  void call_row(target_type target, torrent::Object::list_type& result) const {
+    call(target,
+         result.insert(result.end(), torrent::Object::create_list())->as_list());
+  }
+
+private:
+  command_list m_commands;
+};
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_RPC_RESPONSE_BUFFER_H
+#define RTORRENT_RPC_RESPONSE_BUFFER_H
+
+#include <cstddef>
+#include <deque>
+#include <string>
+
+struct iovec;
+
+namespace rpc {
+
+// Output of an RPC call, kept as a list of segments. Serializers hand
+// over their strings as they are produced, and the writer sends them
+// with a single writev call instead of first copying everything into
+// one contiguous buffer.
+class ResponseBuffer {
+public:
+  using segment_list   = std::deque<std::string>;
+  using const_iterator = segment_list::const_iterator;
+
+  bool empty() const {
+    return m_size == 0;
+  }
+
+  // Number of bytes not yet consumed.
+  size_t size() const {
+    return m_size;
+  }
+
+  const_iterator begin() const {
+    return m_segments.begin();
+  }
+  const_iterator end() const {
+    return m_segments.end();
+  }
+
+  void push_back(std::string&& segment);
+  void push_back(const char* data, size_t length);
+  void push_front(std::string&& segment);
+
+  void clear();
+
+  // Fills 'iov' with up to 'count' entries pointing at the unconsumed
+  // data and returns the number of entries used.
+  int  fill_iovec(struct iovec* iov, int count) const;
+  void consume(size_t bytes);
+
+private:
+  segment_list m_segments;
+  size_t       m_offset{ 0 };
+  size_t       m_size{ 0 };
+};
+
+}
+
+#endif
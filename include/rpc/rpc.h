@@ -9,6 +9,8 @@
 
 #include <torrent/exceptions.h>
 
+#include "rpc/response_buffer.h"
+
 namespace core {
 class Download;
 }
@@ -23,7 +25,7 @@ namespace rpc {
 
 class IRpc {
 public:
-  using res_callback = std::function<bool(const char*, uint32_t)>;
+  using res_callback = std::function<bool(ResponseBuffer&&)>;
 
   virtual void initialize() {}
 
@@ -43,9 +43,14 @@ public:
   void cleanup();
 
   void insert_command(const char* name, const char* parm, const char* doc);
-  bool is_command_enabled( const char* const methodName );
   bool set_trusted_connection( bool enabled );
-  
+
+  // Whether the RPC call being processed by this thread, if any, came
+  // from a trusted connection. Always true outside of RPC calls.
+  static bool is_trusted_connection() {
+    return trustedXmlConnection;
+  }
+
   const slot_download& slot_find_download() const {
     return m_slotFindDownload;
   }
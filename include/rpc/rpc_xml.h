@@ -15,26 +15,27 @@ namespace rpc {
 class RpcXml final : public IRpc {
 #ifdef HAVE_XMLRPC_C
 public:
-  void initialize() override;
+  void initialize() override {
+    m_valid = true;
+  }
 
-  void cleanup() override;
+  void cleanup() override {
+    m_valid = false;
+  }
 
   bool is_valid() const override {
-    return m_env != nullptr;
+    return m_valid;
   }
 
+  // Calls are decoded and responses encoded by 'xmlrpc_codec', only
+  // the execution of the commands holds the global lock.
   bool process(const char*  inBuffer,
                uint32_t     length,
                res_callback callback,
                bool trusted = false) override;
 
-  void insert_command(const char* name,
-                      const char* parm,
-                      const char* doc) override;
-
 private:
-  void* m_env{ nullptr };
-  void* m_registry{ nullptr };
+  bool m_valid{ false };
 #endif
 };
 
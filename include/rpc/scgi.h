@@ -4,22 +4,63 @@
 #ifndef RTORRENT_RPC_SCGI_H
 #define RTORRENT_RPC_SCGI_H
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <torrent/event.h>
 #include <torrent/utils/cacheline.h>
 
+#include "rpc/event_stream.h"
 #include "rpc/scgi_task.h"
 
+struct iovec;
+
 namespace utils {
 class SocketFd;
 }
 
 namespace rpc {
 
+// The RPC log, shared by every thread serving connections. Threads
+// hold a reference while writing an entry, so the file is only closed
+// once the log has been replaced and no entry is being written.
+class SCgiLog {
+public:
+  static constexpr char separator[] = "\n---\n";
+
+  explicit SCgiLog(int fd)
+    : m_fd(fd) {}
+  ~SCgiLog();
+
+  SCgiLog(const SCgiLog&)            = delete;
+  SCgiLog& operator=(const SCgiLog&) = delete;
+
+  // Each entry is written with a single call, so entries from
+  // different threads don't interleave.
+  void write(const struct iovec* iov, int count) const;
+
+private:
+  int m_fd;
+};
+
 class lt_cacheline_aligned SCgi : public torrent::Event {
 public:
-  static constexpr int max_tasks = 100;
+  using task_list      = std::deque<SCgiTask>;
+  using task_free_list = std::vector<SCgiTask*>;
+
+  static constexpr unsigned int default_max_tasks = 100;
+
+  // The HTTP/1.1 protocol allows clients to talk to the listener
+  // directly and to keep their connection open between calls.
+  enum class Protocol { SCGI, HTTP };
+
+  explicit SCgi(Protocol protocol = Protocol::SCGI)
+    : m_protocol(protocol) {}
 
   // Global lock:
   ~SCgi() override;
@@ -34,15 +75,46 @@ public:
   void activate();
   void deactivate();
 
+  Protocol protocol() const {
+    return m_protocol;
+  }
+
   const std::string& path() const {
     return m_path;
   }
 
-  int log_fd() const {
-    return m_logFd;
+  std::shared_ptr<const SCgiLog> log() const {
+    std::lock_guard<std::mutex> guard(m_logLock);
+    return m_log;
   }
-  void set_log_fd(int fd) {
-    m_logFd = fd;
+  void set_log(std::shared_ptr<const SCgiLog> log) {
+    std::lock_guard<std::mutex> guard(m_logLock);
+    m_log.swap(log);
+  }
+
+  unsigned int max_tasks() const {
+    return m_maxTasks;
+  }
+  void set_max_tasks(unsigned int size);
+
+  // Connection statistics, safe to read from any thread. While all
+  // tasks are busy new connections wait in the listen backlog, and
+  // 'accept_paused' counts the times accepting was paused for it.
+  unsigned int size_tasks() const {
+    return m_activeTasks;
+  }
+  uint64_t accepted() const {
+    return m_accepted;
+  }
+  uint64_t rejected() const {
+    return m_rejected;
+  }
+  uint64_t accept_paused() const {
+    return m_acceptPausedCount;
+  }
+
+  EventStream& events() {
+    return m_events;
   }
 
   // Thread local:
@@ -50,8 +122,18 @@ public:
   void event_write() override;
   void event_error() override;
 
+  // Listener thread:
+  void resume_accept();
+
+  // Thread of the task:
   bool receive_call(SCgiTask* task, const char* buffer, uint32_t length, bool trusted);
 
+  // The task whose request is being processed by the calling thread,
+  // or nullptr outside of 'receive_call'.
+  static SCgiTask* current_task();
+
+  void release_task(SCgiTask* task, bool rejected);
+
   utils::SocketFd& get_fd() {
     return *reinterpret_cast<utils::SocketFd*>(&m_fileDesc);
   }
@@ -59,9 +141,30 @@ public:
 private:
   void open(void* sa, unsigned int length);
 
+  SCgiTask* acquire_task();
+
+  Protocol    m_protocol;
   std::string m_path;
-  int         m_logFd{ -1 };
-  SCgiTask    m_task[max_tasks];
+
+  mutable std::mutex             m_logLock;
+  std::shared_ptr<const SCgiLog> m_log;
+
+  // Tasks are never removed from 'm_tasks', which keeps the addresses
+  // registered with the polls stable. The task lists are shared with
+  // the threads the tasks run on.
+  std::mutex     m_taskLock;
+  task_list      m_tasks;
+  task_free_list m_freeTasks;
+  bool           m_acceptPaused{ false };
+  bool           m_resumeQueued{ false };
+
+  std::atomic<unsigned int> m_maxTasks{ default_max_tasks };
+  std::atomic<unsigned int> m_activeTasks{ 0 };
+  std::atomic<uint64_t>     m_accepted{ 0 };
+  std::atomic<uint64_t>     m_rejected{ 0 };
+  std::atomic<uint64_t>     m_acceptPausedCount{ 0 };
+
+  EventStream m_events;
 };
 
 }
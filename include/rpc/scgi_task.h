@@ -4,7 +4,14 @@
 #ifndef RTORRENT_RPC_SCGI_TASK_H
 #define RTORRENT_RPC_SCGI_TASK_H
 
+#include <string>
+
 #include <torrent/event.h>
+#include <torrent/utils/priority_queue_default.h>
+
+#include "rpc/response_buffer.h"
+
+class ThreadWorker;
 
 namespace utils {
 class SocketFd;
@@ -18,12 +25,19 @@ class SCgiTask : public torrent::Event {
 public:
   static constexpr unsigned int default_buffer_size = 2047;
   static constexpr int          max_header_size     = 2000;
+  static constexpr int          max_iovecs          = 64;
+
+  // Seconds a connection may go without progress, other than while
+  // streaming, before it is closed.
+  static constexpr int idle_timeout = 30;
 
   enum ContentType { XML, JSON };
 
   SCgiTask() {
     m_fileDesc = -1;
     m_trusted = false;
+
+    m_taskTimeout.slot() = [this] { close(); };
   }
 
   ContentType type() const {
@@ -37,34 +51,68 @@ public:
     return m_fileDesc == -1;
   }
 
-  void open(SCgi* parent, int fd);
-  void close();
+  // Opened on, and from then on only used by, the thread serving the
+  // connection.
+  void open(SCgi* parent, ThreadWorker* thread, int fd);
+
+  ThreadWorker* thread() const {
+    return m_thread;
+  }
+
+  // Closing a task returns it to the parent's free list. A rejected
+  // task is one closed because of an invalid request.
+  void close(bool rejected = false);
 
   void event_read() override;
   void event_write() override;
   void event_error() override;
 
-  bool receive_write(const char* buffer, uint32_t length);
+  bool receive_write(ResponseBuffer&& response);
+
+  // A streaming task keeps the connection open after the response to
+  // the current request, for notifications queued with 'write_stream'.
+  // Returns false if the connection can't keep up.
+  bool is_streaming() const {
+    return m_streaming;
+  }
+  void set_streaming() {
+    m_streaming = true;
+  }
+
+  bool write_stream(std::string&& data);
 
   utils::SocketFd& get_fd() {
     return *reinterpret_cast<utils::SocketFd*>(&m_fileDesc);
   }
 
 private:
+  void parse_request();
+  int  parse_http_header();
+  void restart();
+  void reset_timeout();
+
   inline void realloc_buffer(uint32_t    size,
                              const char* buffer     = nullptr,
                              uint32_t    bufferSize = 0);
 
   ContentType m_type{ XML };
 
-  SCgi* m_parent;
+  SCgi*         m_parent;
+  ThreadWorker* m_thread{ nullptr };
 
   char* m_buffer;
   char* m_position;
   char* m_body;
   bool  m_trusted;
+  bool  m_keepAlive{ false };
+  bool  m_streaming{ false };
 
   unsigned int m_bufferSize;
+
+  ResponseBuffer m_output;
+  std::string    m_pending;
+
+  torrent::utils::priority_item m_taskTimeout;
 };
 
 }
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_RPC_XMLRPC_CODEC_H
+#define RTORRENT_RPC_XMLRPC_CODEC_H
+
+#include <string>
+#include <utility>
+
+#include <torrent/exceptions.h>
+#include <torrent/object.h>
+
+namespace rpc {
+
+// XML-RPC encoding of torrent::Object. Calls are parsed straight into
+// objects and responses written into a string, without building an
+// intermediate value tree.
+//
+// Integers are read from 'i4', 'int', 'i8' and 'ex:i8', booleans as 0
+// or 1, 'base64' is decoded into a string and structs become maps.
+// Untyped values are strings. Doubles, dates and nil are rejected.
+//
+// Responses use 'i8' for integers. Strings that aren't valid UTF-8
+// have control characters and bytes above 0x7f replaced by '?'.
+
+static constexpr int xmlrpc_internal_error        = -500;
+static constexpr int xmlrpc_type_error            = -501;
+static constexpr int xmlrpc_index_error           = -502;
+static constexpr int xmlrpc_parse_error           = -503;
+static constexpr int xmlrpc_no_such_method_error  = -506;
+static constexpr int xmlrpc_request_refused_error = -507;
+static constexpr int xmlrpc_limit_exceeded_error  = -509;
+
+class xmlrpc_error : public torrent::base_error {
+public:
+  xmlrpc_error(int type, std::string msg)
+    : m_type(type)
+    , m_msg(std::move(msg)) {}
+  ~xmlrpc_error() override = default;
+
+  int type() const noexcept {
+    return m_type;
+  }
+  const char* what() const noexcept override {
+    return m_msg.c_str();
+  }
+
+private:
+  int         m_type;
+  std::string m_msg;
+};
+
+// Parses a 'methodCall' document, throwing xmlrpc_error if it is
+// malformed or nested too deeply.
+void
+xmlrpc_parse_call(const char*                 first,
+                  const char*                 last,
+                  std::string*                method,
+                  torrent::Object::list_type* params);
+
+void
+xmlrpc_write_value(std::string* output, const torrent::Object& object);
+
+void
+xmlrpc_write_response(std::string* output, const torrent::Object& object);
+
+void
+xmlrpc_write_fault(std::string* output, int code, const std::string& message);
+
+}
+
+#endif
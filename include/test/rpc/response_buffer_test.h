@@ -0,0 +1,8 @@
+#include <gtest/gtest.h>
+
+#include "rpc/response_buffer.h"
+
+class ResponseBufferTest : public ::testing::Test {
+public:
+  rpc::ResponseBuffer m_buffer;
+};
@@ -4,21 +4,22 @@
 #ifndef RTORRENT_UTILS_THREAD_BASE_H
 #define RTORRENT_UTILS_THREAD_BASE_H
 
+#include <functional>
 #include <sys/types.h>
 
 #include <torrent/utils/priority_queue_default.h>
 #include <torrent/utils/thread_base.h>
 
 #include "core/poll_manager.h"
+#include "utils/mpsc_queue.h"
 
 // Move this class to libtorrent.
 
-class thread_queue_hack;
-
 class ThreadBase : public torrent::thread_base {
 public:
   using priority_queue   = torrent::utils::priority_queue_default;
   using thread_base_func = void (*)(ThreadBase*);
+  using thread_item      = std::function<void(ThreadBase*)>;
 
   ThreadBase();
   ~ThreadBase() override;
@@ -31,9 +32,10 @@ public:
   static void stop_thread(ThreadBase* thread);
 
   // ATM, only interaction with a thread's allowed by other threads is
-  // through the queue_item call.
+  // through the queue_item call. Items are called on the thread in the
+  // order they were queued, and queuing never blocks or fails.
 
-  void queue_item(thread_base_func newFunc);
+  void queue_item(thread_item item);
 
 protected:
   int64_t next_timeout_usec() override;
@@ -49,9 +51,7 @@ protected:
 
   torrent::utils::priority_item m_taskShutdown;
 
-  // Temporary hack to pass messages to a thread. This really needs to
-  // be cleaned up and/or integrated into the priority queue itself.
-  thread_queue_hack* m_threadQueue;
+  utils::mpsc_queue<thread_item> m_threadQueue;
 };
 
 #endif
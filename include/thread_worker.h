@@ -5,6 +5,8 @@
 #define RTORRENT_THREAD_WORKER_H
 
 #include <atomic>
+#include <string>
+#include <vector>
 
 #include "thread_base.h"
 
@@ -13,6 +15,7 @@
 
 namespace rpc {
 class SCgi;
+class SCgiTask;
 }
 
 // Check if cacheline aligned with inheritance ends up taking two
@@ -20,6 +23,10 @@ class SCgi;
 
 class lt_cacheline_aligned ThreadWorker : public ThreadBase {
 public:
+  using thread_list = std::vector<ThreadWorker*>;
+
+  static constexpr unsigned int max_threads = 64;
+
   ~ThreadWorker() override;
 
   const char* name() const override {
@@ -33,10 +40,28 @@ public:
   }
   bool set_scgi(rpc::SCgi* scgi);
 
+  // Connections accepted by the SCGI listener of this thread are
+  // spread over it and its helper threads, each with its own poll.
+  // Helpers are created before the listener is set, and started
+  // along with it.
+  const thread_list& helpers() const {
+    return m_helpers;
+  }
+  void create_helpers(unsigned int count);
+
+  // Listener thread:
+  ThreadWorker* next_thread();
+
+  // Any thread:
+  void queue_connection(rpc::SCgi* parent, rpc::SCgiTask* task, int fd);
+  void queue_deliver_events();
+
   void set_rpc_log(const std::string& filename);
 
   static void start_scgi(ThreadBase* thread);
   static void msg_change_rpc_log(ThreadBase* thread);
+  static void msg_deliver_events(ThreadBase* thread);
+  static void msg_resume_accept(ThreadBase* thread);
 
 private:
   void task_touch_log();
@@ -48,6 +73,12 @@ private:
   // The following types shall only be modified while holding the
   // global lock.
   std::string m_rpcLog;
+
+  thread_list  m_helpers;
+  unsigned int m_nextThread{ 0 };
+
+  // Keeps a single delivery queued for any number of events.
+  std::atomic<bool> m_deliveryQueued{ false };
 };
 
 #endif
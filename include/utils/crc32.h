@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+// CRC-32 (IEEE 802.3) used to detect torn or corrupted writes of
+// session data. Pass the previous result as 'crc' to continue a
+// checksum over several buffers.
+
+#ifndef RTORRENT_UTILS_CRC32_H
+#define RTORRENT_UTILS_CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace utils {
+
+uint32_t
+crc32(const char* data, size_t length, uint32_t crc = 0);
+
+}
+
+#endif
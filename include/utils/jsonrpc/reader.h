@@ -0,0 +1,323 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#ifndef RTORRENT_UTILS_JSONRPC_READER_H
+#define RTORRENT_UTILS_JSONRPC_READER_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <torrent/object.h>
+
+#include "common.h"
+
+namespace jsonrpccxx {
+
+// A request object as read from the body. Only the members the server
+// looks at are kept, and the parameters are read straight into
+// torrent::Object.
+struct JsonRpcRequest {
+  enum params_type {
+    params_missing,
+    params_null,
+    params_array,
+    params_object,
+    params_other
+  };
+
+  bool isObject{ false };
+
+  // The "jsonrpc" member is "2.0", "method" is a string and "id" a
+  // number, string or null.
+  bool hasVersion{ false };
+  bool hasMethod{ false };
+  bool hasId{ false };
+
+  std::string     method;
+  json            id;
+  params_type     paramsType{ params_missing };
+  torrent::Object params;
+};
+
+// SAX handler for nlohmann::json::sax_parse that reads a single request
+// or a batch without building a DOM of the body.
+//
+// Parameter values are converted as they are read: integers and
+// booleans to values, strings and nested arrays as is. Values with no
+// torrent::Object equivalent, i.e. null, floats, objects and integers
+// too large for int64_t, are left empty for the handler to reject.
+class JsonRpcReader {
+public:
+  using requests_type = std::vector<JsonRpcRequest>;
+
+  // Returns false if the body isn't valid JSON, with the message in
+  // 'error'.
+  bool parse(const std::string_view& input) {
+    return json::sax_parse(input.begin(), input.end(), this);
+  }
+
+  bool is_batch() const {
+    return m_batch;
+  }
+
+  // The body was valid JSON but neither an array nor an object.
+  bool is_scalar() const {
+    return m_scalar;
+  }
+
+  requests_type&     requests() {
+    return m_requests;
+  }
+  const std::string& error() const {
+    return m_error;
+  }
+
+  bool null() {
+    return m_skip != 0 || (m_stack.empty() ? member(json(nullptr))
+                                           : param(torrent::Object()));
+  }
+
+  bool boolean(bool value) {
+    return m_skip != 0 || (m_stack.empty() ? member(json(value))
+                                           : param(int64_t(value)));
+  }
+
+  bool number_integer(json::number_integer_t value) {
+    return m_skip != 0 || (m_stack.empty() ? member(json(value))
+                                           : param(int64_t(value)));
+  }
+
+  bool number_unsigned(json::number_unsigned_t value) {
+    if (m_skip != 0)
+      return true;
+
+    if (m_stack.empty())
+      return member(json(value));
+
+    if (value > (json::number_unsigned_t)std::numeric_limits<int64_t>::max())
+      return param(torrent::Object());
+
+    return param(int64_t(value));
+  }
+
+  bool number_float(json::number_float_t value, const json::string_t&) {
+    return m_skip != 0 || (m_stack.empty() ? member(json(value))
+                                           : param(torrent::Object()));
+  }
+
+  bool string(json::string_t& value) {
+    if (m_skip != 0)
+      return true;
+
+    if (m_stack.empty())
+      return member(json(std::move(value)));
+
+    torrent::Object object = torrent::Object::create_string();
+    object.as_string().swap(value);
+
+    return param(std::move(object));
+  }
+
+  bool binary(json::binary_t&) {
+    return m_skip != 0 || (m_stack.empty() ? member(json())
+                                           : param(torrent::Object()));
+  }
+
+  bool start_object(std::size_t) {
+    if (m_skip != 0) {
+      m_skip++;
+
+    } else if (!m_stack.empty()) {
+      m_stack.back()->as_list().emplace_back();
+      m_skip = 1;
+
+    } else if (m_inRequest) {
+      if (m_key == key_params)
+        m_requests.back().paramsType = JsonRpcRequest::params_object;
+      else
+        member_invalid();
+
+      m_skip = 1;
+
+    } else {
+      // The request itself, or an entry of the batch.
+      m_started   = true;
+      m_inRequest = true;
+      m_key       = key_other;
+
+      m_requests.emplace_back();
+      m_requests.back().isObject = true;
+    }
+
+    return true;
+  }
+
+  bool key(json::string_t& name) {
+    if (m_skip != 0 || !m_stack.empty() || !m_inRequest)
+      return true;
+
+    if (name == "jsonrpc")
+      m_key = key_jsonrpc;
+    else if (name == "method")
+      m_key = key_method;
+    else if (name == "id")
+      m_key = key_id;
+    else if (name == "params")
+      m_key = key_params;
+    else
+      m_key = key_other;
+
+    return true;
+  }
+
+  bool end_object() {
+    if (m_skip != 0)
+      m_skip--;
+    else
+      m_inRequest = false;
+
+    return true;
+  }
+
+  bool start_array(std::size_t) {
+    if (m_skip != 0) {
+      m_skip++;
+
+    } else if (!m_stack.empty()) {
+      auto& list = m_stack.back()->as_list();
+      list.push_back(torrent::Object::create_list());
+      m_stack.push_back(&list.back());
+
+    } else if (m_inRequest) {
+      if (m_key == key_params) {
+        JsonRpcRequest& request = m_requests.back();
+
+        request.paramsType = JsonRpcRequest::params_array;
+        request.params     = torrent::Object::create_list();
+        m_stack.push_back(&request.params);
+      } else {
+        member_invalid();
+        m_skip = 1;
+      }
+
+    } else if (!m_started) {
+      m_started = true;
+      m_batch   = true;
+
+    } else {
+      // Batch entries that aren't objects are invalid requests.
+      m_requests.emplace_back();
+      m_skip = 1;
+    }
+
+    return true;
+  }
+
+  bool end_array() {
+    if (m_skip != 0)
+      m_skip--;
+    else if (!m_stack.empty())
+      m_stack.pop_back();
+
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& e) {
+    m_error = std::string("parse error: ") + e.what();
+    return false;
+  }
+
+private:
+  enum key_type { key_other, key_jsonrpc, key_method, key_id, key_params };
+
+  bool param(torrent::Object&& object) {
+    auto& list = m_stack.back()->as_list();
+
+    list.push_back(torrent::Object());
+    list.back().swap(object);
+    return true;
+  }
+
+  // A scalar outside of the parameters, which is either a member of a
+  // request or a body or batch entry that isn't an object.
+  bool member(json&& value) {
+    if (!m_inRequest) {
+      if (!m_started) {
+        m_started = true;
+        m_scalar  = true;
+      } else {
+        m_requests.emplace_back();
+      }
+
+      return true;
+    }
+
+    JsonRpcRequest& request = m_requests.back();
+
+    switch (m_key) {
+      case key_jsonrpc:
+        request.hasVersion = value.is_string() && value == "2.0";
+        break;
+
+      case key_method:
+        request.hasMethod = value.is_string();
+
+        if (request.hasMethod)
+          request.method = std::move(value.get_ref<std::string&>());
+        break;
+
+      case key_id:
+        request.hasId = value.is_string() || value.is_null() || value.is_number();
+        request.id    = request.hasId ? std::move(value) : json();
+        break;
+
+      case key_params:
+        request.paramsType = value.is_null() ? JsonRpcRequest::params_null
+                                             : JsonRpcRequest::params_other;
+        break;
+
+      default:
+        break;
+    }
+
+    return true;
+  }
+
+  // A container was found where a string or number was expected.
+  void member_invalid() {
+    JsonRpcRequest& request = m_requests.back();
+
+    switch (m_key) {
+      case key_jsonrpc:
+        request.hasVersion = false;
+        break;
+      case key_method:
+        request.hasMethod = false;
+        break;
+      case key_id:
+        request.hasId = false;
+        request.id    = json();
+        break;
+      default:
+        break;
+    }
+  }
+
+  requests_type                 m_requests;
+  std::vector<torrent::Object*> m_stack;
+  std::string                   m_error;
+
+  bool     m_started{ false };
+  bool     m_batch{ false };
+  bool     m_scalar{ false };
+  bool     m_inRequest{ false };
+  size_t   m_skip{ 0 };
+  key_type m_key{ key_other };
+};
+
+}
+
+#endif
@@ -9,141 +9,258 @@
 #ifndef RTORRENT_UTILS_JSONRPC_SERVER_H
 #define RTORRENT_UTILS_JSONRPC_SERVER_H
 
+#include <functional>
 #include <string>
+#include <vector>
 
 #include "common.h"
+#include "reader.h"
 
 namespace jsonrpccxx {
 class JsonRpcServer {
 public:
+  // A request is handled in three steps. The handler decodes the call
+  // and returns a JsonRpcCall, which is run with the lock held and
+  // returns a JsonRpcResult, which writes the result as JSON after the
+  // lock has been released.
+  using JsonRpcResult = std::function<void(std::string* output)>;
+  using JsonRpcCall   = std::function<JsonRpcResult()>;
   using JsonRpcHandler =
-    std::function<json(const std::string& name, const json& params)>;
+    std::function<JsonRpcCall(const std::string& name, torrent::Object& params)>;
+  using JsonRpcLock   = std::function<void()>;
+  using JsonRpcWriter = std::function<void(std::string&&)>;
 
-  JsonRpcServer(JsonRpcHandler handler)
-    : m_handler(handler) {}
-  virtual ~JsonRpcServer()                                           = default;
-  virtual std::string HandleRequest(const std::string_view& request) = 0;
+  JsonRpcServer(JsonRpcHandler handler,
+                JsonRpcLock    lock   = JsonRpcLock(),
+                JsonRpcLock    unlock = JsonRpcLock())
+    : m_handler(handler)
+    , m_lock(lock)
+    , m_unlock(unlock) {}
+  virtual ~JsonRpcServer() = default;
+
+  // The response is passed to 'writer' in one or more pieces, which
+  // lets large batches be handed over while they are being written.
+  virtual void HandleRequest(const std::string_view& request,
+                             const JsonRpcWriter&    writer) = 0;
+
+  std::string HandleRequest(const std::string_view& request) {
+    std::string response;
+    HandleRequest(request, [&response](std::string&& piece) {
+      response.append(piece);
+    });
+    return response;
+  }
 
 protected:
   JsonRpcHandler m_handler;
+  JsonRpcLock    m_lock;
+  JsonRpcLock    m_unlock;
 };
 
 class JsonRpc2Server : public JsonRpcServer {
 public:
-  JsonRpc2Server(JsonRpcHandler handler)
-    : JsonRpcServer(handler) {}
+  // Batch responses are handed to the writer in pieces of about this
+  // size.
+  static constexpr size_t piece_size = 64 << 10;
+
+  JsonRpc2Server(JsonRpcHandler handler,
+                 JsonRpcLock    lock   = JsonRpcLock(),
+                 JsonRpcLock    unlock = JsonRpcLock())
+    : JsonRpcServer(handler, lock, unlock) {}
   ~JsonRpc2Server() override = default;
 
-  std::string HandleRequest(const std::string_view& requestString) override {
-    try {
-      json request = json::parse(requestString);
-      if (request.is_array()) {
-        json result = json::array();
-        for (json& r : request) {
-          json res = this->HandleSingleRequest(r);
-          if (!res.is_null()) {
-            result.push_back(std::move(res));
-          }
-        }
-        return result.dump(-1, ' ', false, json::error_handler_t::replace);
-      } else if (request.is_object()) {
-        json res = HandleSingleRequest(request);
-        if (!res.is_null()) {
-          return res.dump(-1, ' ', false, json::error_handler_t::replace);
-        } else {
-          return "";
-        }
-      } else {
-        return json{
-          { "id", nullptr },
-          { "error",
-            { { "code", -32600 },
-              { "message", "invalid request: expected array or object" } } },
-          { "jsonrpc", "2.0" }
-        }.dump();
+  using JsonRpcServer::HandleRequest;
+
+  // The body is read without building a DOM, with the parameters of
+  // each request going straight into torrent::Object, and responses
+  // are written directly into the output.
+  void HandleRequest(const std::string_view& requestString,
+                     const JsonRpcWriter&    writer) override {
+    JsonRpcReader reader;
+    std::string   output;
+
+    if (!reader.parse(requestString)) {
+      WriteError(&output, json(), MakeError(-32700, reader.error()));
+      writer(std::move(output));
+      return;
+    }
+
+    if (reader.is_scalar()) {
+      WriteError(&output,
+                 json(),
+                 MakeError(-32600, "invalid request: expected array or object"));
+      writer(std::move(output));
+      return;
+    }
+
+    auto&                       requests = reader.requests();
+    std::vector<PendingRequest> pending(requests.size());
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+      PrepareSingleRequest(requests[i], pending[i]);
+    }
+
+    // The whole batch shares a single lock acquisition.
+    ExecuteRequests(pending);
+
+    if (reader.is_batch()) {
+      output.push_back('[');
+    }
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+      if (i != 0) {
+        output.push_back(',');
+      }
+
+      FinishSingleRequest(pending[i], &output);
+      pending[i] = PendingRequest();
+
+      if (output.size() >= piece_size) {
+        writer(std::move(output));
+        output = std::string();
       }
-    } catch (json::parse_error& e) {
-      return json{
-        { "id", nullptr },
-        { "error",
-          { { "code", -32700 },
-            { "message", std::string("parse error: ") + e.what() } } },
-        { "jsonrpc", "2.0" }
-      }.dump();
-    } catch (json::exception& e) {
-      return json{
-        { "id", nullptr },
-        { "error",
-          { { "code", -32700 },
-            { "message", std::string("compose error: ") + e.what() } } },
-        { "jsonrpc", "2.0" }
-      }.dump();
     }
+
+    if (reader.is_batch()) {
+      output.push_back(']');
+    }
+
+    writer(std::move(output));
   }
 
 private:
-  json HandleSingleRequest(json& request) {
-    json id = nullptr;
-    if (valid_id(request)) {
-      id = request["id"];
+  struct PendingRequest {
+    json          id;
+    JsonRpcCall   call;
+    JsonRpcResult result;
+    json          error;
+  };
+
+  static json MakeError(int code, const std::string& message) {
+    return { { "code", code }, { "message", message } };
+  }
+
+  static json MakeError(JsonRpcException& e) {
+    json error = MakeError(e.Code(), e.Message());
+    if (!e.Data().is_null()) {
+      error["data"] = e.Data();
     }
+    return error;
+  }
+
+  static void WriteJson(std::string* output, const json& value) {
+    output->append(value.dump(-1, ' ', false, json::error_handler_t::replace));
+  }
+
+  // Members are written in the order nlohmann::json sorts them.
+  static void WriteError(std::string* output, const json& id, const json& error) {
+    output->append("{\"error\":");
+    WriteJson(output, error);
+    output->append(",\"id\":");
+    WriteJson(output, id);
+    output->append(",\"jsonrpc\":\"2.0\"}");
+  }
+
+  // Run 'function' and store any error it throws in the request.
+  template<typename Function>
+  static void CatchErrors(PendingRequest& pending, Function function) {
     try {
-      return ProcessSingleRequest(request);
+      function();
     } catch (JsonRpcException& e) {
-      json error = { { "code", e.Code() }, { "message", e.Message() } };
-      if (!e.Data().is_null()) {
-        error["data"] = e.Data();
-      }
-      return json{ { "id", id }, { "error", error }, { "jsonrpc", "2.0" } };
+      pending.error = MakeError(e);
     } catch (std::exception& e) {
-      return json{
-        { "id", id },
-        { "error",
-          { { "code", -32603 },
-            { "message",
-              std::string("internal server error: ") + e.what() } } },
-        { "jsonrpc", "2.0" }
-      };
+      pending.error =
+        MakeError(-32603, std::string("internal server error: ") + e.what());
     } catch (...) {
-      return json{ { "id", id },
-                   { "error",
-                     { { "code", -32603 },
-                       { "message", std::string("internal server error") } } },
-                   { "jsonrpc", "2.0" } };
+      pending.error = MakeError(-32603, "internal server error");
+    }
+  }
+
+  void PrepareSingleRequest(JsonRpcRequest& request, PendingRequest& pending) {
+    if (request.hasId) {
+      pending.id = std::move(request.id);
+    }
+    CatchErrors(pending, [&] { pending.call = ProcessSingleRequest(request); });
+  }
+
+  void ExecuteRequests(std::vector<PendingRequest>& pending) {
+    bool locked = false;
+
+    for (PendingRequest& p : pending) {
+      if (!p.call) {
+        continue;
+      }
+
+      if (!locked && m_lock) {
+        m_lock();
+      }
+      locked = true;
+
+      CatchErrors(p, [&] { p.result = p.call(); });
+    }
+
+    if (locked && m_unlock) {
+      m_unlock();
     }
   }
 
-  json ProcessSingleRequest(json& request) {
-    if (!has_key_type(request, "jsonrpc", json::value_t::string) ||
-        request["jsonrpc"] != "2.0") {
+  void FinishSingleRequest(PendingRequest& pending, std::string* output) {
+    if (pending.error.is_null()) {
+      size_t start = output->size();
+
+      output->append("{\"id\":");
+      WriteJson(output, pending.id);
+      output->append(",\"jsonrpc\":\"2.0\",\"result\":");
+
+      if (pending.result) {
+        CatchErrors(pending, [&] { pending.result(output); });
+      } else {
+        output->append("null");
+      }
+
+      if (pending.error.is_null()) {
+        output->push_back('}');
+        return;
+      }
+
+      output->resize(start);
+    }
+
+    WriteError(output, pending.id, pending.error);
+  }
+
+  JsonRpcCall ProcessSingleRequest(JsonRpcRequest& request) {
+    if (!request.hasVersion) {
       throw JsonRpcException(
         -32600, R"(invalid request: missing jsonrpc field set to "2.0")");
     }
-    if (!has_key_type(request, "method", json::value_t::string)) {
+    if (!request.hasMethod) {
       throw JsonRpcException(-32600,
                              "invalid request: method field must be a string");
     }
-    if (!valid_id(request)) {
+    if (!request.hasId) {
       throw JsonRpcException(
         -32600, "invalid request: id field must be a number, string or null");
     }
-    if (has_key(request, "params") &&
-        !(request["params"].is_array() || request["params"].is_object() ||
-          request["params"].is_null())) {
-      throw JsonRpcException(
-        -32600,
-        "invalid request: params field must be an array, object or null");
-    }
-    if (!has_key(request, "params") ||
-        has_key_type(request, "params", json::value_t::null)) {
-      request["params"] = json::array();
-    }
 
-    const auto& result = m_handler(request["method"], request["params"]);
+    switch (request.paramsType) {
+      case JsonRpcRequest::params_other:
+        throw JsonRpcException(
+          -32600,
+          "invalid request: params field must be an array, object or null");
+      case JsonRpcRequest::params_object:
+        throw JsonRpcException(
+          -32602,
+          "invalid parameter: procedure doesn't support named parameter");
+      case JsonRpcRequest::params_missing:
+      case JsonRpcRequest::params_null:
+        request.params = torrent::Object::create_list();
+        break;
+      default:
+        break;
+    }
 
-    return { { "jsonrpc", "2.0" },
-             { "id", request["id"] },
-             { "result", result } };
+    return m_handler(request.method, request.params);
   }
 };
 }
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+// Stream buffers over memory, for bencoding objects into a string and
+// decoding them from a mapped file without intermediate copies.
+
+#ifndef RTORRENT_UTILS_MEMORY_STREAM_H
+#define RTORRENT_UTILS_MEMORY_STREAM_H
+
+#include <streambuf>
+#include <string>
+
+namespace utils {
+
+// Appends everything written to the string.
+class string_streambuf : public std::streambuf {
+public:
+  explicit string_streambuf(std::string* buffer)
+    : m_buffer(buffer) {}
+
+protected:
+  int_type overflow(int_type c) override {
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      m_buffer->push_back(traits_type::to_char_type(c));
+
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    m_buffer->append(s, n);
+    return n;
+  }
+
+private:
+  std::string* m_buffer;
+};
+
+// Reads from the range [first, last), which must outlive the stream.
+class memory_streambuf : public std::streambuf {
+public:
+  memory_streambuf(const char* first, const char* last) {
+    setg(const_cast<char*>(first),
+         const_cast<char*>(first),
+         const_cast<char*>(last));
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+// Unbounded lock-free queue for any number of producers and a single
+// consumer, after Dmitry Vyukov's intrusive MPSC node queue.
+//
+// A push is one allocation and one atomic exchange, and never waits
+// on other producers or on the consumer. A producer that is preempted
+// between the exchange and linking its node hides the items pushed
+// after it until it resumes, so the consumer may see the queue as
+// empty while items are on their way. Producers should therefore wake
+// the consumer after pushing, as ThreadBase::queue_item does.
+
+#ifndef RTORRENT_UTILS_MPSC_QUEUE_H
+#define RTORRENT_UTILS_MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+#include <torrent/utils/cacheline.h>
+
+namespace utils {
+
+template<typename T>
+class mpsc_queue {
+public:
+  using value_type = T;
+
+  mpsc_queue()
+    : m_head(new node_type)
+    , m_tail(m_head.load(std::memory_order_relaxed)) {}
+
+  ~mpsc_queue() {
+    while (m_tail != nullptr) {
+      node_type* next = m_tail->next.load(std::memory_order_relaxed);
+      delete m_tail;
+      m_tail = next;
+    }
+  }
+
+  mpsc_queue(const mpsc_queue&) = delete;
+  mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+  // Any thread:
+  void push(value_type value) {
+    node_type* node = new node_type(std::move(value));
+    node_type* prev = m_head.exchange(node, std::memory_order_acq_rel);
+
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // Consumer thread:
+  bool empty() const {
+    return m_tail->next.load(std::memory_order_acquire) == nullptr;
+  }
+
+  bool pop(value_type* value) {
+    node_type* tail = m_tail;
+    node_type* next = tail->next.load(std::memory_order_acquire);
+
+    if (next == nullptr)
+      return false;
+
+    // The popped node becomes the new stub, its value is moved out
+    // so that it isn't kept alive until the next pop.
+    *value      = std::move(next->value);
+    next->value = value_type();
+    m_tail      = next;
+
+    delete tail;
+    return true;
+  }
+
+private:
+  struct node_type {
+    node_type() = default;
+    explicit node_type(value_type&& v)
+      : value(std::move(v)) {}
+
+    std::atomic<node_type*> next{ nullptr };
+    value_type              value;
+  };
+
+  // Producers swap in new nodes at the head, the consumer follows the
+  // links from the tail. They are kept on separate cache lines.
+  std::atomic<node_type*> lt_cacheline_aligned m_head;
+  node_type* lt_cacheline_aligned              m_tail;
+};
+
+}
+
+#endif
@@ -3,7 +3,11 @@
 
 #include <cstdio>
 #include <functional>
+#include <list>
+#include <memory>
 #include <regex>
+#include <string_view>
+#include <unordered_map>
 
 #include <torrent/connection_manager.h>
 #include <torrent/data/download_data.h>
@@ -29,6 +33,7 @@
 #include "core/download.h"
 #include "core/download_store.h"
 #include "core/manager.h"
+#include "rpc/multicall_plan.h"
 #include "rpc/parse.h"
 
 #include "command_helpers.h"
@@ -177,6 +182,8 @@ apply_d_directory(core::Download* download, const std::string& name) {
 
 torrent::Object
 apply_d_connection_type(core::Download* download, const std::string& name) {
+  download->set_session_dirty();
+
   torrent::Download::ConnectionType t =
     (torrent::Download::ConnectionType)torrent::option_find_string(
       torrent::OPTION_CONNECTION_TYPE, name.c_str());
@@ -189,6 +196,8 @@ torrent::Object
 apply_d_choke_heuristics(core::Download*    download,
                          const std::string& name,
                          bool               is_down) {
+  download->set_session_dirty();
+
   torrent::Download::HeuristicType t =
     (torrent::Download::HeuristicType)torrent::option_find_string(
       torrent::OPTION_CHOKE_HEURISTICS, name.c_str());
@@ -231,6 +240,8 @@ retrieve_d_ratio(core::Download* download) {
 torrent::Object
 apply_d_custom(core::Download*                   download,
                const torrent::Object::list_type& args) {
+  download->set_session_dirty();
+
   torrent::Object::list_const_iterator itr = args.begin();
 
   if (itr == args.end())
@@ -398,63 +409,181 @@ d_chunks_seen(core::Download* download) {
   return result;
 }
 
+// Compiled f.multicall patterns, most recently used first, so UIs
+// polling the same filters don't recompile them on every call.
+static constexpr size_t file_pattern_cache_size = 32;
+
+using file_regex_ptr = std::shared_ptr<const std::regex>;
+using file_regex_lru = std::list<std::pair<std::string, file_regex_ptr>>;
+
+static file_regex_lru file_regex_cache;
+static std::unordered_map<std::string, file_regex_lru::iterator>
+  file_regex_index;
+
+static file_regex_ptr
+file_regex_compile(const std::string& pattern) {
+  auto found = file_regex_index.find(pattern);
+
+  if (found != file_regex_index.end()) {
+    file_regex_cache.splice(
+      file_regex_cache.begin(), file_regex_cache, found->second);
+    return found->second->second;
+  }
+
+  // Throws std::regex_error, which isn't cached.
+  auto compiled = std::make_shared<const std::regex>(pattern);
+
+  if (file_regex_cache.size() >= file_pattern_cache_size) {
+    file_regex_index.erase(file_regex_cache.back().first);
+    file_regex_cache.pop_back();
+  }
+
+  file_regex_cache.emplace_front(pattern, compiled);
+  file_regex_index.emplace(pattern, file_regex_cache.begin());
+
+  return compiled;
+}
+
+// An f.multicall file filter. Patterns that are a plain string with an
+// optional leading and trailing '.*', like '.*\\.mkv', are matched
+// without the regex engine.
+class file_pattern {
+public:
+  explicit file_pattern(const std::string& pattern) {
+    std::string_view literal = pattern;
+
+    m_anyPrefix = literal.substr(0, 2) == ".*";
+    if (m_anyPrefix)
+      literal.remove_prefix(2);
+
+    m_anySuffix = literal.size() >= 2 &&
+                  literal.substr(literal.size() - 2) == ".*" &&
+                  (literal.size() < 3 || literal[literal.size() - 3] != '\\');
+    if (m_anySuffix)
+      literal.remove_suffix(2);
+
+    if (unescape_literal(literal)) {
+      m_regex.reset();
+      return;
+    }
+
+    m_literal.clear();
+    m_regex = file_regex_compile(pattern);
+  }
+
+  bool matches(const std::string& path) const {
+    if (m_regex != nullptr)
+      return std::regex_match(path, *m_regex);
+
+    if (path.size() < m_literal.size())
+      return false;
+
+    const std::string_view view = path;
+
+    if (!m_anyPrefix && !m_anySuffix)
+      return view == m_literal;
+
+    size_t position;
+
+    if (!m_anyPrefix)
+      position = view.substr(0, m_literal.size()) == m_literal
+                   ? 0
+                   : std::string_view::npos;
+    else if (!m_anySuffix)
+      position = view.substr(view.size() - m_literal.size()) == m_literal
+                   ? view.size() - m_literal.size()
+                   : std::string_view::npos;
+    else
+      position = view.find(m_literal);
+
+    if (position == std::string_view::npos)
+      return false;
+
+    // The '.' in '.*' doesn't match line terminators.
+    const auto is_terminator = [](char c) { return c == '\n' || c == '\r'; };
+
+    return std::none_of(view.begin(), view.begin() + position, is_terminator) &&
+           std::none_of(view.begin() + position + m_literal.size(),
+                        view.end(),
+                        is_terminator);
+  }
+
+private:
+  // Returns false if 'str' has any regex syntax besides escaped
+  // punctuation.
+  bool unescape_literal(std::string_view str) {
+    static constexpr std::string_view special = "^$\\.*+?()[]{}|";
+
+    m_literal.clear();
+    m_literal.reserve(str.size());
+
+    for (size_t i = 0; i < str.size(); ++i) {
+      if (str[i] == '\\') {
+        if (++i == str.size() || special.find(str[i]) == std::string_view::npos)
+          return false;
+      } else if (special.find(str[i]) != std::string_view::npos) {
+        return false;
+      }
+
+      m_literal += str[i];
+    }
+
+    return true;
+  }
+
+  file_regex_ptr m_regex;
+  std::string    m_literal;
+  bool           m_anyPrefix;
+  bool           m_anySuffix;
+};
+
 torrent::Object
 f_multicall(core::Download* download, const torrent::Object::list_type& args) {
   if (args.empty())
     throw torrent::input_error("Too few arguments.");
 
-  // We ignore the first arg for now, but it will be used for
-  // selecting what files to include.
+  // The first argument is a regex, or a list of them, selecting the
+  // files to include by path. The patterns are compiled once per call.
+  std::vector<file_pattern> patterns;
 
-  // Add some pre-parsing of the commands, so we don't spend time
-  // parsing and searching command map for every single call.
-  torrent::Object             resultRaw = torrent::Object::create_list();
-  torrent::Object::list_type& result    = resultRaw.as_list();
-  std::vector<std::string>    regex_list;
+  const auto add_pattern = [&patterns](const std::string& pattern) {
+    try {
+      patterns.emplace_back(pattern);
+    } catch (const std::regex_error& e) {
+      // Invalid patterns don't match anything.
+      control->core()->push_log_std("regex_error: " + std::string(e.what()));
+    }
+  };
 
   bool use_regex = true;
 
   if (args.front().is_list())
-    std::transform(args.front().as_list().begin(),
-                   args.front().as_list().end(),
-                   std::back_inserter(regex_list),
-                   [](const auto& object) { return object.as_string_c(); });
+    for (const auto& object : args.front().as_list())
+      add_pattern(object.as_string_c());
   else if (args.front().is_string() && !args.front().as_string().empty())
-    regex_list.push_back(args.front().as_string());
+    add_pattern(args.front().as_string());
   else
     use_regex = false;
 
+  rpc::MulticallPlan          plan(++args.begin(), args.end());
+  torrent::Object             resultRaw = torrent::Object::create_list();
+  torrent::Object::list_type& result    = resultRaw.as_list();
+
   for (torrent::FileList::const_iterator itr  = download->file_list()->begin(),
                                          last = download->file_list()->end();
        itr != last;
        itr++) {
-    if (use_regex &&
-        std::find_if(
-          regex_list.begin(), regex_list.end(), [itr](std::string pattern) {
-            bool isAMatch = false;
-            try {
-              std::regex re(pattern);
-              isAMatch = std::regex_match((*itr)->path()->as_string(), re);
-            } catch (const std::regex_error& e) {
-              control->core()->push_log_std("regex_error: " +
-                                            std::string(e.what()));
-            }
-            return isAMatch;
-          }) == regex_list.end())
-      continue;
-
-    torrent::Object::list_type& row =
-      result.insert(result.end(), torrent::Object::create_list())->as_list();
-
-    for (torrent::Object::list_const_iterator cItr = ++args.begin();
-         cItr != args.end();
-         cItr++) {
-      const std::string& cmd = cItr->as_string();
-      row.push_back(rpc::parse_command(rpc::make_target(*itr),
-                                       cmd.c_str(),
-                                       cmd.c_str() + cmd.size())
-                      .first);
+    if (use_regex) {
+      const std::string path = (*itr)->path()->as_string();
+
+      if (std::none_of(
+            patterns.begin(), patterns.end(), [&path](const auto& pattern) {
+              return pattern.matches(path);
+            }))
+        continue;
     }
+
+    plan.call_row(rpc::make_target(*itr), result);
   }
 
   return resultRaw;
@@ -468,27 +597,13 @@ t_multicall(core::Download* download, const torrent::Object::list_type& args) {
   // We ignore the first arg for now, but it will be used for
   // selecting what files to include.
 
-  // Add some pre-parsing of the commands, so we don't spend time
-  // parsing and searching command map for every single call.
+  rpc::MulticallPlan          plan(++args.begin(), args.end());
   torrent::Object             resultRaw = torrent::Object::create_list();
   torrent::Object::list_type& result    = resultRaw.as_list();
 
   for (int itr = 0, last = download->tracker_list()->size(); itr != last;
        itr++) {
-    torrent::Object::list_type& row =
-      result.insert(result.end(), torrent::Object::create_list())->as_list();
-
-    for (torrent::Object::list_const_iterator cItr = ++args.begin();
-         cItr != args.end();
-         cItr++) {
-      const std::string& cmd = cItr->as_string();
-      torrent::Tracker*  t   = download->tracker_list()->at(itr);
-
-      row.push_back(rpc::parse_command(rpc::make_target(t),
-                                       cmd.c_str(),
-                                       cmd.c_str() + cmd.size())
-                      .first);
-    }
+    plan.call_row(rpc::make_target(download->tracker_list()->at(itr)), result);
   }
 
   return resultRaw;
@@ -502,8 +617,7 @@ p_multicall(core::Download* download, const torrent::Object::list_type& args) {
   // We ignore the first arg for now, but it will be used for
   // selecting what files to include.
 
-  // Add some pre-parsing of the commands, so we don't spend time
-  // parsing and searching command map for every single call.
+  rpc::MulticallPlan          plan(++args.begin(), args.end());
   torrent::Object             resultRaw = torrent::Object::create_list();
   torrent::Object::list_type& result    = resultRaw.as_list();
 
@@ -512,19 +626,7 @@ p_multicall(core::Download* download, const torrent::Object::list_type& args) {
          last = download->connection_list()->end();
        itr != last;
        itr++) {
-    torrent::Object::list_type& row =
-      result.insert(result.end(), torrent::Object::create_list())->as_list();
-
-    for (torrent::Object::list_const_iterator cItr = ++args.begin();
-         cItr != args.end();
-         cItr++) {
-      const std::string& cmd = cItr->as_string();
-
-      row.push_back(rpc::parse_command(rpc::make_target(*itr),
-                                       cmd.c_str(),
-                                       cmd.c_str() + cmd.size())
-                      .first);
-    }
+    plan.call_row(rpc::make_target(*itr), result);
   }
 
   return resultRaw;
@@ -573,6 +675,8 @@ p_call_target(const torrent::Object::list_type& args) {
 torrent::Object
 download_tracker_insert(core::Download*                   download,
                         const torrent::Object::list_type& args) {
+  download->set_session_dirty();
+
   if (args.size() != 2)
     throw torrent::input_error("Wrong argument count.");
 
@@ -610,6 +714,8 @@ download_set_variable(core::Download*        download,
                       const torrent::Object& rawArgs,
                       const char*            first_key,
                       const char*            second_key = nullptr) {
+  download->set_session_dirty();
+
   if (second_key == nullptr)
     return download->bencode()->get_key(first_key) =
              torrent::object_create_normal(rawArgs);
@@ -623,6 +729,8 @@ download_set_variable_value(core::Download*                    download,
                             const torrent::Object::value_type& args,
                             const char*                        first_key,
                             const char* second_key = nullptr) {
+  download->set_session_dirty();
+
   if (second_key == nullptr)
     return download->bencode()->get_key(first_key) = args;
 
@@ -639,8 +747,10 @@ download_set_variable_value_ifz(core::Download*                    download,
       ? download->bencode()->get_key(first_key)
       : download->bencode()->get_key(first_key).get_key(second_key);
 
-  if (object.as_value() == 0)
+  if (object.as_value() == 0) {
     object = args;
+    download->set_session_dirty();
+  }
 
   return object;
 }
@@ -650,6 +760,8 @@ download_set_variable_string(core::Download*                     download,
                              const torrent::Object::string_type& args,
                              const char*                         first_key,
                              const char* second_key = nullptr) {
+  download->set_session_dirty();
+
   if (second_key == nullptr)
     return download->bencode()->get_key(first_key) = args;
 
@@ -665,6 +777,8 @@ d_list_push_back(core::Download*        download,
                  const torrent::Object& rawArgs,
                  const char*            first_key,
                  const char*            second_key) {
+  download->set_session_dirty();
+
   download_get_variable(download, first_key, second_key)
     .as_list()
     .push_back(rawArgs);
@@ -677,6 +791,8 @@ d_list_push_back_unique(core::Download*        download,
                         const torrent::Object& rawArgs,
                         const char*            first_key,
                         const char*            second_key) {
+  download->set_session_dirty();
+
   const torrent::Object& args =
     (rawArgs.is_list() && !rawArgs.as_list().empty())
       ? rawArgs.as_list().front()
@@ -715,6 +831,8 @@ d_list_remove(core::Download*        download,
               const torrent::Object& rawArgs,
               const char*            first_key,
               const char*            second_key) {
+  download->set_session_dirty();
+
   const torrent::Object& args =
     (rawArgs.is_list() && !rawArgs.as_list().empty())
       ? rawArgs.as_list().front()
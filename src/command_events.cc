@@ -2,8 +2,12 @@
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
 #include <algorithm>
+#include <charconv>
 #include <cstdio>
+#include <deque>
 #include <functional>
+#include <list>
+#include <unordered_map>
 #include <torrent/hash_string.h>
 #include <torrent/rate.h>
 #include <torrent/utils/directory_events.h>
@@ -18,6 +22,7 @@
 #include "core/manager.h"
 #include "core/view_manager.h"
 #include "rpc/command_scheduler.h"
+#include "rpc/multicall_plan.h"
 #include "rpc/parse.h"
 #include "rpc/parse_commands.h"
 
@@ -305,29 +310,7 @@ d_multicall(const torrent::Object::list_type& args) {
   if (viewItr == viewManager->end())
     throw torrent::input_error("Could not find view.");
 
-  // [(cmd, cmd_args)]
-  std::vector<std::pair<rpc::CommandMap::iterator, torrent::Object>> parsed;
-  parsed.reserve(args.size() - 1);
-
-  for (size_t i = 1; i < args.size(); ++i) {
-    const auto& arg = args[i].as_string();
-
-    char key[128];
-    auto cmd_args = torrent::Object();
-    auto start    = arg.c_str();
-
-    if (!rpc::parse_line(key, cmd_args, start, start + arg.size())) {
-      throw torrent::input_error("Failed to parse command.");
-    }
-
-    auto cmd = rpc::commands.find(key);
-    if (cmd == rpc::commands.end()) {
-      throw torrent::input_error("Command \"" + std::string(key) +
-                                 "\" does not exist.");
-    }
-
-    parsed.emplace_back(cmd, cmd_args);
-  }
+  rpc::MulticallPlan plan(args.begin() + 1, args.end());
 
   unsigned int     dlist_size = (*viewItr)->size_visible();
   core::Download** dlist =
@@ -341,14 +324,7 @@ d_multicall(const torrent::Object::list_type& args) {
   result.resize(dlist_size, torrent::Object::create_list());
 
   for (size_t i = 0; i < dlist_size; ++i) {
-    torrent::Object::list_type& row = result[i].as_list();
-
-    row.reserve(parsed.size());
-
-    for (const auto& [cmd, cmd_args] : parsed) {
-      row.push_back(
-        rpc::parse_command_(rpc::make_target(dlist[i]), cmd, cmd_args));
-    }
+    plan.call(rpc::make_target(dlist[i]), result[i].as_list());
   }
 
   free(dlist);
@@ -377,27 +353,239 @@ d_multicall_filtered(const torrent::Object::list_type& args) {
   (*viewItr)->filter_by(*++arg, dlist);
 
   // Generate result by iterating over all items
+  rpc::MulticallPlan          plan(++arg, args.end());
   torrent::Object             resultRaw = torrent::Object::create_list();
   torrent::Object::list_type& result    = resultRaw.as_list();
-  ++arg; // skip to first command
 
   for (core::View::iterator item = dlist.begin(); item != dlist.end(); ++item) {
-    // Add empty row to result
-    torrent::Object::list_type& row =
-      result.insert(result.end(), torrent::Object::create_list())->as_list();
-
-    // Call the provided commands and assemble their results
-    for (torrent::Object::list_const_iterator command = arg;
-         command != args.end();
-         command++) {
-      const std::string& cmdstr = command->as_string();
-      row.push_back(rpc::parse_command(rpc::make_target(*item),
-                                       cmdstr.c_str(),
-                                       cmdstr.c_str() + cmdstr.size())
-                      .first);
+    plan.call_row(rpc::make_target(*item), result);
+  }
+
+  return resultRaw;
+}
+
+// State behind 'd.multicall.delta', kept for each view and list of
+// commands. Rows remember the fingerprints of their last values and the
+// revision those last changed at, so any client revision that is still
+// covered by the removal log can be answered with just the differences.
+struct multicall_delta_state {
+  static constexpr size_t max_states  = 16;
+  static constexpr size_t max_removed = 4096;
+
+  struct row_type {
+    std::vector<uint64_t> fingerprints;
+    uint64_t              changed;
+    uint64_t              seen;
+  };
+
+  std::string key;
+  std::string id;
+  uint64_t    revision{ 0 };
+  uint64_t    removedFloor{ 0 };
+
+  std::unordered_map<std::string, row_type>     rows;
+  std::deque<std::pair<uint64_t, std::string>> removed;
+};
+
+static std::list<multicall_delta_state> multicall_delta_states;
+
+static uint64_t
+object_fingerprint(const torrent::Object& object,
+                   uint64_t               hash = 14695981039346656037ull) {
+  const auto mix = [&hash](const void* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+      hash ^= static_cast<const unsigned char*>(data)[i];
+      hash *= 1099511628211ull;
+    }
+  };
+
+  const auto type = object.type();
+  mix(&type, sizeof(type));
+
+  switch (type) {
+    case torrent::Object::TYPE_VALUE: {
+      const int64_t value = object.as_value();
+      mix(&value, sizeof(value));
+      break;
     }
+    case torrent::Object::TYPE_STRING:
+      mix(object.as_string().data(), object.as_string().size());
+      mix("", 1);
+      break;
+    case torrent::Object::TYPE_LIST:
+      for (const auto& element : object.as_list())
+        hash = object_fingerprint(element, hash);
+      mix("", 1);
+      break;
+    case torrent::Object::TYPE_MAP:
+      for (const auto& [k, v] : object.as_map()) {
+        mix(k.data(), k.size());
+        hash = object_fingerprint(v, hash);
+      }
+      mix("", 1);
+      break;
+    case torrent::Object::TYPE_DICT_KEY:
+      mix(object.as_dict_key().data(), object.as_dict_key().size());
+      hash = object_fingerprint(object.as_dict_obj(), hash);
+      break;
+    default:
+      break;
   }
 
+  return hash;
+}
+
+static multicall_delta_state&
+multicall_delta_find(const std::string& key) {
+  auto itr = std::find_if(
+    multicall_delta_states.begin(),
+    multicall_delta_states.end(),
+    [&key](const multicall_delta_state& state) { return state.key == key; });
+
+  if (itr != multicall_delta_states.end()) {
+    multicall_delta_states.splice(
+      multicall_delta_states.begin(), multicall_delta_states, itr);
+    return multicall_delta_states.front();
+  }
+
+  if (multicall_delta_states.size() >= multicall_delta_state::max_states)
+    multicall_delta_states.pop_back();
+
+  // Tokens from a state that was evicted, or from before a restart,
+  // must not match a new state that reached the same revision.
+  static uint64_t created = 0;
+
+  auto& state = multicall_delta_states.emplace_front();
+  state.key   = key;
+  state.id    = std::to_string(cachedTime.usec()) + "." +
+             std::to_string(++created);
+
+  return state;
+}
+
+torrent::Object
+d_multicall_delta(const torrent::Object::list_type& args) {
+  if (args.size() < 3)
+    throw torrent::input_error(
+      "d.multicall.delta requires at least 3 arguments.");
+
+  const std::string& viewName = args[0].as_string();
+  const std::string& token    = args[1].as_string();
+
+  core::ViewManager*          viewManager = control->view_manager();
+  core::ViewManager::iterator viewItr =
+    viewManager->find(viewName.empty() ? "default" : viewName);
+
+  if (viewItr == viewManager->end())
+    throw torrent::input_error("Could not find view.");
+
+  rpc::MulticallPlan plan(args.begin() + 2, args.end());
+
+  std::string key = (*viewItr)->name();
+
+  for (size_t i = 2; i < args.size(); ++i) {
+    key += '\0';
+    key += args[i].as_string();
+  }
+
+  multicall_delta_state& state = multicall_delta_find(key);
+
+  // The token is '<state id>:<revision>', anything else gets the full
+  // result.
+  uint64_t since = 0;
+
+  if (token.size() > state.id.size() &&
+      token.compare(0, state.id.size(), state.id) == 0 &&
+      token[state.id.size()] == ':') {
+    const char* first = token.c_str() + state.id.size() + 1;
+    const char* last  = token.c_str() + token.size();
+
+    if (std::from_chars(first, last, since).ptr != last ||
+        since > state.revision)
+      since = 0;
+  }
+
+  const bool     full     = since == 0 || since < state.removedFloor;
+  const uint64_t revision = ++state.revision;
+
+  auto  resultRaw = torrent::Object::create_map();
+  auto& rows      = resultRaw.insert_key("rows", torrent::Object::create_list())
+                 .as_list();
+  auto& removed =
+    resultRaw.insert_key("removed", torrent::Object::create_list()).as_list();
+
+  // Copy the view as the commands may modify it.
+  std::vector<core::Download*> dlist((*viewItr)->begin_visible(),
+                                     (*viewItr)->end_visible());
+
+  bool anyInserted = false;
+
+  for (core::Download* download : dlist) {
+    torrent::Object             rowRaw = torrent::Object::create_list();
+    torrent::Object::list_type& row    = rowRaw.as_list();
+
+    row.push_back(torrent::utils::transform_hex_str(download->info()->hash()));
+    plan.call(rpc::make_target(download), row);
+
+    auto [entry, inserted] = state.rows.try_emplace(row.front().as_string());
+    entry->second.seen     = revision;
+
+    if (inserted) {
+      entry->second.fingerprints.resize(plan.size());
+      entry->second.changed = revision;
+      anyInserted           = true;
+    }
+
+    for (size_t i = 0; i < plan.size(); ++i) {
+      const uint64_t fingerprint = object_fingerprint(row[i + 1]);
+
+      if (entry->second.fingerprints[i] != fingerprint) {
+        entry->second.fingerprints[i] = fingerprint;
+        entry->second.changed         = revision;
+      }
+    }
+
+    if (full || entry->second.changed > since)
+      rows.push_back(std::move(rowRaw));
+  }
+
+  // A download that left the view and came back is reported as a row,
+  // so it must not also be listed as removed. Removed downloads have no
+  // row, so those with one are dropped in a single pass.
+  if (anyInserted && !state.removed.empty())
+    state.removed.erase(
+      std::remove_if(state.removed.begin(),
+                     state.removed.end(),
+                     [&state](const auto& removedEntry) {
+                       return state.rows.count(removedEntry.second) != 0;
+                     }),
+      state.removed.end());
+
+  for (auto itr = state.rows.begin(); itr != state.rows.end();) {
+    if (itr->second.seen == revision) {
+      ++itr;
+      continue;
+    }
+
+    state.removed.emplace_back(revision, itr->first);
+    itr = state.rows.erase(itr);
+  }
+
+  while (state.removed.size() > multicall_delta_state::max_removed) {
+    state.removedFloor = state.removed.front().first;
+    state.removed.pop_front();
+  }
+
+  if (!full) {
+    for (const auto& [removedRevision, hash] : state.removed)
+      if (removedRevision > since)
+        removed.push_back(hash);
+  }
+
+  resultRaw.insert_key("revision",
+                       state.id + ":" + std::to_string(revision));
+  resultRaw.insert_key("full", (int64_t)full);
+
   return resultRaw;
 }
 
@@ -512,6 +700,9 @@ initialize_command_events() {
   CMD2_ANY_LIST("d.multicall.filtered", [](const auto&, const auto& args) {
     return d_multicall_filtered(args);
   });
+  CMD2_ANY_LIST("d.multicall.delta", [](const auto&, const auto& args) {
+    return d_multicall_delta(args);
+  });
 
   CMD2_ANY_LIST("directory.watch.added", [](const auto&, const auto& args) {
     return directory_watch_added(args);
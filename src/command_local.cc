@@ -373,8 +373,30 @@ initialize_command_local() {
     "session.path.set",
     [dStore](const auto&, const auto& path) { return dStore->set_path(path); });
 
-  CMD2_ANY_V("session.save", [dList](const auto&, const auto&) {
-    return dList->session_save();
+  CMD2_ANY("session.format", [dStore](const auto&, const auto&) {
+    return std::string(
+      dStore->format() == core::DownloadStore::format_log ? "log" : "files");
+  });
+  CMD2_ANY_STRING_V(
+    "session.format.set", [dStore](const auto&, const std::string& format) {
+      if (format == "files")
+        dStore->set_format(core::DownloadStore::format_files);
+      else if (format == "log")
+        dStore->set_format(core::DownloadStore::format_log);
+      else
+        throw torrent::input_error("Invalid session format, expected "
+                                   "\"files\" or \"log\".");
+    });
+
+  CMD2_ANY("session.checksum",
+           [dStore](const auto&, const auto&) { return dStore->checksum(); });
+  CMD2_ANY_VALUE_V("session.checksum.set",
+                   [dStore](const auto&, const auto& state) {
+                     return dStore->set_checksum(state);
+                   });
+
+  CMD2_ANY("session.save", [dList](const auto&, const auto&) {
+    return (int64_t)dList->session_save();
   });
 
 #define CMD2_EXECUTE(key, flags)                                               \
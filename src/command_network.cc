@@ -129,15 +129,88 @@ initialize_rpc() {
     torrent::LOG_RPC_EVENTS, "XMLRPC initialized with %u functions.", count);
 }
 
+// Used for the SCGI listener opened later, as 'network.scgi.max_tasks.set'
+// is usually called before the port is opened.
+static unsigned int scgi_max_tasks = rpc::SCgi::default_max_tasks;
+
+torrent::Object
+apply_scgi_max_tasks(int64_t size) {
+  if (size <= 0 || size > (1 << 16))
+    throw torrent::input_error("Invalid SCGI connection limit.");
+
+  scgi_max_tasks = size;
+
+  if (worker_thread->scgi() != nullptr)
+    worker_thread->scgi()->set_max_tasks(size);
+
+  return torrent::Object();
+}
+
+// Threads serving the connections of the SCGI listener, which can't
+// be changed once it is open.
+static unsigned int scgi_threads = 1;
+
+torrent::Object
+apply_scgi_threads(int64_t count) {
+  if (count <= 0 || count > ThreadWorker::max_threads)
+    throw torrent::input_error("Invalid SCGI thread count.");
+
+  if (worker_thread->scgi() != nullptr)
+    throw torrent::input_error(
+      "SCGI thread count must be set before the listener is opened.");
+
+  scgi_threads = count;
+  return torrent::Object();
+}
+
+int64_t
+scgi_statistic(uint64_t (rpc::SCgi::*getter)() const) {
+  rpc::SCgi* scgi = worker_thread->scgi();
+
+  return scgi != nullptr ? (scgi->*getter)() : 0;
+}
+
+torrent::Object
+apply_scgi_subscribe(const torrent::Object::list_type& args) {
+  rpc::SCgiTask* task = rpc::SCgi::current_task();
+
+  if (task == nullptr || task->type() != rpc::SCgiTask::ContentType::JSON)
+    throw torrent::input_error(
+      "Subscriptions are only available to JSON-RPC connections.");
+
+  rpc::EventStream::topic_list topics;
+
+  for (const auto& arg : args) {
+    const std::string& topic = arg.as_string();
+
+    if (topic.compare(0, 15, "event.download.") != 0 &&
+        topic.compare(0, 5, "view:") != 0)
+      throw torrent::input_error("Invalid subscription topic: " + topic);
+
+    topics.push_back(topic);
+  }
+
+  if (topics.empty())
+    throw torrent::input_error("No subscription topics given.");
+
+  worker_thread->scgi()->events().subscribe(task, topics);
+  task->set_streaming();
+
+  return torrent::Object();
+}
+
 torrent::Object
-apply_scgi(const std::string& arg, int type) {
+apply_scgi(const std::string&  arg,
+           int                 type,
+           rpc::SCgi::Protocol protocol = rpc::SCgi::Protocol::SCGI) {
   if (worker_thread->scgi() != nullptr)
     throw torrent::input_error("SCGI already enabled.");
 
   if (!rpc::rpc.is_initialized())
     initialize_rpc();
 
-  rpc::SCgi* scgi = new rpc::SCgi;
+  rpc::SCgi* scgi = new rpc::SCgi(protocol);
+  scgi->set_max_tasks(scgi_max_tasks);
 
   torrent::utils::address_info*   ai = nullptr;
   torrent::utils::socket_address  sa;
@@ -228,6 +301,7 @@ apply_scgi(const std::string& arg, int type) {
     throw torrent::input_error(e.what());
   }
 
+  worker_thread->create_helpers(scgi_threads - 1);
   worker_thread->set_scgi(scgi);
   return torrent::Object();
 }
@@ -387,8 +461,46 @@ initialize_command_network() {
   CMD2_ANY_STRING("network.scgi.open_local", [](const auto&, const auto& arg) {
     return apply_scgi(arg, 2);
   });
+  CMD2_ANY_STRING("network.scgi.open_http_port",
+                  [](const auto&, const auto& arg) {
+                    return apply_scgi(arg, 1, rpc::SCgi::Protocol::HTTP);
+                  });
+  CMD2_ANY_STRING("network.scgi.open_http_local",
+                  [](const auto&, const auto& arg) {
+                    return apply_scgi(arg, 2, rpc::SCgi::Protocol::HTTP);
+                  });
   CMD2_VAR_BOOL("network.scgi.dont_route", false);
 
+  CMD2_ANY("network.scgi.max_tasks",
+           [](const auto&, const auto&) { return (int64_t)scgi_max_tasks; });
+  CMD2_ANY_VALUE_V("network.scgi.max_tasks.set",
+                   [](const auto&, const auto& size) {
+                     return apply_scgi_max_tasks(size);
+                   });
+  CMD2_ANY("network.scgi.threads",
+           [](const auto&, const auto&) { return (int64_t)scgi_threads; });
+  CMD2_ANY_VALUE_V("network.scgi.threads.set",
+                   [](const auto&, const auto& count) {
+                     return apply_scgi_threads(count);
+                   });
+  CMD2_ANY("network.scgi.active_tasks", [](const auto&, const auto&) {
+    rpc::SCgi* scgi = worker_thread->scgi();
+    return scgi != nullptr ? (int64_t)scgi->size_tasks() : (int64_t)0;
+  });
+  CMD2_ANY("network.scgi.accepted", [](const auto&, const auto&) {
+    return scgi_statistic(&rpc::SCgi::accepted);
+  });
+  CMD2_ANY("network.scgi.rejected", [](const auto&, const auto&) {
+    return scgi_statistic(&rpc::SCgi::rejected);
+  });
+  CMD2_ANY("network.scgi.accept_paused", [](const auto&, const auto&) {
+    return scgi_statistic(&rpc::SCgi::accept_paused);
+  });
+
+  CMD2_ANY_LIST("system.subscribe", [](const auto&, const auto& args) {
+    return apply_scgi_subscribe(args);
+  });
+
   CMD2_ANY("network.xmlrpc.size_limit", [](const auto&, const auto&) {
     return std::numeric_limits<size_t>::max();
   });
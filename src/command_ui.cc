@@ -256,7 +256,7 @@ initialize_command_ui() {
   });
 
   CMD2_ANY_STRING_V("view.filter_all", [](const auto&, const auto& args) {
-    control->view_manager()->find_ptr_throw(args)->filter();
+    control->view_manager()->find_ptr_throw(args)->filter_all();
   });
 
   CMD2_DL_STRING("view.filter_download",
@@ -3,6 +3,7 @@
 
 #include "buildinfo.h"
 
+#include <algorithm>
 #include <csignal>
 #include <iostream>
 #include <sys/stat.h>
@@ -136,7 +137,10 @@ Control::is_shutdown_completed() {
     return true;
   }
 
-  if (worker_thread->is_active()) {
+  if (worker_thread->is_active() ||
+      std::any_of(worker_thread->helpers().begin(),
+                  worker_thread->helpers().end(),
+                  [](ThreadWorker* helper) { return helper->is_active(); })) {
     return false;
   }
 
@@ -167,6 +171,10 @@ Control::handle_shutdown() {
     worker_thread->queue_item(&ThreadBase::stop_thread);
   }
 
+  for (auto helper : worker_thread->helpers())
+    if (helper->is_active())
+      helper->queue_item(&ThreadBase::stop_thread);
+
   if (!m_shutdownQuick) {
     torrent::connection_manager()->listen_close();
     m_directory_events->close();
@@ -25,7 +25,8 @@ Download::Download(download_type d)
   ,
 
   m_resumeFlags(~uint32_t())
-  , m_group(0) {
+  , m_group(0)
+  , m_id(0) {
 
   m_download.info()->signal_tracker_success().push_back(
     [this] { receive_tracker_msg(""); });
@@ -70,6 +71,7 @@ Download::set_priority(uint32_t p) {
     torrent::download_set_priority(m_download, p * p);
 
   bencode()->get_key("rtorrent").insert_key("priority", (int64_t)p);
+  set_session_dirty();
 }
 
 uint32_t
@@ -122,6 +124,7 @@ Download::set_throttle_name(const std::string& throttleName) {
   m_download.bencode()
     ->get_key("rtorrent")
     .insert_key("throttle_name", throttleName);
+  set_session_dirty();
 }
 
 void
@@ -155,6 +158,51 @@ Download::set_root_directory(const std::string& path) {
   file_list->set_root_dir(torrent::utils::path_expand(path));
 
   bencode()->get_key("rtorrent").insert_key("directory", path);
+  set_session_dirty();
+}
+
+bool
+Download::session_state::operator==(const session_state& state) const {
+  return generation == state.generation && chunks_done == state.chunks_done &&
+         chunks_wanted == state.chunks_wanted &&
+         total_uploaded == state.total_uploaded &&
+         total_downloaded == state.total_downloaded &&
+         trackers == state.trackers;
+}
+
+Download::session_state
+Download::current_session_state() const {
+  session_state state;
+
+  state.generation       = m_sessionGeneration;
+  state.chunks_done      = m_download.file_list()->completed_chunks();
+  state.chunks_wanted    = m_download.data()->wanted_chunks();
+  state.total_uploaded   = m_download.info()->up_rate()->total();
+  state.total_downloaded = m_download.info()->down_rate()->total();
+
+  // Trackers can be enabled, disabled or added without going through
+  // a download command, so fold their states.
+  for (const auto& tracker : *m_download.tracker_list())
+    state.trackers = state.trackers * 31 + (tracker->is_enabled() ? 2 : 1);
+
+  return state;
+}
+
+bool
+Download::is_session_dirty() const {
+  return !(current_session_state() == m_sessionSaved);
+}
+
+void
+Download::set_session_dirty() {
+  m_sessionGeneration++;
+
+  control->core()->download_list()->mark_changed(this);
+}
+
+void
+Download::set_session_saved() {
+  m_sessionSaved = current_session_state();
 }
 
 }
@@ -114,6 +114,27 @@ DownloadFactory::load_raw_data(const std::string& input) {
   m_loaded = true;
 }
 
+void
+DownloadFactory::load_session(const std::string& uri,
+                              torrent::Object&   torrent,
+                              torrent::Object&   rtorrent,
+                              torrent::Object&   resume) {
+  if (m_stream || m_object)
+    throw torrent::internal_error(
+      "DownloadFactory::load*() called on an object with m_stream != NULL");
+
+  m_uri    = uri;
+  m_object = new torrent::Object;
+  m_object->swap(torrent);
+
+  m_sessionLoaded = true;
+  m_sessionRtorrent.swap(rtorrent);
+  m_sessionResume.swap(resume);
+
+  m_isFile = true;
+  m_loaded = true;
+}
+
 void
 DownloadFactory::commit() {
   priority_queue_insert(&taskScheduler, &m_taskCommit, cachedTime);
@@ -220,7 +241,13 @@ DownloadFactory::receive_success() {
       commands.push_back(*itr);
   }
 
-  if (m_session) {
+  if (m_session && m_sessionLoaded) {
+    if (!m_sessionRtorrent.is_empty())
+      root->insert_key_move("rtorrent", m_sessionRtorrent);
+    if (!m_sessionResume.is_empty())
+      root->insert_key_move("libtorrent_resume", m_sessionResume);
+
+  } else if (m_session) {
     download_factory_add_stream(
       root,
       "rtorrent",
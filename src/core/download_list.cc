@@ -19,6 +19,7 @@
 
 
 
+#include "rpc/event_stream.h"
 #include "rpc/parse_commands.h"
 
 #include "control.h"
@@ -40,6 +41,10 @@ inline void dl_trigger_event(Download* download, const char* event_name) {
   bool state = rpc::rpc.set_trusted_connection( true );
   rpc::commands.call_catch(event_name, rpc::make_target(download), torrent::Object(), ("Event '"+std::string(event_name)+"' failed: ").c_str());
   rpc::rpc.set_trusted_connection( state );
+  rpc::publish_download_event(event_name, download);
+
+  for (const auto& view : *control->view_manager())
+    view->mark_dirty(download);
 }
 #ifdef RT_USE_EXTRA_DEBUG
 inline void
@@ -63,26 +68,62 @@ DownloadList::clear() {
   }
 
   base_type::clear();
+  m_index.clear();
+  m_freeIds.clear();
+  m_nextId = 0;
 }
 
-void
+unsigned int
 DownloadList::session_save() {
-  unsigned int c = std::count_if(begin(), end(), [](Download* download) {
-    return control->core()->download_store()->save_resume(download);
-  });
+  DownloadStore* store = control->core()->download_store();
+
+  // Only downloads changed since they were last saved are written.
+  std::vector<Download*> saved;
+  unsigned int           failed = 0;
+
+  store->begin_batch();
+
+  for (const auto& download : *this) {
+    if (!download->is_session_dirty())
+      continue;
+
+    if (store->save_resume(download))
+      saved.push_back(download);
+    else
+      failed++;
+  }
+
+  // Nothing in the batch was written, keep it for the next save.
+  if (!store->end_batch()) {
+    failed += saved.size();
 
-  if (c != size())
+    for (const auto& download : saved)
+      download->set_session_dirty();
+
+    saved.clear();
+  }
+
+  unsigned int skipped = size() - saved.size() - failed;
+
+  if (failed != 0)
     lt_log_print(torrent::LOG_ERROR, "Failed to save session torrents.");
 
+  lt_log_print(torrent::LOG_INFO,
+               "Saved %zu session torrents, skipped %u unchanged.",
+               saved.size(),
+               skipped);
+
   control->dht_manager()->save_dht_cache();
   control->ui()->save_input_history();
+
+  return skipped;
 }
 
 DownloadList::iterator
 DownloadList::find(const torrent::HashString& hash) {
-  return std::find_if(begin(), end(), [hash](Download* download) {
-    return hash == download->info()->hash();
-  });
+  index_type::iterator itr = m_index.find(hash);
+
+  return itr != m_index.end() ? itr->second : end();
 }
 
 DownloadList::iterator
@@ -95,9 +136,7 @@ DownloadList::find_hex(const char* hash) {
     *itr = (torrent::utils::hexchar_to_value(*hash) << 4) +
            torrent::utils::hexchar_to_value(*(hash + 1));
 
-  return std::find_if(begin(), end(), [key](Download* download) {
-    return key == download->info()->hash();
-  });
+  return find(key);
 }
 
 Download*
@@ -163,6 +202,15 @@ DownloadList::iterator
 DownloadList::insert(Download* download) {
   iterator itr = base_type::insert(end(), download);
 
+  m_index.emplace(download->info()->hash(), itr);
+
+  if (m_freeIds.empty()) {
+    download->set_id(m_nextId++);
+  } else {
+    download->set_id(m_freeIds.back());
+    m_freeIds.pop_back();
+  }
+
   lt_log_print_info(torrent::LOG_TORRENT_INFO,
                     download->info(),
                     "download_list",
@@ -207,9 +255,22 @@ DownloadList::insert(Download* download) {
   return itr;
 }
 
+void
+DownloadList::mark_changed(Download* download) {
+  iterator itr = find(download->info()->hash());
+
+  if (itr == end() || *itr != download)
+    return;
+
+  for (const auto& view : *control->view_manager())
+    view->mark_dirty(download);
+}
+
 void
 DownloadList::erase_ptr(Download* download) {
-  erase(std::find(begin(), end(), download));
+  iterator itr = find(download->info()->hash());
+
+  erase(itr != end() && *itr == download ? itr : end());
 }
 
 DownloadList::iterator
@@ -235,6 +296,9 @@ DownloadList::erase(iterator itr) {
     v->erase(*itr);
   }
 
+  m_index.erase((*itr)->info()->hash());
+  m_freeIds.push_back((*itr)->id());
+
   torrent::download_remove(*(*itr)->download());
   delete *itr;
 
@@ -3,8 +3,10 @@
 
 // DownloadStore handles the saving and listing of session torrents.
 
+#include <cerrno>
 #include <cstdio>
-#include <fstream>
+#include <fcntl.h>
+#include <ostream>
 #include <unistd.h>
 
 #include <torrent/exceptions.h>
@@ -17,7 +19,9 @@
 #include <torrent/utils/resume.h>
 #include <torrent/utils/string_manip.h>
 
+#include "utils/crc32.h"
 #include "utils/directory.h"
+#include "utils/memory_stream.h"
 
 #include "core/download.h"
 #include "core/download_store.h"
@@ -56,6 +60,15 @@ DownloadStore::enable(bool lock) {
       throw torrent::input_error(msg);
     }
   }
+
+  if (m_format == format_log) {
+    try {
+      m_log.open(session_log_filename());
+    } catch (torrent::storage_error& e) {
+      m_lockfile.unlock();
+      throw torrent::input_error(e.what());
+    }
+  }
 }
 
 void
@@ -63,6 +76,10 @@ DownloadStore::disable() {
   if (!is_enabled())
     return;
 
+  if (m_log.is_open())
+    checkpoint();
+
+  m_log.close();
   m_lockfile.unlock();
 }
 
@@ -78,36 +95,92 @@ DownloadStore::set_path(const std::string& path) {
     m_path = torrent::utils::path_expand(path);
 }
 
+void
+DownloadStore::set_format(format_type format) {
+  if (is_enabled())
+    throw torrent::input_error(
+      "Tried to change session format while it is enabled.");
+
+  m_format = format;
+}
+
+bool
+DownloadStore::end_batch() {
+  if (m_batch == 0)
+    throw torrent::internal_error("DownloadStore::end_batch() not in a batch.");
+
+  if (--m_batch != 0 || !m_log.is_open())
+    return true;
+
+  return checkpoint();
+}
+
+bool
+DownloadStore::checkpoint() {
+  if (!m_log.checkpoint())
+    return false;
+
+  // The log now has the torrents of downloads migrated from the files
+  // format, which would otherwise go stale.
+  for (const auto& filename : m_migrated) {
+    ::unlink((filename + ".libtorrent_resume").c_str());
+    ::unlink((filename + ".rtorrent").c_str());
+    ::unlink(filename.c_str());
+  }
+
+  m_migrated.clear();
+  return true;
+}
+
 bool
 DownloadStore::write_bencode(const std::string&     filename,
                              const torrent::Object& obj,
                              uint32_t               skip_mask) {
-  torrent::Object tmp;
-  std::fstream    output(filename.c_str(), std::ios::out | std::ios::trunc);
+  // Serialize up front so the file is written with a single call, and
+  // doesn't need to be read back to know it is complete.
+  std::string buffer;
 
-  if (!output.is_open())
-    goto download_store_save_error;
+  {
+    utils::string_streambuf streambuf(&buffer);
+    std::ostream            output(&streambuf);
 
-  torrent::object_write_bencode(&output, &obj, skip_mask);
+    torrent::object_write_bencode(&output, &obj, skip_mask);
 
-  if (!output.good())
-    goto download_store_save_error;
+    if (!output.good())
+      return false;
+  }
 
-  output.close();
+  if (m_checksum)
+    append_checksum(&buffer);
 
-  // Test the new file, to ensure it is a valid bencode string.
-  output.open(filename.c_str(), std::ios::in);
-  output >> tmp;
+  int fd =
+    ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
 
-  if (!output.good())
-    goto download_store_save_error;
+  if (fd == -1)
+    return false;
 
-  output.close();
-  return true;
+  const char* data   = buffer.data();
+  size_t      length = buffer.size();
+
+  while (length != 0) {
+    ssize_t result = ::write(fd, data, length);
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result <= 0) {
+      ::close(fd);
+      return false;
+    }
+
+    data += result;
+    length -= result;
+  }
 
-download_store_save_error:
-  output.close();
-  return false;
+  // Flush before the caller renames the file over the previous one.
+  bool synced = ::fdatasync(fd) == 0;
+
+  return ::close(fd) == 0 && synced;
 }
 
 bool
@@ -141,6 +214,37 @@ DownloadStore::save(Download* d, int flags) {
   resume_base->set_flags(torrent::Object::flag_session_data);
   rtorrent_base->set_flags(torrent::Object::flag_session_data);
 
+  if (m_log.is_open()) {
+    std::string hash(d->info()->hash().begin(), d->info()->hash().end());
+
+    m_log.append(SessionLog::record_resume, hash, *resume_base, 0);
+    m_log.append(SessionLog::record_rtorrent, hash, *rtorrent_base, 0);
+
+    // Downloads migrated from the files format get their torrent
+    // written on the first save, and their files removed once it is
+    // committed.
+    bool logged = m_log.has_torrent(hash);
+
+    if (!logged) {
+      std::string filename = create_filename(d);
+
+      if (::access(filename.c_str(), F_OK) == 0)
+        m_migrated.push_back(std::move(filename));
+    }
+
+    if (!(flags & flag_skip_static) || !logged)
+      m_log.append(SessionLog::record_torrent,
+                   hash,
+                   *d->bencode(),
+                   torrent::Object::flag_session_data);
+
+    if (m_batch == 0 && !checkpoint())
+      return false;
+
+    d->set_session_saved();
+    return true;
+  }
+
   std::string base_filename = create_filename(d);
 
   if (!write_bencode(
@@ -159,6 +263,7 @@ DownloadStore::save(Download* d, int flags) {
                     torrent::Object::flag_session_data))
     ::rename((base_filename + ".new").c_str(), base_filename.c_str());
 
+  d->set_session_saved();
   return true;
 }
 
@@ -167,6 +272,15 @@ DownloadStore::remove(Download* d) {
   if (!is_enabled())
     return;
 
+  if (m_log.is_open()) {
+    m_log.append_erase(
+      std::string(d->info()->hash().begin(), d->info()->hash().end()));
+
+    if (m_batch == 0)
+      checkpoint();
+  }
+
+  // Also removes files left over from before switching to the log.
   ::unlink((create_filename(d) + ".libtorrent_resume").c_str());
   ::unlink((create_filename(d) + ".rtorrent").c_str());
   ::unlink(create_filename(d).c_str());
@@ -212,6 +326,42 @@ DownloadStore::is_correct_format(const std::string& f) {
   return true;
 }
 
+static constexpr char   checksum_prefix[] = "\ncrc32:";
+static constexpr size_t checksum_size     = sizeof(checksum_prefix) - 1 + 8;
+
+void
+DownloadStore::append_checksum(std::string* data) {
+  char trailer[checksum_size + 1];
+
+  std::snprintf(trailer,
+                sizeof(trailer),
+                "%s%08x",
+                checksum_prefix,
+                utils::crc32(data->data(), data->size()));
+
+  data->append(trailer, checksum_size);
+}
+
+bool
+DownloadStore::verify_checksum(std::string* data) {
+  if (data->size() < checksum_size)
+    return true;
+
+  size_t offset = data->size() - checksum_size;
+
+  if (data->compare(offset, sizeof(checksum_prefix) - 1, checksum_prefix) != 0)
+    return true;
+
+  char crc[9];
+  std::snprintf(crc, sizeof(crc), "%08x", utils::crc32(data->data(), offset));
+
+  if (data->compare(offset + sizeof(checksum_prefix) - 1, 8, crc) != 0)
+    return false;
+
+  data->resize(offset);
+  return true;
+}
+
 std::string
 DownloadStore::create_filename(Download* d) {
   return m_path +
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <algorithm>
+#include <fstream>
+#include <istream>
+
+#include <torrent/object_stream.h>
+
+#include "core/download_store.h"
+#include "core/session_loader.h"
+#include "utils/memory_stream.h"
+
+namespace core {
+
+// Reads the whole file with a single call and decodes it from memory.
+// A checksum trailer, if present, is verified and 'corrupted' set when
+// it doesn't match.
+static bool
+session_loader_read(const std::string& filename,
+                    torrent::Object*   object,
+                    bool*              corrupted = nullptr) {
+  std::ifstream stream(filename, std::ios::in | std::ios::binary);
+
+  if (!stream.is_open())
+    return false;
+
+  std::string data;
+
+  stream.seekg(0, std::ios::end);
+  data.resize(std::max<std::streamoff>(stream.tellg(), 0));
+  stream.seekg(0, std::ios::beg);
+
+  if (!stream.read(&data[0], data.size()))
+    return false;
+
+  if (!DownloadStore::verify_checksum(&data)) {
+    if (corrupted != nullptr)
+      *corrupted = true;
+
+    return false;
+  }
+
+  utils::memory_streambuf buffer(data.data(), data.data() + data.size());
+  std::istream            input(&buffer);
+
+  try {
+    input >> *object;
+  } catch (...) {
+    *object = torrent::Object();
+    return false;
+  }
+
+  if (input.fail()) {
+    *object = torrent::Object();
+    return false;
+  }
+
+  return true;
+}
+
+SessionLoader::SessionLoader(std::vector<std::string> paths,
+                             unsigned int             threads)
+  : m_entries(paths.size())
+  , m_done(paths.size(), 0) {
+  for (size_t i = 0; i != paths.size(); ++i)
+    m_entries[i].path = std::move(paths[i]);
+
+  threads = std::max(1u, std::min<unsigned int>(threads, m_entries.size()));
+
+  for (unsigned int i = 0; i != threads && !m_entries.empty(); ++i)
+    m_threads.emplace_back([this] { read_entries(); });
+}
+
+SessionLoader::~SessionLoader() {
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_stopped = true;
+  }
+
+  m_condition.notify_all();
+
+  for (auto& thread : m_threads)
+    thread.join();
+}
+
+bool
+SessionLoader::next(entry_type* entry) {
+  std::unique_lock<std::mutex> lock(m_lock);
+
+  if (m_nextTaken == m_entries.size())
+    return false;
+
+  m_condition.wait(lock, [this] { return m_done[m_nextTaken] != 0; });
+
+  // Release the decoded objects as they are handed out.
+  *entry = std::move(m_entries[m_nextTaken]);
+  m_entries[m_nextTaken] = entry_type();
+  m_nextTaken++;
+
+  lock.unlock();
+  m_condition.notify_all();
+
+  return true;
+}
+
+void
+SessionLoader::read_entries() {
+  while (true) {
+    size_t index;
+
+    {
+      std::unique_lock<std::mutex> lock(m_lock);
+
+      m_condition.wait(lock, [this] {
+        return m_stopped || m_nextRead == m_entries.size() ||
+               m_nextRead < m_nextTaken + max_pending;
+      });
+
+      if (m_stopped || m_nextRead == m_entries.size())
+        return;
+
+      index = m_nextRead++;
+    }
+
+    // Entries are only touched by this thread until marked done.
+    entry_type& entry = m_entries[index];
+
+    entry.loaded =
+      session_loader_read(entry.path, &entry.torrent, &entry.corrupted);
+
+    if (entry.loaded) {
+      session_loader_read(entry.path + ".rtorrent", &entry.rtorrent);
+      session_loader_read(entry.path + ".libtorrent_resume", &entry.resume);
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_done[index] = 1;
+    }
+
+    m_condition.notify_all();
+  }
+}
+
+}
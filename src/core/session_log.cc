@@ -0,0 +1,533 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <istream>
+#include <ostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <torrent/exceptions.h>
+#include <torrent/object_stream.h>
+
+#include "utils/crc32.h"
+#include "utils/memory_stream.h"
+
+#include "core/session_log.h"
+
+namespace core {
+
+// Size and CRC-32 preceding the body of each record.
+static constexpr size_t session_log_prefix_size = 8;
+static constexpr size_t session_log_body_min    = 1 + SessionLog::hash_size;
+
+struct session_log_span {
+  const char* data{ nullptr };
+  uint32_t    size{ 0 };
+};
+
+using session_log_records = std::array<session_log_span, 3>;
+using session_log_map     = std::map<std::string, session_log_records>;
+
+// Read-only mapping of a whole file, kept valid after the descriptor
+// is closed.
+class session_log_mapping {
+public:
+  explicit session_log_mapping(int fd) {
+    struct stat st;
+
+    if (::fstat(fd, &st) == -1 || st.st_size == 0)
+      return;
+
+    void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED)
+      return;
+
+    ::madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    m_data = static_cast<const char*>(data);
+    m_size = st.st_size;
+  }
+
+  ~session_log_mapping() {
+    if (m_data != nullptr)
+      ::munmap(const_cast<char*>(m_data), m_size);
+  }
+
+  session_log_mapping(const session_log_mapping&) = delete;
+  void operator=(const session_log_mapping&) = delete;
+
+  bool is_valid() const {
+    return m_data != nullptr;
+  }
+
+  const char* data() const {
+    return m_data;
+  }
+  size_t size() const {
+    return m_size;
+  }
+
+private:
+  const char* m_data{ nullptr };
+  size_t      m_size{ 0 };
+};
+
+static void
+session_log_put_u32(char* dest, uint32_t value) {
+  for (int i = 0; i != 4; ++i)
+    dest[i] = static_cast<char>(value >> (i * 8));
+}
+
+static uint32_t
+session_log_get_u32(const char* src) {
+  uint32_t value = 0;
+
+  for (int i = 0; i != 4; ++i)
+    value |= static_cast<uint32_t>(static_cast<uint8_t>(src[i])) << (i * 8);
+
+  return value;
+}
+
+static void
+session_log_put_header(std::string* buffer) {
+  buffer->append("RTSL");
+  buffer->append(4, '\0');
+  session_log_put_u32(&(*buffer)[buffer->size() - 4], SessionLog::version);
+}
+
+// Starts a record at the end of the buffer, returning its offset for
+// 'session_log_finish_record'.
+static size_t
+session_log_begin_record(std::string*       buffer,
+                         uint8_t            type,
+                         const std::string& hash) {
+  size_t start = buffer->size();
+
+  buffer->append(session_log_prefix_size, '\0');
+  buffer->push_back(static_cast<char>(type));
+  buffer->append(hash);
+
+  return start;
+}
+
+static uint32_t
+session_log_finish_record(std::string* buffer, size_t start) {
+  char*  record    = &(*buffer)[start];
+  size_t body_size = buffer->size() - start - session_log_prefix_size;
+
+  session_log_put_u32(record, body_size);
+  session_log_put_u32(
+    record + 4,
+    utils::crc32(record + session_log_prefix_size, body_size));
+
+  return buffer->size() - start;
+}
+
+static void
+session_log_apply(const session_log_span& record, session_log_map* records) {
+  const char* body = record.data + session_log_prefix_size;
+  std::string hash(body + 1, SessionLog::hash_size);
+
+  if (static_cast<uint8_t>(body[0]) == SessionLog::record_erase)
+    records->erase(hash);
+  else
+    (*records)[hash][static_cast<uint8_t>(body[0]) - 1] = record;
+}
+
+// Returns the size of the log up to and including the last valid
+// checkpoint, or zero if the header is invalid. The latest committed
+// records of each download are added to 'records'.
+static size_t
+session_log_scan(const char* data, size_t size, session_log_map* records) {
+  if (size < SessionLog::header_size || std::memcmp(data, "RTSL", 4) != 0 ||
+      session_log_get_u32(data + 4) != SessionLog::version)
+    return 0;
+
+  size_t committed = SessionLog::header_size;
+  size_t offset    = SessionLog::header_size;
+
+  std::vector<session_log_span> pending;
+
+  while (size - offset >= session_log_prefix_size) {
+    const char* record    = data + offset;
+    uint32_t    body_size = session_log_get_u32(record);
+
+    if (body_size < session_log_body_min ||
+        body_size > size - offset - session_log_prefix_size)
+      break;
+
+    const char* body = record + session_log_prefix_size;
+    uint8_t     type = static_cast<uint8_t>(body[0]);
+
+    if (type < SessionLog::record_torrent ||
+        type > SessionLog::record_checkpoint ||
+        utils::crc32(body, body_size) != session_log_get_u32(record + 4))
+      break;
+
+    offset += session_log_prefix_size + body_size;
+
+    if (type != SessionLog::record_checkpoint) {
+      pending.push_back(
+        { record, static_cast<uint32_t>(session_log_prefix_size + body_size) });
+      continue;
+    }
+
+    for (const auto& span : pending)
+      session_log_apply(span, records);
+
+    pending.clear();
+    committed = offset;
+  }
+
+  return committed;
+}
+
+static bool
+session_log_decode(const session_log_span& record, torrent::Object* object) {
+  if (record.data == nullptr)
+    return false;
+
+  utils::memory_streambuf buffer(
+    record.data + session_log_prefix_size + session_log_body_min,
+    record.data + record.size);
+  std::istream stream(&buffer);
+
+  try {
+    stream >> *object;
+  } catch (torrent::input_error&) {
+    *object = torrent::Object();
+    return false;
+  }
+
+  if (stream.fail()) {
+    *object = torrent::Object();
+    return false;
+  }
+
+  return true;
+}
+
+static bool
+session_log_write(int fd, const std::string& buffer) {
+  const char* data   = buffer.data();
+  size_t      length = buffer.size();
+
+  while (length != 0) {
+    ssize_t result = ::write(fd, data, length);
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result <= 0)
+      return false;
+
+    data += result;
+    length -= result;
+  }
+
+  return ::fdatasync(fd) == 0;
+}
+
+// Makes a rename in the directory of 'filename' durable.
+static bool
+session_log_sync_directory(const std::string& filename) {
+  std::string::size_type slash = filename.rfind('/');
+  std::string            directory =
+    slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+
+  int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (fd == -1)
+    return false;
+
+  bool synced = ::fsync(fd) == 0;
+
+  ::close(fd);
+  return synced;
+}
+
+SessionLog::~SessionLog() {
+  close();
+}
+
+void
+SessionLog::open(const std::string& filename) {
+  close();
+
+  int fd =
+    ::open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+  if (fd == -1)
+    throw torrent::storage_error("Could not open session log \"" + filename +
+                                 "\": " + std::strerror(errno));
+
+  struct stat st;
+
+  if (::fstat(fd, &st) == -1) {
+    ::close(fd);
+    throw torrent::storage_error("Could not open session log \"" + filename +
+                                 "\": " + std::strerror(errno));
+  }
+
+  m_filename = filename;
+  m_fd       = fd;
+
+  if (st.st_size == 0) {
+    std::string header;
+    session_log_put_header(&header);
+
+    if (!session_log_write(m_fd, header)) {
+      close();
+      throw torrent::storage_error("Could not write session log \"" +
+                                   filename + "\".");
+    }
+
+    m_fileSize = header_size;
+    return;
+  }
+
+  session_log_map records;
+  size_t          committed;
+
+  {
+    session_log_mapping mapping(m_fd);
+
+    committed = mapping.is_valid()
+                  ? session_log_scan(mapping.data(), mapping.size(), &records)
+                  : 0;
+
+    for (const auto& [hash, spans] : records) {
+      sizes_type& sizes = m_index[hash];
+
+      for (size_t i = 0; i != sizes.size(); ++i) {
+        sizes[i] = spans[i].size;
+        m_liveSize += spans[i].size;
+      }
+    }
+  }
+
+  if (committed == 0) {
+    close();
+    throw torrent::storage_error("Invalid session log \"" + filename + "\".");
+  }
+
+  // Drop records of a checkpoint that was interrupted.
+  if (committed != static_cast<size_t>(st.st_size) &&
+      ::ftruncate(m_fd, committed) == -1) {
+    close();
+    throw torrent::storage_error("Could not truncate session log \"" +
+                                 filename + "\": " + std::strerror(errno));
+  }
+
+  m_fileSize = committed;
+}
+
+void
+SessionLog::close() {
+  if (m_fd != -1)
+    ::close(m_fd);
+
+  m_fd = -1;
+  m_filename.clear();
+  m_buffer.clear();
+  m_index.clear();
+  m_fileSize = 0;
+  m_liveSize = 0;
+  m_truncate      = false;
+  m_syncDirectory = false;
+}
+
+bool
+SessionLog::has_torrent(const std::string& hash) const {
+  index_type::const_iterator itr = m_index.find(hash);
+
+  return itr != m_index.end() && itr->second[record_torrent - 1] != 0;
+}
+
+void
+SessionLog::append(record_type            type,
+                   const std::string&     hash,
+                   const torrent::Object& object,
+                   uint32_t               skip_mask) {
+  if (type < record_torrent || type > record_resume || hash.size() != hash_size)
+    throw torrent::internal_error("SessionLog::append(...) bad record.");
+
+  size_t start = session_log_begin_record(&m_buffer, type, hash);
+
+  {
+    utils::string_streambuf buffer(&m_buffer);
+    std::ostream            stream(&buffer);
+
+    torrent::object_write_bencode(&stream, &object, skip_mask);
+  }
+
+  uint32_t& size = m_index[hash][type - 1];
+
+  m_liveSize -= size;
+  size = session_log_finish_record(&m_buffer, start);
+  m_liveSize += size;
+}
+
+void
+SessionLog::append_erase(const std::string& hash) {
+  if (hash.size() != hash_size)
+    throw torrent::internal_error("SessionLog::append_erase(...) bad hash.");
+
+  index_type::iterator itr = m_index.find(hash);
+
+  if (itr == m_index.end())
+    return;
+
+  for (uint32_t size : itr->second)
+    m_liveSize -= size;
+
+  m_index.erase(itr);
+
+  session_log_finish_record(
+    &m_buffer, session_log_begin_record(&m_buffer, record_erase, hash));
+}
+
+bool
+SessionLog::checkpoint() {
+  if (!is_open())
+    return false;
+
+  if (m_buffer.empty())
+    return true;
+
+  // Nothing is appended to a compacted log before its directory entry
+  // is durable, as a crash could otherwise bring back the previous
+  // file without the checkpoints written since.
+  if (m_syncDirectory) {
+    if (!session_log_sync_directory(m_filename))
+      return false;
+
+    m_syncDirectory = false;
+  }
+
+  // Cut off what a failed checkpoint left behind before appending
+  // after it.
+  if (m_truncate) {
+    if (::ftruncate(m_fd, m_fileSize) == -1)
+      return false;
+
+    m_truncate = false;
+  }
+
+  size_t pending = m_buffer.size();
+
+  session_log_finish_record(
+    &m_buffer,
+    session_log_begin_record(
+      &m_buffer, record_checkpoint, std::string(hash_size, '\0')));
+
+  if (!session_log_write(m_fd, m_buffer)) {
+    // Keep the records, which the index already includes, and retry
+    // them on the next checkpoint.
+    m_buffer.resize(pending);
+    m_truncate = ::ftruncate(m_fd, m_fileSize) == -1;
+    return false;
+  }
+
+  m_fileSize += m_buffer.size();
+  m_buffer.clear();
+
+  // Failing to compact leaves the current log, which is still valid.
+  if (m_fileSize >= compact_min_size &&
+      m_fileSize > 2 * (m_liveSize + header_size))
+    compact();
+
+  return true;
+}
+
+bool
+SessionLog::compact() {
+  std::string buffer;
+  buffer.reserve(header_size + m_liveSize + session_log_prefix_size +
+                 session_log_body_min);
+
+  session_log_put_header(&buffer);
+
+  {
+    session_log_mapping mapping(m_fd);
+    session_log_map     records;
+
+    if (!mapping.is_valid() ||
+        session_log_scan(mapping.data(), mapping.size(), &records) == 0)
+      return false;
+
+    for (const auto& [hash, spans] : records)
+      for (const auto& span : spans)
+        if (span.data != nullptr)
+          buffer.append(span.data, span.size);
+  }
+
+  session_log_finish_record(
+    &buffer,
+    session_log_begin_record(
+      &buffer, record_checkpoint, std::string(hash_size, '\0')));
+
+  std::string filename_new = m_filename + ".new";
+
+  int fd = ::open(filename_new.c_str(),
+                  O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                  0644);
+
+  if (fd == -1)
+    return false;
+
+  if (!session_log_write(fd, buffer) ||
+      ::rename(filename_new.c_str(), m_filename.c_str()) == -1) {
+    ::close(fd);
+    ::unlink(filename_new.c_str());
+    return false;
+  }
+
+  ::close(m_fd);
+
+  m_fd            = fd;
+  m_fileSize      = buffer.size();
+  m_syncDirectory = !session_log_sync_directory(m_filename);
+  return true;
+}
+
+bool
+SessionLog::read(const std::string& filename, entry_list* entries) {
+  int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd == -1)
+    return false;
+
+  session_log_mapping mapping(fd);
+  ::close(fd);
+
+  session_log_map records;
+
+  if (!mapping.is_valid() ||
+      session_log_scan(mapping.data(), mapping.size(), &records) == 0)
+    return false;
+
+  entries->reserve(entries->size() + records.size());
+
+  for (const auto& [hash, spans] : records) {
+    entry_type entry;
+    entry.hash = hash;
+
+    if (!session_log_decode(spans[record_torrent - 1], &entry.torrent))
+      continue;
+
+    session_log_decode(spans[record_rtorrent - 1], &entry.rtorrent);
+    session_log_decode(spans[record_resume - 1], &entry.resume);
+
+    entries->push_back(std::move(entry));
+  }
+
+  return true;
+}
+
+}
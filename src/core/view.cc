@@ -11,125 +11,46 @@
 #include "core/download_list.h"
 #include "core/manager.h"
 #include "core/view.h"
+#include "rpc/event_stream.h"
 #include "rpc/object_storage.h"
 #include "rpc/parse_commands.h"
 
 namespace core {
 
-// Also add focus thingie here?
-using view_downloads_compare_type = std::function<bool(Download*, Download*)>;
-using view_downloads_filter_type = std::function<bool(Download*)> ;
-struct view_downloads_compare
-  : view_downloads_compare_type {
-  view_downloads_compare(const torrent::Object& cmd)
-    : m_command(cmd) {}
-
-  bool operator()(Download* d1, Download* d2) const {
-    try {
-      if (m_command.is_empty())
-        return false;
-
-      if (!m_command.is_dict_key())
-        return rpc::parse_command_single(rpc::make_target_pair(d1, d2),
-                                         m_command.as_string())
-          .as_value();
-
-      // torrent::Object tmp_command = m_command;
-
-      // uint32_t flags = tmp_command.flags() & torrent::Object::mask_function;
-      // tmp_command.unset_flags(torrent::Object::mask_function);
-      // tmp_command.set_flags((flags >> 1) & torrent::Object::mask_function);
-
-      // rpc::parse_command_execute(rpc::make_target_pair(d1, d2),
-      // &tmp_command); return
-      // rpc::commands.call_command(tmp_command.as_dict_key().c_str(),
-      // tmp_command.as_dict_obj(),
-      //                                   rpc::make_target_pair(d1,
-      //                                   d2)).as_value();
-
-      return rpc::commands
-        .call_command(m_command.as_dict_key().c_str(),
-                      m_command.as_dict_obj(),
-                      rpc::make_target_pair(d1, d2))
-        .as_value();
-
-    } catch (torrent::input_error& e) {
-      control->core()->push_log(e.what());
+// Sorts set with the same command put the downloads in the same order.
+static bool
+view_same_command(const torrent::Object& lhs, const torrent::Object& rhs) {
+  if (lhs.type() != rhs.type() || lhs.flags() != rhs.flags())
+    return false;
 
-      return false;
-    }
-  }
-
-  const torrent::Object& m_command;
-};
-
-struct view_downloads_filter : view_downloads_filter_type {
-  view_downloads_filter(const torrent::Object& cmd, const torrent::Object& cmd2)
-    : m_command(cmd)
-    , m_command2(cmd2) {}
-
-  bool operator()(Download* d1) const {
-    return this->evalCmd(m_command, d1) && this->evalCmd(m_command2, d1);
-  }
-
-  bool evalCmd(const torrent::Object& cmd, Download* d1) const {
-    if (cmd.is_empty())
+  switch (lhs.type()) {
+    case torrent::Object::TYPE_NONE:
       return true;
-
-    try {
-      torrent::Object result;
-
-      if (cmd.is_dict_key()) {
-        // torrent::Object tmp_command = cmd;
-
-        // uint32_t flags = tmp_command.flags() &
-        // torrent::Object::mask_function;
-        // tmp_command.unset_flags(torrent::Object::mask_function);
-        // tmp_command.set_flags((flags >> 1) & torrent::Object::mask_function);
-
-        // rpc::parse_command_execute(rpc::make_target(d1), &tmp_command);
-        // result =
-        // rpc::commands.call_command(tmp_command.as_dict_key().c_str(),
-        // tmp_command.as_dict_obj(),
-        //                                     rpc::make_target(d1));
-
-        result = rpc::commands.call_command(
-          cmd.as_dict_key().c_str(), cmd.as_dict_obj(), rpc::make_target(d1));
-
-      } else {
-        result =
-          rpc::parse_command_single(rpc::make_target(d1), cmd.as_string());
-      }
-
-      switch (result.type()) {
-          //      case torrent::Object::TYPE_RAW_BENCODE: return
-          //      !result.as_raw_bencode().empty();
-        case torrent::Object::TYPE_VALUE:
-          return result.as_value();
-        case torrent::Object::TYPE_STRING:
-          return !result.as_string().empty();
-        case torrent::Object::TYPE_LIST:
-          return !result.as_list().empty();
-        case torrent::Object::TYPE_MAP:
-          return !result.as_map().empty();
-        default:
-          return false;
-      }
-
-      // The default filter action is to return true, to not filter
-      // the download out.
-      return true;
-
-    } catch (torrent::input_error& e) {
-      control->core()->push_log(e.what());
-
+    case torrent::Object::TYPE_VALUE:
+      return lhs.as_value() == rhs.as_value();
+    case torrent::Object::TYPE_STRING:
+      return lhs.as_string() == rhs.as_string();
+    case torrent::Object::TYPE_LIST:
+      return std::equal(lhs.as_list().begin(),
+                        lhs.as_list().end(),
+                        rhs.as_list().begin(),
+                        rhs.as_list().end(),
+                        view_same_command);
+    case torrent::Object::TYPE_DICT_KEY:
+      return lhs.as_dict_key() == rhs.as_dict_key() &&
+             view_same_command(lhs.as_dict_obj(), rhs.as_dict_obj());
+    default:
       return false;
-    }
   }
+}
 
-  const torrent::Object& m_command;
-  const torrent::Object& m_command2;
-};
+// Visible when both the view's filter and the temporary filter pass.
+static bool
+view_filter_matches(const ViewExpression& filter,
+                    const ViewExpression& temp_filter,
+                    Download*             download) {
+  return filter.filter(download) && temp_filter.filter(download);
+}
 
 void
 View::emit_changed() {
@@ -171,30 +92,60 @@ View::initialize(const std::string& name) {
   // Urgh, wrong. No filtering being done.
   for (const auto& download : *dlist) {
     push_back(download);
+    set_visible_bit(download, true);
   }
 
-  m_size  = base_type::size();
-  m_focus = 0;
+  m_size      = base_type::size();
+  m_focus     = 0;
+  m_sortedNew = m_size <= 1;
 
   set_last_changed(torrent::utils::timer());
   m_delayChanged.slot() = [this] { emit_changed_now(); };
 }
 
+void
+View::insert(Download* download) {
+  base_type::push_back(download);
+  set_visible_bit(download, false);
+}
+
 void
 View::erase(Download* download) {
-  iterator itr = std::find(base_type::begin(), base_type::end(), download);
+  bool     visible = is_visible(download);
+  iterator last    = visible ? end_visible() : end_filtered();
+  iterator itr =
+    std::find(visible ? begin_visible() : begin_filtered(), last, download);
 
-  if (itr >= end_visible()) {
-    erase_internal(itr);
+  m_dirty.erase(download);
+  m_pending.erase(download);
 
-  } else {
-    erase_internal(itr);
-    rpc::call_object_nothrow(m_event_removed, rpc::make_target(download));
-  }
+  if (itr == last)
+    throw torrent::internal_error("View::erase(...) could not find download.");
+
+  erase_internal(itr);
+
+  if (visible)
+    event_removed(download);
+}
+
+bool
+View::is_visible(Download* download) const {
+  return download->id() < m_visibleIds.size() && m_visibleIds[download->id()];
+}
+
+void
+View::set_visible_bit(Download* download, bool state) {
+  if (download->id() >= m_visibleIds.size())
+    m_visibleIds.resize(download->id() + 1);
+
+  m_visibleIds[download->id()] = state;
 }
 
 void
 View::set_visible(Download* download) {
+  if (is_visible(download))
+    return;
+
   iterator itr = std::find(begin_filtered(), end_filtered(), download);
 
   if (itr == end_filtered())
@@ -205,11 +156,14 @@ View::set_visible(Download* download) {
   base_type::erase(itr);
   insert_visible(download);
 
-  rpc::call_object_nothrow(m_event_added, rpc::make_target(download));
+  event_added(download);
 }
 
 void
 View::set_not_visible(Download* download) {
+  if (!is_visible(download))
+    return;
+
   iterator itr = std::find(begin_visible(), end_visible(), download);
 
   if (itr == end_visible())
@@ -222,8 +176,9 @@ View::set_not_visible(Download* download) {
   // non-visible elements.
   base_type::erase(itr);
   base_type::push_back(download);
+  set_visible_bit(download, false);
 
-  rpc::call_object_nothrow(m_event_removed, rpc::make_target(download));
+  event_removed(download);
 }
 
 void
@@ -246,15 +201,21 @@ View::prev_focus() {
 
 void
 View::sort() {
-  if (m_sortCurrent.is_empty()) {
+  if (m_sortCurrent.empty()) {
     return;
   }
 
   Download* curFocus = focus() != end_visible() ? *focus() : nullptr;
 
   // Don't go randomly switching around equivalent elements.
-  std::stable_sort(
-    begin(), end_visible(), view_downloads_compare(m_sortCurrent));
+  if (!m_sortCurrent.sort(begin(), end_visible()))
+    std::stable_sort(
+      begin(), end_visible(), [this](Download* d1, Download* d2) {
+        return m_sortCurrent.compare(d1, d2);
+      });
+
+  m_sortedNew = m_size <= 1 ||
+                view_same_command(m_sortCurrent.command(), m_sortNew.command());
 
   m_focus = position(std::find(begin(), end_visible(), curFocus));
   emit_changed();
@@ -266,15 +227,45 @@ View::filter() {
   if (m_name == "started" || m_name == "stopped")
     return;
 
+  if (m_filterStale)
+    return filter_all();
+
+  // Downloads marked while filtering are left for the next pass. Those
+  // erased by event commands are dropped from the pending set by
+  // erase(), so the set never holds a download not in the view.
+  m_pending.insert(m_dirty.begin(), m_dirty.end());
+  m_dirty.clear();
+
+  while (!m_pending.empty()) {
+    Download* download = *m_pending.begin();
+    m_pending.erase(m_pending.begin());
+
+    // Like the full pass, downloads that stay visible keep their
+    // position.
+    if (view_filter_matches(m_filter, m_temp_filter, download) !=
+        is_visible(download))
+      filter_download(download);
+  }
+}
+
+void
+View::filter_all() {
+  if (m_name == "started" || m_name == "stopped")
+    return;
+
+  m_dirty.clear();
+  m_pending.clear();
+  m_filterStale = false;
+
+  auto matches = [this](Download* download) {
+    return view_filter_matches(m_filter, m_temp_filter, download);
+  };
+
   // Parition the list in two steps so we know which elements changed.
   iterator splitVisible =
-    std::stable_partition(begin_visible(),
-                          end_visible(),
-                          view_downloads_filter(m_filter, m_temp_filter));
+    std::stable_partition(begin_visible(), end_visible(), matches);
   iterator splitFiltered =
-    std::stable_partition(begin_filtered(),
-                          end_filtered(),
-                          view_downloads_filter(m_filter, m_temp_filter));
+    std::stable_partition(begin_filtered(), end_filtered(), matches);
 
   base_type changed(splitVisible, splitFiltered);
   iterator  splitChanged =
@@ -284,6 +275,17 @@ View::filter() {
                          std::copy(splitChanged, changed.end(), splitVisible));
   std::copy(changed.begin(), splitChanged, begin_filtered());
 
+  // Newly visible downloads are appended without sorting.
+  if (splitChanged != changed.end())
+    m_sortedNew = m_size <= 1;
+
+  std::for_each(changed.begin(), splitChanged, [this](Download* download) {
+    set_visible_bit(download, false);
+  });
+  std::for_each(splitChanged, changed.end(), [this](Download* download) {
+    set_visible_bit(download, true);
+  });
+
   // Fix this...
   m_focus = std::min(m_focus, m_size);
 
@@ -297,52 +299,50 @@ View::filter() {
   // done by using a base_type* member variable, and making sure we
   // set the elements to NULL as we trigger commands on them. Or
   // perhaps always clear them, thus not throwing anything.
-  if (!m_event_removed.is_empty()) {
-    std::for_each(changed.begin(), splitChanged, [this](const auto& download) {
-      return rpc::call_object_d_nothrow(m_event_removed, download);
-    });
-  }
-
-  if (!m_event_added.is_empty()) {
-    std::for_each(changed.begin(), splitChanged, [this](const auto& download) {
-      return rpc::call_object_d_nothrow(m_event_added, download);
-    });
-  }
+  std::for_each(changed.begin(), splitChanged, [this](Download* download) {
+    event_removed(download);
+  });
+  std::for_each(splitChanged, changed.end(), [this](Download* download) {
+    event_added(download);
+  });
 
   emit_changed();
 }
 
 void
 View::filter_by(const torrent::Object& condition, View::base_type& result) {
-  // std::copy_if(begin_visible(), end_visible(), result.begin(),
-  // view_downloads_filter(condition));
-  view_downloads_filter matches =
-    view_downloads_filter(condition, m_temp_filter);
+  // Compiled once for all the downloads in the view.
+  ViewExpression filter;
+  filter.set_command(condition);
 
   for (iterator itr = begin_visible(); itr != end_visible(); ++itr)
-    if (matches(*itr))
+    if (view_filter_matches(filter, m_temp_filter, *itr))
       result.push_back(*itr);
 }
 
 void
 View::filter_download(core::Download* download) {
-  iterator itr = std::find(base_type::end() - 1, base_type::end(), download);
+  // Newly inserted downloads are at the end of the filtered range.
+  iterator itr = base_type::end();
 
-  if (itr == base_type::end()) {
-    itr = std::find(base_type::begin(), base_type::end() - 1, download);
-  }
+  if (is_visible(download))
+    itr = std::find(begin_visible(), end_visible(), download);
+  else if (!base_type::empty() && base_type::back() == download)
+    itr = base_type::end() - 1;
+  else
+    itr = std::find(begin_filtered(), end_filtered(), download);
 
-  if (itr == base_type::end()) {
+  if (itr == base_type::end() || *itr != download) {
     throw torrent::internal_error(
       "View::filter_download(...) could not find download.");
   }
 
-  if (view_downloads_filter(m_filter, m_temp_filter)(download)) {
+  if (view_filter_matches(m_filter, m_temp_filter, download)) {
     if (itr >= end_visible()) {
       erase_internal(itr);
       insert_visible(download);
 
-      rpc::call_object_nothrow(m_event_added, rpc::make_target(download));
+      event_added(download);
 
     } else {
       // This makes sure the download is sorted even if it is
@@ -360,7 +360,7 @@ View::filter_download(core::Download* download) {
     erase_internal(itr);
     base_type::push_back(download);
 
-    rpc::call_object_nothrow(m_event_removed, rpc::make_target(download));
+    event_removed(download);
   }
 
   emit_changed();
@@ -377,20 +377,36 @@ View::clear_filter_on() {
   control->object_storage()->rlookup_clear("!view." + m_name);
 }
 
+void
+View::event_added(Download* download) {
+  if (!m_event_added.is_empty())
+    rpc::call_object_nothrow(m_event_added, rpc::make_target(download));
+
+  rpc::publish_view_event("view.added", m_name, download);
+}
+
+void
+View::event_removed(Download* download) {
+  if (!m_event_removed.is_empty())
+    rpc::call_object_nothrow(m_event_removed, rpc::make_target(download));
+
+  rpc::publish_view_event("view.removed", m_name, download);
+}
+
 inline void
 View::insert_visible(Download* d) {
+  if (m_size == 0)
+    m_sortedNew = true;
+
   iterator itr =
-    m_sortNew.is_empty()
-      ? end_visible()
-      : std::find_if(
-          begin_visible(), end_visible(), [d, this](Download* download) {
-            return view_downloads_compare(m_sortNew)(d, download);
-          });
+    m_sortedNew ? m_sortNew.upper_bound(begin_visible(), end_visible(), d)
+                : m_sortNew.find_after(begin_visible(), end_visible(), d);
 
   m_size++;
   m_focus += (m_focus >= position(itr));
 
   base_type::insert(itr, d);
+  set_visible_bit(d, true);
 }
 
 inline void
@@ -402,6 +418,7 @@ View::erase_internal(iterator itr) {
   m_size -= (itr < end_visible());
   m_focus -= (m_focus > position(itr));
 
+  set_visible_bit(*itr, false);
   base_type::erase(itr);
 }
 
@@ -0,0 +1,693 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <torrent/exceptions.h>
+
+#include "control.h"
+#include "core/manager.h"
+#include "globals.h"
+#include "rpc/parse_commands.h"
+
+#include "core/view_expression.h"
+
+namespace core {
+
+class ViewExpression::node {
+public:
+  virtual ~node() = default;
+
+  virtual torrent::Object evaluate(rpc::target_type target) const = 0;
+
+  // Same conversion as 'as_boolean' in command_logic.cc.
+  virtual bool test(rpc::target_type target) const {
+    return as_boolean(evaluate(target));
+  }
+
+  static bool as_boolean(const torrent::Object& object) {
+    switch (object.type()) {
+      case torrent::Object::TYPE_VALUE:
+        return object.as_value();
+      case torrent::Object::TYPE_STRING:
+        return !object.as_string().empty();
+      case torrent::Object::TYPE_LIST:
+        return !object.as_list().empty() &&
+               as_boolean(object.as_list().front());
+      default:
+        return false;
+    }
+  }
+};
+
+// The fields a sort compares, each evaluated once per download by
+// ViewExpression::sort.
+class ViewExpression::sort_plan {
+public:
+  struct field_type {
+    std::unique_ptr<node> command;
+    bool                  descending;
+    std::string           mismatch;
+  };
+
+  std::vector<field_type> fields;
+
+  // 'compare' orders otherwise equal downloads by address.
+  bool tiebreak;
+};
+
+namespace {
+
+using node_ptr  = std::unique_ptr<ViewExpression::node>;
+using node_list = std::vector<node_ptr>;
+
+class node_constant : public ViewExpression::node {
+public:
+  node_constant(torrent::Object value)
+    : m_value(std::move(value)) {}
+
+  torrent::Object evaluate(rpc::target_type) const override {
+    return m_value;
+  }
+
+private:
+  torrent::Object m_value;
+};
+
+// A command resolved to its command map entry. Arguments with '$'
+// strings or nested commands are still expanded on every call, the
+// way parse_command_single does.
+class node_call : public ViewExpression::node {
+public:
+  node_call(rpc::CommandMap::iterator itr,
+            torrent::Object           args,
+            bool                      substitute)
+    : m_itr(itr)
+    , m_args(std::move(args))
+    , m_substitute(substitute) {}
+
+  torrent::Object evaluate(rpc::target_type target) const override {
+    if (m_substitute)
+      return rpc::parse_command_(target, m_itr, m_args);
+
+    return rpc::commands.call_command(m_itr, m_args, target);
+  }
+
+private:
+  rpc::CommandMap::iterator m_itr;
+  torrent::Object           m_args;
+  bool                      m_substitute;
+};
+
+// Fallback for commands that failed to compile.
+class node_uncompiled : public ViewExpression::node {
+public:
+  node_uncompiled(const torrent::Object& command)
+    : m_command(command) {}
+
+  torrent::Object evaluate(rpc::target_type target) const override {
+    if (m_command.is_dict_key())
+      return rpc::commands.call_command(
+        m_command.as_dict_key().c_str(), m_command.as_dict_obj(), target);
+
+    return rpc::parse_command_single(target, m_command.as_string());
+  }
+
+private:
+  const torrent::Object& m_command;
+};
+
+class node_not : public ViewExpression::node {
+public:
+  node_not(node_ptr operand)
+    : m_operand(std::move(operand)) {}
+
+  torrent::Object evaluate(rpc::target_type target) const override {
+    return (int64_t)test(target);
+  }
+  bool test(rpc::target_type target) const override {
+    return !m_operand->test(target);
+  }
+
+private:
+  node_ptr m_operand;
+};
+
+// 'and' stops at the first false operand, 'or' at the first true.
+class node_logic : public ViewExpression::node {
+public:
+  node_logic(bool is_and, node_list operands)
+    : m_and(is_and)
+    , m_operands(std::move(operands)) {}
+
+  torrent::Object evaluate(rpc::target_type target) const override {
+    return (int64_t)test(target);
+  }
+  bool test(rpc::target_type target) const override {
+    for (const auto& operand : m_operands)
+      if (operand->test(target) != m_and)
+        return !m_and;
+
+    return m_and;
+  }
+
+private:
+  bool      m_and;
+  node_list m_operands;
+};
+
+// 'less', 'greater' and 'equal', with the left and right sides called
+// on the respective download of a target pair.
+class node_compare : public ViewExpression::node {
+public:
+  enum order_type { order_less, order_greater, order_equal };
+
+  node_compare(order_type order, node_ptr left, node_ptr right)
+    : m_order(order)
+    , m_left(std::move(left))
+    , m_right(std::move(right)) {}
+
+  torrent::Object evaluate(rpc::target_type target) const override {
+    return (int64_t)test(target);
+  }
+
+  bool test(rpc::target_type target) const override {
+    bool pair = rpc::is_target_pair(target);
+
+    torrent::Object result1 =
+      m_left->evaluate(pair ? rpc::get_target_left(target) : target);
+    torrent::Object result2 =
+      m_right->evaluate(pair ? rpc::get_target_right(target) : target);
+
+    if (result1.type() != result2.type())
+      throw torrent::input_error("Type mismatch.");
+
+    int cmp;
+
+    switch (result1.type()) {
+      case torrent::Object::TYPE_VALUE:
+        cmp = result1.as_value() < result2.as_value()
+                ? -1
+                : result1.as_value() > result2.as_value();
+        break;
+      case torrent::Object::TYPE_STRING:
+        cmp = result1.as_string().compare(result2.as_string());
+        break;
+      default:
+        return false;
+    }
+
+    switch (m_order) {
+      case order_less:
+        return cmp < 0;
+      case order_greater:
+        return cmp > 0;
+      default:
+        return cmp == 0;
+    }
+  }
+
+private:
+  order_type m_order;
+  node_ptr   m_left;
+  node_ptr   m_right;
+};
+
+node_ptr
+compile_call(rpc::CommandMap::iterator itr,
+             const torrent::Object&    args,
+             bool                      substitute);
+
+// Would parse_command_execute modify these arguments.
+bool
+needs_substitution(const torrent::Object& args) {
+  switch (args.type()) {
+    case torrent::Object::TYPE_STRING:
+      return *args.as_string().c_str() == '$';
+    case torrent::Object::TYPE_DICT_KEY:
+      return true;
+    case torrent::Object::TYPE_LIST:
+      for (const auto& arg : args.as_list())
+        if (!arg.is_list() && needs_substitution(arg))
+          return true;
+
+      return false;
+    default:
+      return false;
+  }
+}
+
+rpc::CommandMap::iterator
+compile_find(const char* key) {
+  rpc::CommandMap::iterator itr = rpc::commands.find(key);
+
+  if (itr == rpc::commands.end())
+    throw torrent::input_error("Command \"" + std::string(key) +
+                               "\" does not exist.");
+
+  return itr;
+}
+
+// A command looked up in the command map, with the arguments it is
+// to be called with.
+struct resolved_command {
+  rpc::CommandMap::iterator itr;
+  torrent::Object           args;
+  bool                      substitute;
+};
+
+// Command objects, as passed to 'and', are called with their arguments
+// as they are. Command strings such as 'd.name=' are called as by
+// parse_command_single. Returns false for an empty command string.
+bool
+resolve_operand(const torrent::Object& operand, resolved_command* command) {
+  if (operand.is_dict_key()) {
+    command->itr        = compile_find(operand.as_dict_key().c_str());
+    command->args       = operand.as_dict_obj();
+    command->substitute = false;
+    return true;
+  }
+
+  const std::string& str = operand.as_string();
+
+  char        key[128];
+  const char* first = str.c_str();
+
+  if (!rpc::parse_line(key, command->args, first, str.c_str() + str.size()))
+    return false;
+
+  command->itr        = compile_find(key);
+  command->substitute = needs_substitution(command->args);
+  return true;
+}
+
+node_ptr
+compile_operand(const torrent::Object& operand) {
+  resolved_command command;
+
+  if (!resolve_operand(operand, &command))
+    return std::make_unique<node_constant>(torrent::Object());
+
+  return compile_call(command.itr, command.args, command.substitute);
+}
+
+node_ptr
+compile_not(const torrent::Object& args) {
+  if (args.is_dict_key())
+    return std::make_unique<node_not>(compile_operand(args));
+
+  if (args.is_list() && !args.as_list().empty())
+    return compile_not(args.as_list().front());
+
+  return std::make_unique<node_constant>(
+    (int64_t)!ViewExpression::node::as_boolean(args));
+}
+
+node_ptr
+compile_logic(bool is_and, const torrent::Object& args) {
+  if (!args.is_list())
+    return std::make_unique<node_constant>(
+      (int64_t)ViewExpression::node::as_boolean(args));
+
+  node_list operands;
+
+  for (const auto& arg : args.as_list()) {
+    if (arg.is_value())
+      operands.push_back(std::make_unique<node_constant>(arg));
+    else
+      operands.push_back(compile_operand(arg));
+  }
+
+  return std::make_unique<node_logic>(is_and, std::move(operands));
+}
+
+node_ptr
+compile_compare(node_compare::order_type order, const torrent::Object& args) {
+  if (args.is_empty() || (args.is_list() && args.as_list().empty()))
+    throw torrent::input_error("Wrong argument count.");
+
+  const torrent::Object& front = args.is_list() ? args.as_list().front() : args;
+  const torrent::Object& back  = args.is_list() ? args.as_list().back() : args;
+
+  return std::make_unique<node_compare>(
+    order, compile_operand(front), compile_operand(back));
+}
+
+node_ptr
+compile_call(rpc::CommandMap::iterator itr,
+             const torrent::Object&    args,
+             bool                      substitute) {
+  // The logic commands only see the arguments after substitution, so
+  // leave those to the commands themselves.
+  if (!substitute) {
+    const char* name = itr->first;
+
+    if (std::strcmp(name, "and") == 0)
+      return compile_logic(true, args);
+    if (std::strcmp(name, "or") == 0)
+      return compile_logic(false, args);
+    if (std::strcmp(name, "not") == 0)
+      return compile_not(args);
+    if (std::strcmp(name, "less") == 0)
+      return compile_compare(node_compare::order_less, args);
+    if (std::strcmp(name, "greater") == 0)
+      return compile_compare(node_compare::order_greater, args);
+    if (std::strcmp(name, "equal") == 0)
+      return compile_compare(node_compare::order_equal, args);
+  }
+
+  return std::make_unique<node_call>(itr, args, substitute);
+}
+
+// Sorts that compare fields of the two downloads, either 'less' or
+// 'greater' with a single command, or 'compare' with an order
+// string. Returns nullptr for anything else.
+std::unique_ptr<ViewExpression::sort_plan>
+compile_sort_plan(const torrent::Object& command) {
+  resolved_command root;
+
+  if (!resolve_operand(command, &root) || root.substitute)
+    return nullptr;
+
+  auto        plan = std::make_unique<ViewExpression::sort_plan>();
+  const char* name = root.itr->first;
+
+  torrent::Object::list_type args;
+
+  if (root.args.is_list())
+    args = root.args.as_list();
+  else if (!root.args.is_empty())
+    args.push_back(root.args);
+
+  if (std::strcmp(name, "less") == 0 || std::strcmp(name, "greater") == 0) {
+    if (args.size() != 1)
+      return nullptr;
+
+    plan->tiebreak = false;
+    plan->fields.push_back({ compile_operand(args.front()),
+                             std::strcmp(name, "greater") == 0,
+                             "Type mismatch." });
+    return plan;
+  }
+
+  if (std::strcmp(name, "compare") != 0 || args.size() < 2)
+    return nullptr;
+
+  const std::string& order   = args.front().as_string();
+  const char*        current = order.c_str();
+
+  plan->tiebreak = true;
+
+  for (auto itr = std::next(args.begin()); itr != args.end(); ++itr) {
+    bool descending = *current == 'd' || *current == 'D' || *current == '-';
+
+    if (*current) {
+      if (!descending &&
+          !(*current == 'a' || *current == 'A' || *current == '+'))
+        return nullptr;
+
+      ++current;
+    }
+
+    plan->fields.push_back(
+      { compile_operand(*itr),
+        descending,
+        "Type mismatch in compare of " + itr->as_string() });
+  }
+
+  return plan;
+}
+
+}
+
+ViewExpression::ViewExpression() = default;
+ViewExpression::~ViewExpression() = default;
+
+void
+ViewExpression::set_command(const torrent::Object& command) {
+  m_command = command;
+  m_root.reset();
+  m_sortPlan.reset();
+}
+
+void
+ViewExpression::compile() const {
+  m_generation = rpc::commands.generation();
+
+  try {
+    m_root = compile_operand(m_command);
+  } catch (torrent::input_error&) {
+    m_root = std::make_unique<node_uncompiled>(m_command);
+  }
+
+  try {
+    m_sortPlan = compile_sort_plan(m_command);
+  } catch (torrent::input_error&) {
+    m_sortPlan.reset();
+  }
+}
+
+torrent::Object
+ViewExpression::evaluate(rpc::target_type target) const {
+  if (empty())
+    return torrent::Object();
+
+  prepare();
+
+  return m_root->evaluate(target);
+}
+
+bool
+ViewExpression::filter(Download* download) const {
+  if (empty())
+    return true;
+
+  try {
+    torrent::Object result = evaluate(rpc::make_target(download));
+
+    switch (result.type()) {
+      case torrent::Object::TYPE_VALUE:
+        return result.as_value();
+      case torrent::Object::TYPE_STRING:
+        return !result.as_string().empty();
+      case torrent::Object::TYPE_LIST:
+        return !result.as_list().empty();
+      case torrent::Object::TYPE_MAP:
+        return !result.as_map().empty();
+      default:
+        return false;
+    }
+
+  } catch (torrent::input_error& e) {
+    control->core()->push_log(e.what());
+
+    return false;
+  }
+}
+
+bool
+ViewExpression::compare(Download* download1, Download* download2) const {
+  if (empty())
+    return false;
+
+  try {
+    return evaluate(rpc::make_target_pair(download1, download2)).as_value();
+
+  } catch (torrent::input_error& e) {
+    control->core()->push_log(e.what());
+
+    return false;
+  }
+}
+
+namespace {
+
+struct sort_key {
+  enum kind_type { kind_none, kind_value, kind_string, kind_failed };
+
+  kind_type   kind{ kind_none };
+  int64_t     value{ 0 };
+  std::string string;
+};
+
+// Evaluates the fields of the plan for 'download' into 'keys', the
+// first error is kept for logging.
+void
+sort_keys_evaluate(const ViewExpression::sort_plan& plan,
+                   Download*                        download,
+                   sort_key*                        keys,
+                   std::string*                     error) {
+  for (const auto& field : plan.fields) {
+    sort_key& key = *keys++;
+
+    try {
+      torrent::Object result =
+        field.command->evaluate(rpc::make_target(download));
+
+      if (result.is_value()) {
+        key.kind  = sort_key::kind_value;
+        key.value = result.as_value();
+      } else if (result.is_string()) {
+        key.kind = sort_key::kind_string;
+        key.string.swap(result.as_string());
+      }
+
+    } catch (torrent::input_error& e) {
+      key.kind = sort_key::kind_failed;
+
+      if (error->empty())
+        *error = e.what();
+    }
+  }
+}
+
+// Failed evaluations and mismatched types compare as equal, as the
+// comparison would have failed.
+bool
+sort_keys_less(const ViewExpression::sort_plan& plan,
+               const sort_key*                  keys1,
+               Download*                        download1,
+               const sort_key*                  keys2,
+               Download*                        download2,
+               std::string*                     error) {
+  for (const auto& field : plan.fields) {
+    const sort_key& key1 = *keys1++;
+    const sort_key& key2 = *keys2++;
+
+    if (key1.kind == sort_key::kind_failed ||
+        key2.kind == sort_key::kind_failed)
+      return false;
+
+    if (key1.kind != key2.kind) {
+      if (error->empty())
+        *error = field.mismatch;
+
+      return false;
+    }
+
+    switch (key1.kind) {
+      case sort_key::kind_value:
+        if (key1.value != key2.value)
+          return field.descending ^ (key1.value < key2.value);
+        break;
+      case sort_key::kind_string:
+        if (key1.string != key2.string)
+          return field.descending ^ (key1.string < key2.string);
+        break;
+      default:
+        break;
+    }
+  }
+
+  return plan.tiebreak && download1 < download2;
+}
+
+}
+
+void
+ViewExpression::prepare() const {
+  if (m_root == nullptr || m_generation != rpc::commands.generation())
+    compile();
+}
+
+bool
+ViewExpression::sort(iterator first, iterator last) const {
+  if (empty())
+    return true;
+
+  prepare();
+
+  if (m_sortPlan == nullptr)
+    return false;
+
+  const size_t fields = m_sortPlan->fields.size();
+  const size_t size   = std::distance(first, last);
+
+  std::vector<sort_key> keys(size * fields);
+  std::string           error;
+
+  for (size_t i = 0; i != size; ++i)
+    sort_keys_evaluate(*m_sortPlan, first[i], &keys[i * fields], &error);
+
+  std::vector<size_t> order(size);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return sort_keys_less(*m_sortPlan,
+                          &keys[a * fields],
+                          first[a],
+                          &keys[b * fields],
+                          first[b],
+                          &error);
+  });
+
+  std::vector<Download*> sorted;
+  sorted.reserve(size);
+
+  for (size_t index : order)
+    sorted.push_back(first[index]);
+
+  std::copy(sorted.begin(), sorted.end(), first);
+
+  if (!error.empty())
+    control->core()->push_log(error.c_str());
+
+  return true;
+}
+
+ViewExpression::iterator
+ViewExpression::find_after(iterator  first,
+                           iterator  last,
+                           Download* download) const {
+  if (empty())
+    return last;
+
+  return std::find_if(first, last, [this, download](Download* d) {
+    return compare(download, d);
+  });
+}
+
+ViewExpression::iterator
+ViewExpression::upper_bound(iterator  first,
+                            iterator  last,
+                            Download* download) const {
+  if (empty())
+    return last;
+
+  prepare();
+
+  if (m_sortPlan == nullptr)
+    return std::upper_bound(
+      first, last, download, [this](Download* d1, Download* d2) {
+        return compare(d1, d2);
+      });
+
+  const size_t fields = m_sortPlan->fields.size();
+
+  std::vector<sort_key> keys(fields);
+  std::vector<sort_key> probe(fields);
+  std::string           error;
+
+  sort_keys_evaluate(*m_sortPlan, download, keys.data(), &error);
+
+  iterator itr = std::upper_bound(
+    first, last, download, [&](Download* d1, Download* d2) {
+      std::fill(probe.begin(), probe.end(), sort_key());
+      sort_keys_evaluate(*m_sortPlan, d2, probe.data(), &error);
+
+      return sort_keys_less(
+        *m_sortPlan, keys.data(), d1, probe.data(), d2, &error);
+    });
+
+  if (!error.empty())
+    control->core()->push_log(error.c_str());
+
+  return itr;
+}
+
+}
@@ -24,6 +24,7 @@ ViewManager::clear() {
   }
 
   base_type::clear();
+  m_index.clear();
 }
 
 ViewManager::iterator
@@ -37,19 +38,20 @@ ViewManager::insert(const std::string& name) {
   View* view = new View();
   view->initialize(name);
 
+  m_index.emplace(name, size());
   return base_type::insert(end(), view);
 }
 
 ViewManager::iterator
 ViewManager::find(const std::string& name) {
-  return std::find_if(
-    begin(), end(), [name](View* v) { return name == v->name(); });
+  auto itr = m_index.find(name);
+
+  return itr != m_index.end() ? begin() + itr->second : end();
 }
 
 ViewManager::iterator
 ViewManager::find_throw(const std::string& name) {
-  iterator itr =
-    std::find_if(begin(), end(), [name](View* v) { return name == v->name(); });
+  iterator itr = find(name);
 
   if (itr == end())
     throw torrent::input_error("Could not find view: " + name);
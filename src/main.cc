@@ -5,15 +5,20 @@
 
 #include "buildinfo.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <queue>
 #include <random>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 #include <inttypes.h>
 #include <unistd.h>
 
@@ -27,6 +32,7 @@
 #include <torrent/data/chunk_utils.h>
 #include <torrent/utils/log.h>
 #include <torrent/utils/error_number.h>
+#include <torrent/utils/string_manip.h>
 
 #ifdef LT_HAVE_BACKTRACE
 #include <execinfo.h>
@@ -37,6 +43,8 @@
 #include "core/download_factory.h"
 #include "core/download_store.h"
 #include "core/manager.h"
+#include "core/session_loader.h"
+#include "core/session_log.h"
 #include "core/view_manager.h"
 #include "display/canvas.h"
 #include "display/window.h"
@@ -124,10 +132,34 @@ void
 load_session_torrents() {
   indicators::BlockProgressBar* progress_bar = nullptr;
 
-  utils::Directory entries =
-    control->core()->download_store()->get_formated_entries();
+  core::DownloadStore* store = control->core()->download_store();
 
-  const auto entries_size = entries.size();
+  // The session log holds everything in one file, torrents still in
+  // the session directory were saved before switching to it and are
+  // loaded unless the log has them.
+  core::SessionLog::entry_list log_entries;
+  std::set<std::string>        log_files;
+
+  if (store->is_enabled() &&
+      store->format() == core::DownloadStore::format_log) {
+    core::SessionLog::read(store->session_log_filename(), &log_entries);
+
+    for (const auto& entry : log_entries)
+      log_files.insert(
+        torrent::utils::transform_hex(entry.hash.begin(), entry.hash.end()) +
+        ".torrent");
+  }
+
+  utils::Directory entries = store->get_formated_entries();
+
+  entries.erase(std::remove_if(entries.begin(),
+                               entries.end(),
+                               [&log_files](const utils::directory_entry& e) {
+                                 return log_files.count(e.d_name) != 0;
+                               }),
+                entries.end());
+
+  const auto entries_size = log_entries.size() + entries.size();
 
   if (!display::Canvas::isInitialized() && entries_size) {
     std::cout << "rTorrent: loading " << entries_size
@@ -143,36 +175,96 @@ load_session_torrents() {
     }
   }
 
-  for (const auto& entry : entries) {
-    // We don't really support session torrents that are links. These
-    // would be overwritten anyway on exit, and thus not really be
-    // useful.
-    if (!entry.is_file()) {
-      if (progress_bar != nullptr) {
-        progress_bar->tick();
-      }
-      continue;
-    }
+  const auto started = std::chrono::steady_clock::now();
 
+  auto create_factory = [&progress_bar, entries_size, started]() {
     core::DownloadFactory* f = new core::DownloadFactory(control->core());
 
     // Replace with session torrent flag.
     f->set_session(true);
     f->set_immediate(true);
-    f->slot_finished([f, &progress_bar, entries_size]() {
+    f->slot_finished([f, &progress_bar, entries_size, started]() {
       if (control->is_shutdown_received()) {
         throw std::runtime_error("shutdown received. aborting...");
       }
       if (progress_bar != nullptr) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - started)
+                         .count();
+        auto rate = (progress_bar->current() + 1) * 1000 /
+                    std::max<decltype(elapsed)>(elapsed, 1);
+
         progress_bar->set_option(indicators::option::PostfixText{
           std::to_string(progress_bar->current()) + "/" +
-          std::to_string(entries_size) });
+          std::to_string(entries_size) + " (" + std::to_string(rate) +
+          "/s)" });
         progress_bar->tick();
       }
       delete f;
     });
 
-    f->load(entries.path() + entry.d_name);
+    return f;
+  };
+
+  for (auto& entry : log_entries) {
+    core::DownloadFactory* f = create_factory();
+
+    f->load_session(store->path() +
+                      torrent::utils::transform_hex(entry.hash.begin(),
+                                                    entry.hash.end()) +
+                      ".torrent",
+                    entry.torrent,
+                    entry.rtorrent,
+                    entry.resume);
+    f->commit();
+  }
+
+  log_entries.clear();
+
+  std::vector<std::string> paths;
+  paths.reserve(entries.size());
+
+  for (const auto& entry : entries) {
+    // We don't really support session torrents that are links. These
+    // would be overwritten anyway on exit, and thus not really be
+    // useful.
+    if (!entry.is_file()) {
+      if (progress_bar != nullptr) {
+        progress_bar->tick();
+      }
+      continue;
+    }
+
+    paths.push_back(entries.path() + entry.d_name);
+  }
+
+  // Reading and decoding the files is done on a pool of threads, the
+  // downloads are created here in directory order.
+  core::SessionLoader loader(std::move(paths),
+                             std::min(std::thread::hardware_concurrency(), 8u));
+  core::SessionLoader::entry_type entry;
+
+  while (loader.next(&entry)) {
+    if (entry.corrupted) {
+      control->core()->push_log_std(
+        "Session torrent checksum mismatch, skipping: \"" + entry.path +
+        "\"");
+
+      if (progress_bar != nullptr)
+        progress_bar->tick();
+
+      continue;
+    }
+
+    core::DownloadFactory* f = create_factory();
+
+    // Files that failed to read are loaded again here, to report the
+    // error as before.
+    if (entry.loaded)
+      f->load_session(entry.path, entry.torrent, entry.rtorrent, entry.resume);
+    else
+      f->load(entry.path);
+
     f->commit();
   }
 
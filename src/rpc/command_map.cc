@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <torrent/data/file_list_iterator.h>
 #include <torrent/exceptions.h>
 #include <torrent/object.h>
@@ -21,6 +24,72 @@ namespace rpc {
 
 command_base::stack_type command_base::current_stack;
 
+// Commands that untrusted RPC connections may not call, marked with
+// 'flag_untrusted_denied' as they are registered.
+static const char* const untrusted_commands[] = {
+  "execute",
+  "execute.capture",
+  "execute.capture_nothrow",
+  "execute.nothrow",
+  "execute.nothrow.bg",
+  "execute.raw",
+  "execute.raw.bg",
+  "execute.raw_nothrow",
+  "execute.raw_nothrow.bg",
+  "execute.throw",
+  "execute.throw.bg",
+  "execute2",
+  "method.insert",
+  "method.redirect",
+  "method.set",
+  "method.set_key",
+  "schedule",
+  "schedule2",
+  "import",
+  "try_import",
+  "log.open_file",
+  "log.add_output",
+  "log.execute",
+  "log.vmmap.dump",
+  "log.xmlrpc",
+  "log.libtorrent",
+  "file.append",
+  // old commands
+  "execute_capture",
+  "execute_capture_nothrow",
+  "execute_nothrow",
+  "execute_nothrow_bg",
+  "execute_raw",
+  "execute_raw_bg",
+  "execute_raw_nothrow",
+  "execute_raw_nothrow_bg",
+  "execute_throw",
+  "execute_throw_bg",
+  "system.method.insert",
+  "system.method.redirect",
+  "system.method.set",
+  "system.method.set_key",
+  "on_insert",
+  "on_erase",
+  "on_open",
+  "on_close",
+  "on_start",
+  "on_stop",
+  "on_hash_queued",
+  "on_hash_removed",
+  "on_hash_done",
+  "on_finished"
+};
+
+static bool
+is_untrusted_command(const char* key) {
+  return std::any_of(std::begin(untrusted_commands),
+                     std::end(untrusted_commands),
+                     [key](const char* name) {
+                       return std::strcmp(key, name) == 0;
+                     });
+}
+
 CommandMap::~CommandMap() {
   std::vector<const char*> keys;
 
@@ -41,19 +110,24 @@ CommandMap::~CommandMap() {
 
 CommandMap::iterator
 CommandMap::insert(key_type key, int flags, const char* parm, const char* doc) {
-  iterator itr = base_type::find(key);
-
-  if (itr != base_type::end())
+  if (has(key))
     throw torrent::internal_error(
       "CommandMap::insert(...) tried to insert an already existing key.");
 
+  if (is_untrusted_command(key))
+    flags |= flag_untrusted_denied;
+
   // TODO: This is not honoring the public flags!!!
   if (rpc::rpc.is_initialized() && (flags & flag_public))
     // if (rpc::rpc.is_initialized())
     rpc::rpc.insert_command(key, parm, doc);
 
-  return base_type::insert(
-    itr, value_type(key, command_map_data_type(flags, parm, doc)));
+  iterator itr = base_type::emplace(
+    key, command_map_data_type(flags, parm, doc)).first;
+
+  m_index.emplace(itr->first, itr);
+  m_generation++;
+  return itr;
 }
 
 // void
@@ -87,21 +161,22 @@ CommandMap::erase(iterator itr) {
   const char* key =
     itr->second.m_flags & flag_delete_key ? itr->first : nullptr;
 
+  m_index.erase(itr->first);
+  m_generation++;
   base_type::erase(itr);
   delete[] key;
 }
 
 void
 CommandMap::create_redirect(key_type key_new, key_type key_dest, int flags) {
-  iterator new_itr  = base_type::find(key_new);
-  iterator dest_itr = base_type::find(key_dest);
+  iterator dest_itr = find(key_dest);
 
   if (dest_itr == base_type::end())
     throw torrent::input_error(
       "Tried to redirect to a key that doesn't exist: '" +
       std::string(key_dest) + "'.");
 
-  if (new_itr != base_type::end())
+  if (has(key_new))
     throw torrent::input_error(
       "Tried to create a redirect key that already exists: '" +
       std::string(key_new) + "'.");
@@ -116,6 +191,9 @@ CommandMap::create_redirect(key_type key_new, key_type key_dest, int flags) {
   flags |= dest_itr->second.m_flags &
            ~(flag_delete_key | flag_has_redirects | flag_public);
 
+  if (is_untrusted_command(key_new))
+    flags |= flag_untrusted_denied;
+
   // TODO: This is not honoring the public flags!!!
   if (rpc::rpc.is_initialized() && (flags & flag_public))
     rpc::rpc.insert_command(
@@ -127,6 +205,9 @@ CommandMap::create_redirect(key_type key_new, key_type key_dest, int flags) {
                command_map_data_type(
                  flags, dest_itr->second.m_parm, dest_itr->second.m_doc)));
 
+  m_index.emplace(itr->first, itr);
+  m_generation++;
+
   // We can assume all the slots are the same size.
   itr->second.m_variable = dest_itr->second.m_variable;
   itr->second.m_anySlot  = dest_itr->second.m_anySlot;
@@ -149,22 +230,25 @@ const CommandMap::mapped_type
 CommandMap::call_command(key_type           key,
                          const mapped_type& arg,
                          target_type        target) {
-  iterator itr = base_type::find(key);
-
-  if( !rpc.is_command_enabled( key ) )
-    throw torrent::input_error("Command \"" + std::string(key) + "\" is not enabled for untrusted connections.");
+  iterator itr = find(key);
 
   if (itr == base_type::end())
     throw torrent::input_error("Command \"" + std::string(key) +
                                "\" does not exist.");
 
-  return itr->second.m_anySlot(&itr->second.m_variable, target, arg);
+  return call_command(itr, arg, target);
 }
 
 const CommandMap::mapped_type
 CommandMap::call_command(iterator           itr,
                          const mapped_type& arg,
                          target_type        target) {
+  // Only the few denied commands need to look at the thread's trust.
+  if ((itr->second.m_flags & flag_untrusted_denied) &&
+      !RpcManager::is_trusted_connection())
+    throw torrent::input_error("Command \"" + std::string(itr->first) +
+                               "\" is not enabled for untrusted connections.");
+
   return itr->second.m_anySlot(&itr->second.m_variable, target, arg);
 }
 
@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <algorithm>
+#include <cstdio>
+
+#include <torrent/download.h>
+#include <torrent/download_info.h>
+#include <torrent/hash_string.h>
+#include <torrent/utils/string_manip.h>
+
+#include "core/download.h"
+#include "globals.h"
+#include "rpc/scgi.h"
+#include "thread_worker.h"
+
+#include "rpc/event_stream.h"
+
+namespace rpc {
+
+static void
+append_json_string(std::string& dest, std::string_view str) {
+  dest += '"';
+
+  for (const char c : str) {
+    switch (c) {
+      case '"':
+        dest += "\\\"";
+        break;
+      case '\\':
+        dest += "\\\\";
+        break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)c);
+          dest += escaped;
+        } else {
+          dest += c;
+        }
+    }
+  }
+
+  dest += '"';
+}
+
+bool
+EventQueue::push(const std::string& notification) {
+  const bool wake = m_pending.empty();
+
+  if (m_pending.size() <= max_size)
+    m_pending += notification;
+
+  return wake;
+}
+
+std::string
+EventQueue::take() {
+  std::string batch;
+
+  batch.swap(m_pending);
+  return batch;
+}
+
+void
+EventStream::publish(std::string_view                        topic,
+                     std::string_view                        method,
+                     std::initializer_list<std::string_view> params) {
+  if (!has_subscribers())
+    return;
+
+  std::string notification;
+
+  std::lock_guard<std::mutex> guard(m_lock);
+
+  for (auto& subscriber : m_subscribers) {
+    if (std::find(subscriber.topics.begin(), subscriber.topics.end(), topic) ==
+        subscriber.topics.end())
+      continue;
+
+    // Only format the notification once somebody wants it.
+    if (notification.empty()) {
+      notification = "{\"jsonrpc\":\"2.0\",\"method\":";
+      append_json_string(notification, method);
+      notification += ",\"params\":[";
+
+      for (auto itr = params.begin(); itr != params.end(); ++itr) {
+        if (itr != params.begin())
+          notification += ',';
+
+        append_json_string(notification, *itr);
+      }
+
+      notification += "]}\n";
+    }
+
+    // Events published before the thread gets around to delivering
+    // are written along with the first.
+    if (subscriber.queue.push(notification))
+      subscriber.task->thread()->queue_deliver_events();
+  }
+}
+
+void
+EventStream::subscribe(SCgiTask* task, const topic_list& topics) {
+  std::lock_guard<std::mutex> guard(m_lock);
+
+  auto itr = std::find_if(
+    m_subscribers.begin(), m_subscribers.end(), [task](const auto& s) {
+      return s.task == task;
+    });
+
+  if (itr == m_subscribers.end()) {
+    m_subscribers.push_back(subscriber_type{ task, topics, EventQueue() });
+    m_size++;
+    return;
+  }
+
+  for (const auto& topic : topics)
+    if (std::find(itr->topics.begin(), itr->topics.end(), topic) ==
+        itr->topics.end())
+      itr->topics.push_back(topic);
+}
+
+void
+EventStream::unsubscribe(SCgiTask* task) {
+  std::lock_guard<std::mutex> guard(m_lock);
+
+  auto itr = std::find_if(
+    m_subscribers.begin(), m_subscribers.end(), [task](const auto& s) {
+      return s.task == task;
+    });
+
+  if (itr == m_subscribers.end())
+    return;
+
+  m_subscribers.erase(itr);
+  m_size--;
+}
+
+void
+EventStream::deliver(ThreadWorker* thread) {
+  std::vector<SCgiTask*> overflowed;
+
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    for (auto& subscriber : m_subscribers) {
+      if (subscriber.queue.empty() || subscriber.task->thread() != thread)
+        continue;
+
+      const bool  overflow = subscriber.queue.is_overflowed();
+      std::string batch    = subscriber.queue.take();
+
+      if (overflow || !subscriber.task->write_stream(std::move(batch)))
+        overflowed.push_back(subscriber.task);
+    }
+  }
+
+  // Closing a task unsubscribes it, so this is done without holding
+  // the lock.
+  for (auto task : overflowed)
+    task->close();
+}
+
+void
+publish_download_event(const char* event, core::Download* download) {
+  SCgi* scgi = worker_thread->scgi();
+
+  if (scgi == nullptr || !scgi->events().has_subscribers())
+    return;
+
+  scgi->events().publish(
+    event,
+    event,
+    { torrent::utils::transform_hex_str(download->info()->hash()) });
+}
+
+void
+publish_view_event(const char*        event,
+                   const std::string& view,
+                   core::Download*    download) {
+  SCgi* scgi = worker_thread->scgi();
+
+  if (scgi == nullptr || !scgi->events().has_subscribers())
+    return;
+
+  scgi->events().publish(
+    "view:" + view,
+    event,
+    { view, torrent::utils::transform_hex_str(download->info()->hash()) });
+}
+
+}
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <string>
+
+#include "rpc/http_request.h"
+
+namespace rpc {
+
+static bool
+http_iequals(std::string_view lhs, std::string_view rhs) {
+  return lhs.size() == rhs.size() &&
+         std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b) {
+           return std::tolower(a) == std::tolower(b);
+         });
+}
+
+static std::string_view
+http_trim(std::string_view str) {
+  const auto first = str.find_first_not_of(" \t");
+
+  if (first == std::string_view::npos)
+    return std::string_view();
+
+  return str.substr(first, str.find_last_not_of(" \t") - first + 1);
+}
+
+int
+http_parse_header(std::string_view received, HttpRequest* request) {
+  const auto headerEnd = received.find("\r\n\r\n");
+
+  if (headerEnd == std::string_view::npos)
+    return received.size() < HttpRequest::max_header_size ? 0 : 413;
+
+  if (headerEnd + 4 > HttpRequest::max_header_size)
+    return 413;
+
+  const std::string_view header = received.substr(0, headerEnd);
+
+  auto       lineEnd     = header.find("\r\n");
+  const auto requestLine = header.substr(0, lineEnd);
+  const auto version     = requestLine.substr(requestLine.rfind(' ') + 1);
+
+  if (requestLine.substr(0, 5) != "POST ")
+    return 400;
+
+  if (version == "HTTP/1.1")
+    request->keep_alive = true;
+  else if (version == "HTTP/1.0")
+    request->keep_alive = false;
+  else
+    return 400;
+
+  int contentSize = -1;
+
+  request->json            = false;
+  request->expect_continue = false;
+
+  while (lineEnd != std::string_view::npos) {
+    const auto lineStart = lineEnd + 2;
+
+    lineEnd = header.find("\r\n", lineStart);
+
+    const auto line  = header.substr(lineStart,
+                                    lineEnd == std::string_view::npos
+                                       ? std::string_view::npos
+                                       : lineEnd - lineStart);
+    const auto colon = line.find(':');
+
+    if (colon == std::string_view::npos)
+      return 400;
+
+    const auto name  = http_trim(line.substr(0, colon));
+    const auto value = http_trim(line.substr(colon + 1));
+
+    std::string lowerValue(value);
+    std::transform(lowerValue.begin(),
+                   lowerValue.end(),
+                   lowerValue.begin(),
+                   [](char c) { return std::tolower(c); });
+
+    if (http_iequals(name, "Content-Length")) {
+      const auto result =
+        std::from_chars(value.data(), value.data() + value.size(), contentSize);
+
+      if (result.ec == std::errc::result_out_of_range)
+        return 413;
+
+      if (result.ec != std::errc() || result.ptr != value.data() + value.size())
+        return 400;
+
+    } else if (http_iequals(name, "Content-Type")) {
+      if (lowerValue.find("application/json") != std::string::npos)
+        request->json = true;
+      else if (lowerValue.find("text/xml") != std::string::npos)
+        request->json = false;
+      else
+        return 415;
+
+    } else if (http_iequals(name, "Connection")) {
+      if (lowerValue.find("close") != std::string::npos)
+        request->keep_alive = false;
+      else if (lowerValue.find("keep-alive") != std::string::npos)
+        request->keep_alive = true;
+
+    } else if (http_iequals(name, "Transfer-Encoding")) {
+      // Chunked request bodies are not supported, ask for a length
+      // instead.
+      return 411;
+
+    } else if (http_iequals(name, "Expect")) {
+      request->expect_continue = lowerValue == "100-continue";
+    }
+  }
+
+  if (contentSize < 0)
+    return 411;
+
+  if (contentSize == 0)
+    return 400;
+
+  if ((unsigned int)contentSize >
+      HttpRequest::max_request_size - (headerEnd + 4))
+    return 413;
+
+  request->header_size    = headerEnd + 4;
+  request->content_length = contentSize;
+  return 200;
+}
+
+std::string_view
+http_error_response(int status) {
+  switch (status) {
+    case 411:
+      return "HTTP/1.1 411 Length Required\r\n"
+             "Content-Length: 0\r\nConnection: close\r\n\r\n";
+    case 413:
+      return "HTTP/1.1 413 Payload Too Large\r\n"
+             "Content-Length: 0\r\nConnection: close\r\n\r\n";
+    case 415:
+      return "HTTP/1.1 415 Unsupported Media Type\r\n"
+             "Content-Length: 0\r\nConnection: close\r\n\r\n";
+    case 400:
+    default:
+      return "HTTP/1.1 400 Bad Request\r\n"
+             "Content-Length: 0\r\nConnection: close\r\n\r\n";
+  }
+}
+
+}
@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <charconv>
+#include <cstdint>
+
+#include "rpc/json_codec.h"
+
+namespace rpc {
+
+// Returns the number of bytes of the UTF-8 sequence at 'first' that
+// are valid, setting 'complete' if they form a whole character. An
+// invalid sequence is replaced as a unit up to its first bad byte.
+static size_t
+json_utf8_prefix(const unsigned char* first,
+                 const unsigned char* last,
+                 bool*                complete) {
+  size_t        length;
+  unsigned char min = 0x80;
+  unsigned char max = 0xbf;
+
+  if (*first >= 0xc2 && *first <= 0xdf) {
+    length = 2;
+  } else if (*first >= 0xe0 && *first <= 0xef) {
+    length = 3;
+    min    = *first == 0xe0 ? 0xa0 : 0x80;
+    max    = *first == 0xed ? 0x9f : 0xbf;
+  } else if (*first >= 0xf0 && *first <= 0xf4) {
+    length = 4;
+    min    = *first == 0xf0 ? 0x90 : 0x80;
+    max    = *first == 0xf4 ? 0x8f : 0xbf;
+  } else {
+    *complete = false;
+    return 1;
+  }
+
+  size_t valid = 1;
+
+  while (valid != length && first + valid != last &&
+         first[valid] >= min && first[valid] <= max) {
+    valid++;
+    min = 0x80;
+    max = 0xbf;
+  }
+
+  *complete = valid == length;
+  return valid;
+}
+
+void
+json_write_string(std::string* output, const std::string& str) {
+  static const char hex[] = "0123456789abcdef";
+
+  const auto* itr  = reinterpret_cast<const unsigned char*>(str.data());
+  const auto* last = itr + str.size();
+  const auto* run  = itr;
+
+  output->push_back('"');
+
+  while (itr != last) {
+    if (*itr >= 0x80) {
+      bool   complete;
+      size_t length = json_utf8_prefix(itr, last, &complete);
+
+      if (!complete) {
+        output->append(reinterpret_cast<const char*>(run), itr - run);
+        output->append("\xef\xbf\xbd");
+        run = itr + length;
+      }
+
+      itr += length;
+      continue;
+    }
+
+    if (*itr >= 0x20 && *itr != '"' && *itr != '\\') {
+      itr++;
+      continue;
+    }
+
+    output->append(reinterpret_cast<const char*>(run), itr - run);
+
+    switch (*itr) {
+      case '"':
+        output->append("\\\"");
+        break;
+      case '\\':
+        output->append("\\\\");
+        break;
+      case '\b':
+        output->append("\\b");
+        break;
+      case '\f':
+        output->append("\\f");
+        break;
+      case '\n':
+        output->append("\\n");
+        break;
+      case '\r':
+        output->append("\\r");
+        break;
+      case '\t':
+        output->append("\\t");
+        break;
+      default:
+        output->append("\\u00");
+        output->push_back(hex[*itr >> 4]);
+        output->push_back(hex[*itr & 0xf]);
+        break;
+    }
+
+    run = ++itr;
+  }
+
+  output->append(reinterpret_cast<const char*>(run), last - run);
+  output->push_back('"');
+}
+
+static void
+json_write_value(std::string* output, int64_t value) {
+  char buffer[24];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+
+  output->append(buffer, result.ptr);
+}
+
+void
+json_write_object(std::string* output, const torrent::Object& object) {
+  switch (object.type()) {
+    case torrent::Object::TYPE_VALUE:
+      json_write_value(output, object.as_value());
+      break;
+
+    case torrent::Object::TYPE_STRING:
+      json_write_string(output, object.as_string());
+      break;
+
+    case torrent::Object::TYPE_LIST: {
+      bool first = true;
+
+      output->push_back('[');
+
+      for (const auto& item : object.as_list()) {
+        if (!first)
+          output->push_back(',');
+
+        json_write_object(output, item);
+        first = false;
+      }
+
+      output->push_back(']');
+      break;
+    }
+
+    case torrent::Object::TYPE_MAP: {
+      bool first = true;
+
+      output->push_back('{');
+
+      for (const auto& member : object.as_map()) {
+        if (!first)
+          output->push_back(',');
+
+        json_write_string(output, member.first);
+        output->push_back(':');
+        json_write_object(output, member.second);
+        first = false;
+      }
+
+      output->push_back('}');
+      break;
+    }
+
+    case torrent::Object::TYPE_DICT_KEY:
+      output->push_back('[');
+      json_write_string(output, object.as_dict_key());
+
+      if (object.as_dict_obj().is_list()) {
+        for (const auto& item : object.as_dict_obj().as_list()) {
+          output->push_back(',');
+          json_write_object(output, item);
+        }
+      } else {
+        output->push_back(',');
+        json_write_object(output, object.as_dict_obj());
+      }
+
+      output->push_back(']');
+      break;
+
+    default:
+      output->push_back('0');
+      break;
+  }
+}
+
+}
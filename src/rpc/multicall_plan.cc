@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <torrent/exceptions.h>
+
+#include "rpc/parse_commands.h"
+
+#include "rpc/multicall_plan.h"
+
+namespace rpc {
+
+MulticallPlan::MulticallPlan(torrent::Object::list_const_iterator first,
+                             torrent::Object::list_const_iterator last) {
+  m_commands.reserve(std::distance(first, last));
+
+  for (; first != last; ++first) {
+    const std::string& command = first->as_string();
+
+    char            key[128];
+    torrent::Object args;
+    const char*     position = command.c_str();
+
+    if (!parse_line(key, args, position, command.c_str() + command.size())) {
+      m_commands.emplace_back(rpc::commands.end(), torrent::Object());
+      continue;
+    }
+
+    CommandMap::iterator itr = rpc::commands.find(key);
+
+    if (itr == rpc::commands.end())
+      throw torrent::input_error("Command \"" + std::string(key) +
+                                 "\" does not exist.");
+
+    m_commands.emplace_back(itr, std::move(args));
+  }
+}
+
+void
+MulticallPlan::call(target_type target, torrent::Object::list_type& row) const {
+  row.reserve(row.size() + m_commands.size());
+
+  for (const auto& [itr, args] : m_commands) {
+    if (itr == rpc::commands.end())
+      row.emplace_back();
+    else
+      row.push_back(parse_command_(target, itr, args));
+  }
+}
+
+}
@@ -103,7 +103,7 @@ parse_command_name(const char* first,
   return first;
 }
 
-inline bool
+bool
 parse_line(char             key[],
            torrent::Object& args,
            const char*&     first,
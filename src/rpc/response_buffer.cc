@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <sys/uio.h>
+
+#include <torrent/exceptions.h>
+
+#include "rpc/response_buffer.h"
+
+namespace rpc {
+
+void
+ResponseBuffer::push_back(std::string&& segment) {
+  if (segment.empty())
+    return;
+
+  m_size += segment.size();
+  m_segments.push_back(std::move(segment));
+}
+
+void
+ResponseBuffer::push_back(const char* data, size_t length) {
+  if (length == 0)
+    return;
+
+  m_size += length;
+  m_segments.emplace_back(data, length);
+}
+
+void
+ResponseBuffer::push_front(std::string&& segment) {
+  if (segment.empty())
+    return;
+
+  if (m_offset != 0)
+    throw torrent::internal_error(
+      "ResponseBuffer::push_front(...) called on a partially consumed buffer.");
+
+  m_size += segment.size();
+  m_segments.push_front(std::move(segment));
+}
+
+void
+ResponseBuffer::clear() {
+  m_segments.clear();
+  m_offset = 0;
+  m_size   = 0;
+}
+
+int
+ResponseBuffer::fill_iovec(struct iovec* iov, int count) const {
+  int    used   = 0;
+  size_t offset = m_offset;
+
+  for (auto itr = m_segments.begin(), last = m_segments.end();
+       itr != last && used != count;
+       itr++, used++) {
+    iov[used].iov_base = const_cast<char*>(itr->data()) + offset;
+    iov[used].iov_len  = itr->size() - offset;
+
+    offset = 0;
+  }
+
+  return used;
+}
+
+void
+ResponseBuffer::consume(size_t bytes) {
+  if (bytes > m_size)
+    throw torrent::internal_error(
+      "ResponseBuffer::consume(...) called with too many bytes.");
+
+  m_size -= bytes;
+
+  while (bytes != 0) {
+    size_t remaining = m_segments.front().size() - m_offset;
+
+    if (bytes < remaining) {
+      m_offset += bytes;
+      return;
+    }
+
+    bytes -= remaining;
+    m_offset = 0;
+    m_segments.pop_front();
+  }
+}
+
+}
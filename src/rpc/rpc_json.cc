@@ -5,15 +5,10 @@
 
 #ifdef HAVE_JSON
 
-#include <algorithm>
 #include <cstddef>
 #include <cstdint>
-#include <iterator>
 #include <string>
 #include <string_view>
-#include <vector>
-
-#include <nlohmann/json.hpp>
 
 #include <torrent/common.h>
 #include <torrent/hash_string.h>
@@ -21,19 +16,27 @@
 
 #include "rpc/command.h"
 #include "rpc/command_map.h"
+#include "rpc/json_codec.h"
 #include "rpc/parse_commands.h"
 #include "thread_base.h"
 #include "utils/jsonrpc/common.h"
 
 using jsonrpccxx::JsonRpcException;
-using nlohmann::json;
 
 namespace rpc {
 
+// Target reference as decoded from the request. It is only resolved
+// to a download, file, tracker or peer once the global lock is held.
+struct json_target {
+  std::string hash;
+  char        type{ 'd' };
+  std::string index;
+};
+
 void
 string_to_target(const std::string_view& targetString,
                  bool                    requireIndex,
-                 rpc::target_type*       target) {
+                 json_target*            target) {
   // target_any: ''
   // target_download: <hash>
   // target_file: <hash>:f<index>
@@ -41,6 +44,7 @@ string_to_target(const std::string_view& targetString,
   // target_tracker: <hash>:t<index>
 
   if (targetString.size() == 0 && !requireIndex) {
+    target->hash.clear();
     return;
   }
 
@@ -49,51 +53,58 @@ string_to_target(const std::string_view& targetString,
     throw torrent::input_error("invalid parameters: invalid target");
   }
 
-  std::string_view hash;
-  char             type = 'd';
-  std::string_view index;
-
   const auto& delimPos = targetString.find_first_of(':', 40);
   if (delimPos == std::string_view::npos ||
       delimPos + 2 >= targetString.size()) {
     if (requireIndex) {
       throw torrent::input_error("invalid parameters: no index");
     }
-    hash = targetString;
+    target->hash  = targetString;
+    target->type  = 'd';
+    target->index.clear();
   } else {
-    hash  = targetString.substr(0, delimPos);
-    type  = targetString[delimPos + 1];
-    index = targetString.substr(delimPos + 2);
+    target->hash  = targetString.substr(0, delimPos);
+    target->type  = targetString[delimPos + 1];
+    target->index = targetString.substr(delimPos + 2);
+  }
+}
+
+// Global lock must be held.
+rpc::target_type
+resolve_target(const json_target& targetRef) {
+  if (targetRef.hash.empty()) {
+    return rpc::make_target();
   }
 
   // many internal functions expect C-style NULL-terminated strings
 
-  core::Download* download =
-    rpc.slot_find_download()(std::string(hash).c_str());
+  core::Download* download = rpc.slot_find_download()(targetRef.hash.c_str());
 
   if (download == nullptr) {
     throw torrent::input_error("invalid parameters: info-hash not found");
   }
 
+  rpc::target_type target;
+
   try {
-    switch (type) {
+    switch (targetRef.type) {
       case 'd':
-        *target = rpc::make_target(download);
+        target = rpc::make_target(download);
         break;
       case 'f':
-        *target = rpc::make_target(
+        target = rpc::make_target(
           command_base::target_file,
-          rpc.slot_find_file()(download, std::stoi(std::string(index))));
+          rpc.slot_find_file()(download, std::stoi(targetRef.index)));
         break;
       case 't':
-        *target = rpc::make_target(
+        target = rpc::make_target(
           command_base::target_tracker,
-          rpc.slot_find_tracker()(download, std::stoi(std::string(index))));
+          rpc.slot_find_tracker()(download, std::stoi(targetRef.index)));
         break;
       case 'p':
-        *target = rpc::make_target(
+        target = rpc::make_target(
           command_base::target_peer,
-          rpc.slot_find_peer()(download, std::string(index).c_str()));
+          rpc.slot_find_peer()(download, targetRef.index.c_str()));
         break;
       default:
         throw torrent::input_error(
@@ -103,38 +114,42 @@ string_to_target(const std::string_view& targetString,
     throw torrent::input_error("invalid parameters: invalid index");
   }
 
-  if (target == nullptr || std::get<1>(*target) == nullptr) {
+  if (std::get<1>(target) == nullptr) {
     throw torrent::input_error(
       "invalid parameters: unable to find requested target");
   }
+
+  return target;
 }
 
+// Converts the parameters as read by JsonRpcReader, moving strings out
+// of 'value' rather than copying them.
 torrent::Object
-json_to_object(const json& value, int callType, rpc::target_type* target) {
+params_to_object(torrent::Object& value, int callType, json_target* target) {
   switch (value.type()) {
-    case json::value_t::number_integer:
-      return torrent::Object(value.get<int64_t>());
-    case json::value_t::boolean:
-      return value.get<bool>() ? torrent::Object(int64_t(1))
-                               : torrent::Object(int64_t(0));
-    case json::value_t::string:
-      return torrent::Object(value.get<std::string>());
-    case json::value_t::array: {
-      const auto& count = value.size();
-
-      uint8_t start = 0;
+    case torrent::Object::TYPE_VALUE:
+    case torrent::Object::TYPE_STRING: {
+      torrent::Object result;
+      result.swap(value);
+      return result;
+    }
+    case torrent::Object::TYPE_LIST: {
+      auto&       list  = value.as_list();
+      const auto& count = list.size();
+
+      size_t start = 0;
 
       if (callType != command_base::target_generic) {
         if (count < 1) {
           throw torrent::input_error("invalid parameters: too few");
         }
 
-        if (!value[0].is_string()) {
+        if (!list[0].is_string()) {
           throw torrent::input_error(
             "invalid parameters: target must be a string");
         }
 
-        string_to_target(value[0].get<std::string_view>(),
+        string_to_target(list[0].as_string(),
                          callType != command_base::target_any,
                          target);
 
@@ -145,14 +160,16 @@ json_to_object(const json& value, int callType, rpc::target_type* target) {
       if (count == 0) {
         return torrent::Object();
       } else if (start == count - 1) {
-        return json_to_object(value[start], callType, target);
+        return params_to_object(list[start], callType, target);
       } else {
         torrent::Object             result  = torrent::Object::create_list();
         torrent::Object::list_type& listRef = result.as_list();
 
+        listRef.reserve(count - start);
+
         auto current = start;
         while (current != count) {
-          listRef.push_back(json_to_object(value[current], callType, target));
+          listRef.push_back(params_to_object(list[current], callType, target));
           ++current;
         }
 
@@ -164,73 +181,20 @@ json_to_object(const json& value, int callType, rpc::target_type* target) {
   }
 }
 
-json
-object_to_json(const torrent::Object& object) noexcept {
-  switch (object.type()) {
-    case torrent::Object::TYPE_VALUE:
-      return object.as_value();
-    case torrent::Object::TYPE_STRING:
-      return object.as_string();
-    case torrent::Object::TYPE_LIST: {
-      json result = json::array();
-      std::transform(
-        object.as_list().cbegin(),
-        object.as_list().cend(),
-        std::back_inserter(result),
-        [](const torrent::Object& element) { return object_to_json(element); });
-      return result;
-    }
-    case torrent::Object::TYPE_MAP: {
-      json result = json::object();
-
-      for (const auto& [k, v] : object.as_map()) {
-        result.emplace(k, object_to_json(v));
-      }
-
-      return result;
-    }
-    case torrent::Object::TYPE_DICT_KEY: {
-      json result = json::array();
-
-      result.push_back(object_to_json(object.as_dict_key()));
-
-      const auto& dict_obj = object.as_dict_obj();
-      if (dict_obj.is_list()) {
-        std::transform(dict_obj.as_list().cbegin(),
-                       dict_obj.as_list().cend(),
-                       std::back_inserter(result),
-                       [](const torrent::Object& element) {
-                         return object_to_json(element);
-                       });
-      } else {
-        result.push_back(object_to_json(dict_obj));
-      }
-
-      return result;
-    }
-    default:
-      return 0;
-  }
-}
-
-json
-jsonrpc_call_command(const std::string& method, const json& params) {
-  if (params.type() != json::value_t::array) {
-    if (params.type() == json::value_t::object) {
-      throw JsonRpcException(
-        -32602, "invalid parameter: procedure doesn't support named parameter");
-    } else {
-      throw JsonRpcException(
-        -32600, "invalid request: params field must be an array, object");
-    }
-  }
-
+// Global lock must be held.
+static jsonrpccxx::JsonRpcServer::JsonRpcResult
+jsonrpc_execute(const std::string& method, torrent::Object& params) {
   if (std::string_view("system.listMethods") == method) {
-    json methods = json::array();
+    torrent::Object             names   = torrent::Object::create_list();
+    torrent::Object::list_type& listRef = names.as_list();
+
     for (const auto& [k, v] : commands) {
-      methods.push_back(k);
+      listRef.emplace_back(std::string(k));
     }
-    return methods;
+
+    return [names = std::move(names)](std::string* output) {
+      json_write_object(output, names);
+    };
   }
 
   CommandMap::iterator itr = commands.find(method.c_str());
@@ -239,41 +203,64 @@ jsonrpc_call_command(const std::string& method, const json& params) {
     throw JsonRpcException(-32601, "method not found: " + method);
   }
 
-  try {
-    torrent::Object  object;
-    rpc::target_type target = rpc::make_target();
-
-    torrent::thread_base::acquire_global_lock();
-    torrent::main_thread()->interrupt();
+  torrent::Object object;
+  json_target     target;
 
+  try {
     if (itr->second.m_flags & CommandMap::flag_no_target) {
-      json_to_object(params, command_base::target_generic, &target)
+      params_to_object(params, command_base::target_generic, &target)
         .swap(object);
     } else if (itr->second.m_flags & CommandMap::flag_file_target) {
-      json_to_object(params, command_base::target_file, &target).swap(object);
+      params_to_object(params, command_base::target_file, &target).swap(object);
     } else if (itr->second.m_flags & CommandMap::flag_tracker_target) {
-      json_to_object(params, command_base::target_tracker, &target)
+      params_to_object(params, command_base::target_tracker, &target)
         .swap(object);
     } else {
-      json_to_object(params, command_base::target_any, &target).swap(object);
+      params_to_object(params, command_base::target_any, &target).swap(object);
     }
+  } catch (torrent::input_error& e) {
+    throw JsonRpcException(-32602, e.what());
+  }
 
-    const auto& result = rpc::commands.call_command(itr, object, target);
+  try {
+    torrent::Object result =
+      rpc::commands.call_command(itr, object, resolve_target(target));
 
-    torrent::thread_base::release_global_lock();
-    return object_to_json(result);
+    return [result = std::move(result)](std::string* output) {
+      json_write_object(output, result);
+    };
   } catch (torrent::input_error& e) {
-    torrent::thread_base::release_global_lock();
     throw JsonRpcException(-32602, e.what());
   } catch (torrent::local_error& e) {
-    torrent::thread_base::release_global_lock();
     throw JsonRpcException(-32000, e.what());
   }
 }
 
+// The parameters have already been read into torrent::Object by the
+// time the handler is called. The method is only looked up once the
+// global lock is held, as earlier calls of a batch may add or erase
+// commands, and the command map may not be read while the main thread
+// modifies it. Rearranging the parameters for the command's target
+// only moves them around.
+jsonrpccxx::JsonRpcServer::JsonRpcCall
+jsonrpc_call_command(const std::string& method, torrent::Object& params) {
+  torrent::Object args;
+  args.swap(params);
+
+  return [method, args = std::move(args)]() mutable {
+    return jsonrpc_execute(method, args);
+  };
+}
+
 void
 RpcJson::initialize() {
-  m_jsonrpc = new jsonrpccxx::JsonRpc2Server(&jsonrpc_call_command);
+  m_jsonrpc = new jsonrpccxx::JsonRpc2Server(
+    &jsonrpc_call_command,
+    []() {
+      torrent::thread_base::acquire_global_lock();
+      torrent::main_thread()->interrupt();
+    },
+    []() { torrent::thread_base::release_global_lock(); });
 }
 
 void
@@ -288,11 +275,15 @@ RpcJson::is_valid() const {
 
 bool
 RpcJson::process(const char* inBuffer, uint32_t length, res_callback callback, bool trusted) {
-  (void) trusted; // TODO check to not handle untrusted request
-  const std::string& response =
-    m_jsonrpc->HandleRequest(std::string_view(inBuffer, length));
+  // Untrusted calls are refused by CommandMap::call_command.
+  (void)trusted;
+  ResponseBuffer buffer;
+
+  m_jsonrpc->HandleRequest(
+    std::string_view(inBuffer, length),
+    [&buffer](std::string&& piece) { buffer.push_back(std::move(piece)); });
 
-  return callback(response.c_str(), response.size());
+  return callback(std::move(buffer));
 }
 
 }
@@ -23,62 +23,6 @@ RpcManager::~RpcManager() {
   delete static_cast<RpcJson*>(m_rpcProcessors[RPCType::JSON]);
 }
 
-// fix security hole for untrusted commands
-static std::vector<std::string> untrusted_commands =
-{
-	"execute",
-	"execute.capture",
-	"execute.capture_nothrow",
-	"execute.nothrow",
-	"execute.nothrow.bg",
-	"execute.raw",
-	"execute.raw.bg",
-	"execute.raw_nothrow",
-	"execute.raw_nothrow.bg",
-	"execute.throw",
-	"execute.throw.bg",
-	"execute2",
-	"method.insert",
-	"method.redirect",
-	"method.set",
-	"method.set_key",
-	"schedule",
-	"schedule2",
-	"import",
-	"try_import",
-	"log.open_file",
-	"log.add_output",
-	"log.execute",
-	"log.vmmap.dump",
-	"log.xmlrpc",
-	"log.libtorrent",
-	"file.append",
-// old commands
-	"execute_capture",
-	"execute_capture_nothrow",
-	"execute_nothrow",
-	"execute_nothrow_bg",
-	"execute_raw",
-	"execute_raw_bg",
-	"execute_raw_nothrow",
-	"execute_raw_nothrow_bg",
-	"execute_throw",
-	"execute_throw_bg",
-	"system.method.insert",
-	"system.method.redirect",
-	"system.method.set",
-	"system.method.set_key",
-	"on_insert",
-	"on_erase",
-	"on_open",
-	"on_close",
-	"on_start",
-	"on_stop",
-	"on_hash_queued",
-	"on_hash_removed",
-	"on_hash_done",
-	"on_finished"
-};
 thread_local bool RpcManager::trustedXmlConnection = true;
 
 bool 
@@ -89,47 +33,51 @@ RpcManager::set_trusted_connection( bool enabled )
 	return(ret);
 }
 
-bool 
-RpcManager::is_command_enabled( const char* const methodName )
-{
-	return( trustedXmlConnection ||
-		(std::find(untrusted_commands.begin(), untrusted_commands.end(), methodName) == untrusted_commands.end()) );
-}
-
 bool
 RpcManager::dispatch(RPCType            type,
                      const char*        inBuffer,
                      uint32_t           length,
                      IRpc::res_callback callback,
                      bool               trusted) {
+  bool result;
+
   trustedXmlConnection = trusted;
+
   switch (type) {
     case RPCType::XML: {
       if (m_rpcProcessors[RPCType::XML]->is_valid()) {
-        return m_rpcProcessors[RPCType::XML]->process(
+        result = m_rpcProcessors[RPCType::XML]->process(
           inBuffer, length, callback, trusted);
       } else {
         const char* response =
           "<?xml version=\"1.0\"?><methodResponse><fault><value><string>XMLRPC "
           "not supported</string></value></fault></methodResponse>";
-        return callback(response, strlen(response));
+        ResponseBuffer buffer;
+        buffer.push_back(response, strlen(response));
+        result = callback(std::move(buffer));
       }
+      break;
     }
     case RPCType::JSON: {
       if (m_rpcProcessors[RPCType::JSON]->is_valid()) {
-        return m_rpcProcessors[RPCType::JSON]->process(
+        result = m_rpcProcessors[RPCType::JSON]->process(
           inBuffer, length, callback, trusted);
       } else {
         const char* response =
           "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32601,\"message\":\"JSON-"
           "RPC not supported\"},\"id\":\"1\"}";
-        return callback(response, strlen(response));
+        ResponseBuffer buffer;
+        buffer.push_back(response, strlen(response));
+        result = callback(std::move(buffer));
       }
+      break;
     }
     default:
       throw torrent::internal_error("Invalid RPC type.");
   }
+
   trustedXmlConnection = true;
+  return result;
 }
 
 void
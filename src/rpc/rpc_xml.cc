@@ -5,244 +5,186 @@
 
 #ifdef HAVE_XMLRPC_C
 
-#include <functional>
-
-#include <cctype>
-#include <limits>
-
-#include <stdlib.h>
-#include <xmlrpc-c/server.h>
-#ifndef XMLRPC_HAVE_I8
-static_assert(false, "XMLRPC is too old");
-#endif
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "rpc/rpc_xml.h"
 
 #include <torrent/exceptions.h>
+#include <torrent/hash_string.h>
 #include <torrent/object.h>
-#include <torrent/utils/string_manip.h>
+#include <torrent/torrent.h>
 
 #include "rpc/parse_commands.h"
+#include "rpc/xmlrpc_codec.h"
+#include "thread_base.h"
 
 #include "rpc/command.h"
 
 namespace rpc {
 
-class xmlrpc_error : public torrent::base_error {
-public:
-  xmlrpc_error(xmlrpc_env* env)
-    : m_type(env->fault_code)
-    , m_msg(env->fault_string) {}
-  xmlrpc_error(int type, const char* msg)
-    : m_type(type)
-    , m_msg(msg) {}
-  ~xmlrpc_error() override = default;
-
-  virtual int type() const noexcept {
-    return m_type;
-  }
-  const char* what() const noexcept override {
-    return m_msg;
-  }
-
-private:
-  int         m_type;
-  const char* m_msg;
+// Methods xmlrpc-c used to provide along with the registered commands.
+static const char* const xmlrpc_system_methods[] = {
+  "system.listMethods",
+  "system.methodExist",
+  "system.methodHelp",
+  "system.methodSignature",
+  "system.multicall",
 };
 
-torrent::Object
-xmlrpc_to_object(xmlrpc_env*       env,
-                 xmlrpc_value*     value,
-                 int               callType = 0,
-                 rpc::target_type* target   = nullptr);
-
-inline torrent::Object
-xmlrpc_list_entry_to_object(xmlrpc_env* env, xmlrpc_value* src, int index) {
-  xmlrpc_value* tmp;
+static bool
+xmlrpc_is_system_method(const std::string& method) {
+  for (const char* name : xmlrpc_system_methods)
+    if (method == name)
+      return true;
 
-  // reference may be incremented
-  xmlrpc_array_read_item(env, src, index, &tmp);
+  return false;
+}
 
-  if (env->fault_occurred) {
-    // when fault_occurred, reference is not incremented
-    throw xmlrpc_error(env);
-  }
+static torrent::Object
+xmlrpc_to_object(const torrent::Object& value);
 
-  torrent::Object obj = xmlrpc_to_object(env, tmp);
-  xmlrpc_DECREF(tmp);
+// Converts the array entries from 'current' on, a single entry is
+// passed as is and an empty array as void.
+static torrent::Object
+xmlrpc_list_to_object(const torrent::Object::list_type& list, size_t current) {
+  if (current + 1 < list.size()) {
+    torrent::Object             result  = torrent::Object::create_list();
+    torrent::Object::list_type& listRef = result.as_list();
 
-  return obj;
-}
+    while (current != list.size())
+      listRef.push_back(xmlrpc_to_object(list[current++]));
 
-int64_t
-xmlrpc_list_entry_to_value(xmlrpc_env* env, xmlrpc_value* src, int index) {
-  xmlrpc_value* tmp;
+    return result;
 
-  // reference may be incremented
-  xmlrpc_array_read_item(env, src, index, &tmp);
+  } else if (current + 1 == list.size()) {
+    return xmlrpc_to_object(list[current]);
 
-  if (env->fault_occurred) {
-    // when fault_occurred, reference is not incremented
-    throw xmlrpc_error(env);
+  } else {
+    return torrent::Object();
   }
+}
 
-  switch (xmlrpc_value_type(tmp)) {
-    case XMLRPC_TYPE_INT:
-      int v;
-      xmlrpc_read_int(env, tmp, &v);
-      xmlrpc_DECREF(tmp);
-      return v;
-
-    case XMLRPC_TYPE_I8:
-      xmlrpc_int64 v2;
-      xmlrpc_read_i8(env, tmp, &v2);
-      xmlrpc_DECREF(tmp);
-      return v2;
-
-    case XMLRPC_TYPE_STRING: {
-      const char* str;
+static torrent::Object
+xmlrpc_to_object(const torrent::Object& value) {
+  switch (value.type()) {
+    case torrent::Object::TYPE_VALUE:
+    case torrent::Object::TYPE_STRING:
+      return value;
 
-      // memory may be allocated
-      xmlrpc_read_string(env, tmp, &str);
+    case torrent::Object::TYPE_LIST:
+      return xmlrpc_list_to_object(value.as_list(), 0);
 
-      if (env->fault_occurred) {
-        // when fault_occurred, memory is not allocated
-        xmlrpc_DECREF(tmp);
-        throw xmlrpc_error(env);
-      }
+    default:
+      throw xmlrpc_error(xmlrpc_type_error, "Unsupported type found.");
+  }
+}
 
-      const char* end = str;
-      int64_t     v3  = ::strtoll(str, (char**)&end, 0);
+static int64_t
+xmlrpc_to_index(const torrent::Object& value) {
+  switch (value.type()) {
+    case torrent::Object::TYPE_VALUE:
+      return value.as_value();
 
-      if (*str == '\0' || *end != '\0') {
-        ::free((void*)str);
-        xmlrpc_DECREF(tmp);
-        throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Invalid index.");
-      }
+    case torrent::Object::TYPE_STRING: {
+      const char* str = value.as_string().c_str();
+      char*       end;
+      int64_t     index = ::strtoll(str, &end, 0);
 
-      ::free((void*)str);
-      xmlrpc_DECREF(tmp);
+      if (*str == '\0' || *end != '\0')
+        throw xmlrpc_error(xmlrpc_type_error, "Invalid index.");
 
-      return v3;
+      return index;
     }
 
     default:
-      xmlrpc_DECREF(tmp);
-      throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Invalid type found.");
+      throw xmlrpc_error(xmlrpc_type_error, "Invalid type found.");
   }
 }
 
-// Consider making a helper function that creates a target_type from a
-// torrent::Object, then we can just use xmlrpc_to_object.
-rpc::target_type
-xmlrpc_to_target(xmlrpc_env* env, xmlrpc_value* value) {
+static rpc::target_type
+xmlrpc_to_target(const torrent::Object& value) {
+  if (!value.is_string())
+    return rpc::make_target();
+
+  const char*  str    = value.as_string().c_str();
+  const size_t length = value.as_string().size();
+
+  if (length == 0) {
+    // When specifying void, we require a zero-length string.
+    return rpc::make_target();
+
+  } else if (length < 40) {
+    throw xmlrpc_error(xmlrpc_type_error, "Unsupported target type found.");
+  }
+
+  core::Download* download = rpc.slot_find_download()(str);
+
+  if (download == nullptr)
+    throw xmlrpc_error(xmlrpc_type_error, "Could not find info-hash.");
+
+  if (length == 40)
+    return rpc::make_target(download);
+
+  if (length < 42 || str[40] != ':')
+    throw xmlrpc_error(xmlrpc_type_error, "Unsupported target type found.");
+
+  // Files:    "<hash>:f<index>"
+  // Trackers: "<hash>:t<index>"
+  // Peers:    "<hash>:p<hash>"
+
   rpc::target_type target;
+  char*            end_ptr;
+
+  switch (str[41]) {
+    case 'f':
+      target = rpc::make_target(
+        command_base::target_file,
+        rpc.slot_find_file()(download, ::strtol(str + 42, &end_ptr, 0)));
+
+      if (*end_ptr != '\0')
+        throw xmlrpc_error(xmlrpc_type_error, "Invalid index.");
+
+      break;
+
+    case 't':
+      target = rpc::make_target(
+        command_base::target_tracker,
+        rpc.slot_find_tracker()(download, ::strtol(str + 42, &end_ptr, 0)));
 
-  switch (xmlrpc_value_type(value)) {
-    case XMLRPC_TYPE_STRING: {
-      const char* str;
-
-      // memory may be allocated
-      xmlrpc_read_string(env, value, &str);
-
-      if (env->fault_occurred) {
-        // when fault_occurred, memory is not allocated
-        throw xmlrpc_error(env);
-      }
-
-      if (std::strlen(str) == 0) {
-        // When specifying void, we require a zero-length string.
-        ::free((void*)str);
-        return rpc::make_target();
-
-      } else if (std::strlen(str) < 40) {
-        ::free((void*)str);
-        throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Unsupported target type found.");
-      }
-
-      core::Download* download = rpc.slot_find_download()(str);
-
-      if (download == nullptr) {
-        ::free((void*)str);
-        throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Could not find info-hash.");
-      }
-
-      if (std::strlen(str) == 40) {
-        ::free((void*)str);
-        return rpc::make_target(download);
-      }
-
-      if (std::strlen(str) < 42 || str[40] != ':') {
-        ::free((void*)str);
-        throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Unsupported target type found.");
-      }
-
-      // Files:    "<hash>:f<index>"
-      // Trackers: "<hash>:t<index>"
-
-      int         index;
-      const char* end_ptr = str + 42;
-
-      switch (str[41]) {
-        case 'f':
-          index = ::strtol(str + 42, (char**)&end_ptr, 0);
-
-          if (*str == '\0' || *end_ptr != '\0') {
-            ::free((void*)str);
-            throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Invalid index.");
-          }
-
-          target = rpc::make_target(command_base::target_file,
-                                    rpc.slot_find_file()(download, index));
-          break;
-
-        case 't':
-          index = ::strtol(str + 42, (char**)&end_ptr, 0);
-
-          if (*str == '\0' || *end_ptr != '\0') {
-            ::free((void*)str);
-            throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Invalid index.");
-          }
-
-          target = rpc::make_target(command_base::target_tracker,
-                                    rpc.slot_find_tracker()(download, index));
-          break;
-
-        case 'p': {
-          torrent::HashString hash;
-          const char*         hash_end =
-            torrent::hash_string_from_hex_c_str(str + 42, hash);
-
-          if (hash_end == end_ptr || *hash_end != '\0') {
-            ::free((void*)str);
-            throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Not a hash string.");
-          }
-
-          target = rpc::make_target(command_base::target_peer,
-                                    rpc.slot_find_peer()(download, hash));
-          break;
-        }
-        default:
-          ::free((void*)str);
-          throw xmlrpc_error(XMLRPC_TYPE_ERROR,
-                             "Unsupported target type found.");
-      }
-
-      ::free((void*)str);
-
-      // Check if the target pointer is NULL.
-      if (std::get<1>(target) == nullptr)
-        throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Invalid index.");
-
-      return target;
+      if (*end_ptr != '\0')
+        throw xmlrpc_error(xmlrpc_type_error, "Invalid index.");
+
+      break;
+
+    case 'p': {
+      torrent::HashString hash;
+      const char*         hash_end =
+        torrent::hash_string_from_hex_c_str(str + 42, hash);
+
+      if (hash_end == str + 42 || *hash_end != '\0')
+        throw xmlrpc_error(xmlrpc_type_error, "Not a hash string.");
+
+      target = rpc::make_target(command_base::target_peer,
+                                rpc.slot_find_peer()(download, hash));
+      break;
     }
 
     default:
-      return rpc::make_target();
+      throw xmlrpc_error(xmlrpc_type_error, "Unsupported target type found.");
   }
+
+  // Check if the target pointer is NULL.
+  if (std::get<1>(target) == nullptr)
+    throw xmlrpc_error(xmlrpc_type_error, "Invalid index.");
+
+  return target;
 }
 
-rpc::target_type
+static rpc::target_type
 xmlrpc_to_index_type(int index, int callType, core::Download* download) {
   void* result;
 
@@ -259,373 +201,404 @@ xmlrpc_to_index_type(int index, int callType, core::Download* download) {
   }
 
   if (result == nullptr)
-    throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Invalid index.");
+    throw xmlrpc_error(xmlrpc_type_error, "Invalid index.");
 
   return rpc::make_target(callType, result);
 }
 
-torrent::Object
-xmlrpc_to_object(xmlrpc_env*       env,
-                 xmlrpc_value*     value,
-                 int               callType,
-                 rpc::target_type* target) {
-  switch (xmlrpc_value_type(value)) {
-    case XMLRPC_TYPE_INT:
-      int v;
-      xmlrpc_read_int(env, value, &v);
+// Resolves the target from the call parameters. Unless the command
+// takes no target, the first parameter is the target, and file and
+// tracker commands called on a download take the index from the next
+// parameter to support old-style calls.
+//
+// Global lock must be held.
+static rpc::target_type
+xmlrpc_params_to_target(const torrent::Object::list_type& params,
+                        int                               callType) {
+  if (callType == command_base::target_generic || params.empty())
+    return rpc::make_target();
+
+  rpc::target_type target = xmlrpc_to_target(params[0]);
+
+  if (std::get<0>(target) == command_base::target_download &&
+      (callType == command_base::target_file ||
+       callType == command_base::target_tracker)) {
+    if (params.size() == 1)
+      throw xmlrpc_error(xmlrpc_type_error,
+                         "Too few arguments, missing index.");
+
+    target = xmlrpc_to_index_type(xmlrpc_to_index(params[1]),
+                                  callType,
+                                  (core::Download*)std::get<1>(target));
+  }
 
-      return torrent::Object((int64_t)v);
+  return target;
+}
 
-    case XMLRPC_TYPE_I8:
-      xmlrpc_int64 v2;
-      xmlrpc_read_i8(env, value, &v2);
+// Number of parameters taken by the target, as consumed by
+// 'xmlrpc_params_to_target', found without looking up the download.
+static size_t
+xmlrpc_target_params(const torrent::Object::list_type& params, int callType) {
+  if (callType == command_base::target_generic || params.empty())
+    return 0;
+
+  // Only a bare info-hash is a download target.
+  if ((callType == command_base::target_file ||
+       callType == command_base::target_tracker) &&
+      params[0].is_string() && params[0].as_string().size() == 40 &&
+      params.size() > 1)
+    return 2;
+
+  return 1;
+}
 
-      return torrent::Object((int64_t)v2);
+// A call decoded ahead of taking the global lock. The method is only
+// looked up with the lock held, as commands may be inserted or erased
+// in between, along with the target and the command itself.
+struct xmlrpc_prepared {
+  struct argument_type {
+    torrent::Object value;
+    bool            failed{ false };
+    int             errorType{ 0 };
+    std::string     errorString;
+  };
+
+  const std::string*                method{ nullptr };
+  const torrent::Object::list_type* params{ nullptr };
+
+  // The parameters are converted one by one, as which of them are
+  // arguments depends on the target the command takes. Conversion
+  // errors are only raised once the target has been resolved, as
+  // before.
+  std::vector<argument_type> args;
+
+  // Errors from decoding the call itself.
+  bool        failed{ false };
+  int         errorType{ 0 };
+  std::string errorString;
+
+  void set_error(const xmlrpc_error& e) {
+    failed      = true;
+    errorType   = e.type();
+    errorString = e.what();
+  }
+};
 
-      //     case XMLRPC_TYPE_BOOL:
-      //     case XMLRPC_TYPE_DOUBLE:
-      //     case XMLRPC_TYPE_DATETIME:
+static void
+xmlrpc_prepare(const std::string&                method,
+               const torrent::Object::list_type& params,
+               xmlrpc_prepared*                  call) {
+  call->method = &method;
+  call->params = &params;
 
-    case XMLRPC_TYPE_STRING:
+  // System methods are run with the parameters of the request.
+  if (xmlrpc_is_system_method(method))
+    return;
+
+  call->args.resize(params.size());
 
-      if (callType != command_base::target_generic) {
-        // When the call type is not supposed to be void, we'll try to
-        // convert it to a command target. It's not that important that
-        // it is converted to the right type here, as an mismatch will
-        // be caught when executing the command.
-        *target = xmlrpc_to_target(env, value);
-        return torrent::Object();
+  for (size_t i = 0; i < params.size(); i++) {
+    try {
+      xmlrpc_to_object(params[i]).swap(call->args[i].value);
+    } catch (xmlrpc_error& e) {
+      call->args[i].failed      = true;
+      call->args[i].errorType   = e.type();
+      call->args[i].errorString = e.what();
+    }
+  }
+}
 
-      } else {
-        const char* valueString;
+// The arguments following the target, with a single one passed as is
+// and none as void.
+static torrent::Object
+xmlrpc_prepared_to_object(xmlrpc_prepared& call, size_t current) {
+  for (size_t i = current; i < call.args.size(); i++)
+    if (call.args[i].failed)
+      throw xmlrpc_error(call.args[i].errorType, call.args[i].errorString);
 
-        // memory may be allocated
-        xmlrpc_read_string(env, value, &valueString);
+  torrent::Object result;
 
-        if (env->fault_occurred) {
-          // when fault_occurred, memory is not allocated
-          throw xmlrpc_error(env);
-        }
+  if (current + 1 < call.args.size()) {
+    result = torrent::Object::create_list();
 
-        torrent::Object result = torrent::Object(std::string(valueString));
+    for (; current != call.args.size(); current++) {
+      result.as_list().push_back(torrent::Object());
+      result.as_list().back().swap(call.args[current].value);
+    }
 
-        // Urgh, seriously?
-        // yes, std::string() above already copied it
-        ::free((void*)valueString);
+  } else if (current + 1 == call.args.size()) {
+    result.swap(call.args[current].value);
+  }
 
-        return result;
-      }
+  return result;
+}
 
-    case XMLRPC_TYPE_BASE64: {
-      size_t      valueSize;
-      const char* valueString;
+// Expands a registration signature such as "i:s,s:" into arrays of
+// XML-RPC type names, return type first.
+static torrent::Object
+xmlrpc_signature(const char* parm) {
+  if (parm == nullptr || *parm == '\0')
+    return std::string("undef");
+
+  torrent::Object result = torrent::Object::create_list();
+  torrent::Object signature = torrent::Object::create_list();
+
+  for (const char* itr = parm;; itr++) {
+    const char* type = nullptr;
+
+    switch (*itr) {
+      case 'i':
+        type = "int";
+        break;
+      case 'I':
+        type = "i8";
+        break;
+      case 'b':
+        type = "boolean";
+        break;
+      case 'd':
+        type = "double";
+        break;
+      case 's':
+        type = "string";
+        break;
+      case '6':
+        type = "base64";
+        break;
+      case '8':
+        type = "dateTime.iso8601";
+        break;
+      case 'A':
+        type = "array";
+        break;
+      case 'S':
+        type = "struct";
+        break;
+      case 'n':
+        type = "nil";
+        break;
+      case ',':
+      case '\0':
+        result.as_list().push_back(signature);
+        signature = torrent::Object::create_list();
+        break;
+      default:
+        break;
+    }
 
-      // memory may be allocated
-      xmlrpc_read_base64(
-        env, value, &valueSize, (const unsigned char**)&valueString);
+    if (type != nullptr)
+      signature.as_list().push_back(std::string(type));
 
-      if (env->fault_occurred) {
-        // when fault_occurred, memory is not allocated
-        throw xmlrpc_error(env);
-      }
+    if (*itr == '\0')
+      return result;
+  }
+}
 
-      torrent::Object result =
-        torrent::Object(std::string(valueString, valueSize));
+static torrent::Object
+xmlrpc_call_system(const std::string& method,
+                   const torrent::Object::list_type& params) {
+  if (method == "system.listMethods") {
+    torrent::Object             result  = torrent::Object::create_list();
+    torrent::Object::list_type& listRef = result.as_list();
 
-      ::free((void*)valueString);
+    for (const auto& command : commands)
+      if (command.second.m_flags & CommandMap::flag_public)
+        listRef.push_back(std::string(command.first));
 
-      return result;
-    }
+    for (const char* name : xmlrpc_system_methods)
+      listRef.push_back(std::string(name));
 
-    case XMLRPC_TYPE_ARRAY: {
-      unsigned int current = 0;
-      unsigned int last    = xmlrpc_array_size(env, value);
+    return result;
+  }
 
-      if (env->fault_occurred)
-        throw xmlrpc_error(env);
+  if (params.empty() || !params.front().is_string())
+    throw xmlrpc_error(xmlrpc_type_error, "Expected a method name.");
 
-      if (callType != command_base::target_generic && last != 0) {
-        if (last < 1)
-          throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Too few arguments.");
+  const std::string&   name = params.front().as_string();
+  CommandMap::iterator itr  = commands.find(name.c_str());
+  bool                 found =
+    itr != commands.end() && (itr->second.m_flags & CommandMap::flag_public);
 
-        xmlrpc_value* tmp;
+  if (method == "system.methodExist")
+    return (int64_t)(found || xmlrpc_is_system_method(name));
 
-        // reference may be incremented
-        xmlrpc_array_read_item(env, value, current++, &tmp);
+  if (!found)
+    throw xmlrpc_error(xmlrpc_no_such_method_error,
+                       "Method '" + name + "' does not exist");
 
-        if (env->fault_occurred) {
-          // when fault_occurred, reference is not incremented
-          throw xmlrpc_error(env);
-        }
+  if (method == "system.methodHelp")
+    return std::string(itr->second.m_doc != nullptr ? itr->second.m_doc : "");
 
-        *target = xmlrpc_to_target(env, tmp);
-        xmlrpc_DECREF(tmp);
+  return xmlrpc_signature(itr->second.m_parm);
+}
 
-        if (env->fault_occurred)
-          throw xmlrpc_error(env);
+// Global lock must be held.
+static torrent::Object
+xmlrpc_execute(xmlrpc_prepared& call) {
+  if (call.failed)
+    throw xmlrpc_error(call.errorType, call.errorString);
 
-        if (std::get<0>(*target) == command_base::target_download &&
-            (callType == command_base::target_file ||
-             callType == command_base::target_tracker)) {
-          // If we have a download target and the call type requires
-          // another contained type, then we try to use the next
-          // parameter as the index to support old-style calls.
+  const std::string& method = *call.method;
 
-          if (current == last)
-            throw xmlrpc_error(XMLRPC_TYPE_ERROR,
-                               "Too few arguments, missing index.");
+  if (xmlrpc_is_system_method(method))
+    return xmlrpc_call_system(method, *call.params);
 
-          *target = xmlrpc_to_index_type(
-            xmlrpc_list_entry_to_value(env, value, current++),
-            callType,
-            (core::Download*)std::get<1>(*target));
-        }
-      }
+  CommandMap::iterator itr = commands.find(method.c_str());
 
-      if (current + 1 < last) {
-        torrent::Object             result  = torrent::Object::create_list();
-        torrent::Object::list_type& listRef = result.as_list();
+  // Only public commands were ever registered with xmlrpc-c.
+  if (itr == commands.end() || !(itr->second.m_flags & CommandMap::flag_public))
+    throw xmlrpc_error(xmlrpc_no_such_method_error,
+                       "Method '" + method + "' not defined");
 
-        while (current != last)
-          listRef.push_back(xmlrpc_list_entry_to_object(env, value, current++));
+  int callType = command_base::target_any;
 
-        return result;
+  if (itr->second.m_flags & CommandMap::flag_no_target)
+    callType = command_base::target_generic;
+  else if (itr->second.m_flags & CommandMap::flag_file_target)
+    callType = command_base::target_file;
+  else if (itr->second.m_flags & CommandMap::flag_tracker_target)
+    callType = command_base::target_tracker;
 
-      } else if (current + 1 == last) {
-        return xmlrpc_list_entry_to_object(env, value, current);
+  try {
+    rpc::target_type target = xmlrpc_params_to_target(*call.params, callType);
+    torrent::Object  object = xmlrpc_prepared_to_object(
+      call, xmlrpc_target_params(*call.params, callType));
 
-      } else {
-        return torrent::Object();
-      }
-    }
+    return rpc::commands.call_command(itr, object, target);
 
-    //     case XMLRPC_TYPE_STRUCT:
-    //     case XMLRPC_TYPE_C_PTR:
-    //     case XMLRPC_TYPE_NIL:
-    //     case XMLRPC_TYPE_DEAD:
-    default:
-      throw xmlrpc_error(XMLRPC_TYPE_ERROR, "Unsupported type found.");
+  } catch (torrent::local_error& e) {
+    throw xmlrpc_error(xmlrpc_parse_error, e.what());
   }
 }
 
-xmlrpc_value*
-object_to_xmlrpc(xmlrpc_env* env, const torrent::Object& object) {
-  switch (object.type()) {
-    case torrent::Object::TYPE_VALUE:
-      return xmlrpc_i8_new(env, object.as_value());
+static torrent::Object
+xmlrpc_fault_object(const xmlrpc_error& e) {
+  torrent::Object fault = torrent::Object::create_map();
 
-    case torrent::Object::TYPE_STRING: {
-      // The versions that support I8 do implicit utf-8 validation.
-      xmlrpc_value* result = xmlrpc_string_new(env, object.as_string().c_str());
-
-      if (env->fault_occurred) {
-        xmlrpc_env_clean(env);
-        xmlrpc_env_init(env);
-
-        const std::string& str = object.as_string();
-        char* buffer = static_cast<char*>(calloc(str.size() + 1, sizeof(char)));
-        char* dst    = buffer;
-        for (std::string::const_iterator itr = str.begin(); itr != str.end();
-             ++itr)
-          *dst++ =
-            ((*itr < 0x20 && *itr != '\r' && *itr != '\n' && *itr != '\t') ||
-             (*itr & 0x80))
-              ? '?'
-              : *itr;
-        *dst = 0;
-
-        result = xmlrpc_string_new(env, buffer);
-        free(buffer);
-      }
+  fault.as_map()["faultCode"]   = (int64_t)e.type();
+  fault.as_map()["faultString"] = std::string(e.what());
 
-      return result;
-    }
+  return fault;
+}
 
-    case torrent::Object::TYPE_LIST: {
-      xmlrpc_value* result = xmlrpc_array_new(env);
+// Decodes every call of a 'system.multicall', so that they can all be
+// run under a single acquisition of the global lock.
+static void
+xmlrpc_prepare_multicall(const torrent::Object::list_type& params,
+                         std::vector<xmlrpc_prepared>*     calls) {
+  if (params.size() != 1 || !params.front().is_list())
+    throw xmlrpc_error(xmlrpc_type_error,
+                       "system.multicall expects an array of calls.");
 
-      for (torrent::Object::list_const_iterator itr  = object.as_list().begin(),
-                                                last = object.as_list().end();
-           itr != last;
-           itr++) {
-        xmlrpc_value* item = object_to_xmlrpc(env, *itr);
-        xmlrpc_array_append_item(env, result, item);
-        xmlrpc_DECREF(item);
-      }
+  calls->resize(params.front().as_list().size());
+  auto prepared = calls->begin();
 
-      return result;
-    }
+  for (const auto& call : params.front().as_list()) {
+    try {
+      if (!call.is_map())
+        throw xmlrpc_error(xmlrpc_type_error, "Call is not a struct.");
 
-    case torrent::Object::TYPE_MAP: {
-      xmlrpc_value* result = xmlrpc_struct_new(env);
+      const auto& members = call.as_map();
+      const auto  name    = members.find("methodName");
+      const auto  args    = members.find("params");
 
-      for (torrent::Object::map_const_iterator itr  = object.as_map().begin(),
-                                               last = object.as_map().end();
-           itr != last;
-           itr++) {
-        xmlrpc_value* item = object_to_xmlrpc(env, itr->second);
-        xmlrpc_struct_set_value(env, result, itr->first.c_str(), item);
-        xmlrpc_DECREF(item);
-      }
+      if (name == members.end() || !name->second.is_string())
+        throw xmlrpc_error(xmlrpc_type_error, "Missing methodName.");
 
-      return result;
-    }
+      if (args == members.end() || !args->second.is_list())
+        throw xmlrpc_error(xmlrpc_type_error, "Missing params.");
 
-    case torrent::Object::TYPE_DICT_KEY: {
-      xmlrpc_value* result = xmlrpc_array_new(env);
-
-      xmlrpc_value* key_item = object_to_xmlrpc(env, object.as_dict_key());
-      xmlrpc_array_append_item(env, result, key_item);
-      xmlrpc_DECREF(key_item);
-
-      if (object.as_dict_obj().is_list()) {
-        for (torrent::Object::list_const_iterator
-               itr  = object.as_dict_obj().as_list().begin(),
-               last = object.as_dict_obj().as_list().end();
-             itr != last;
-             itr++) {
-          xmlrpc_value* item = object_to_xmlrpc(env, *itr);
-          xmlrpc_array_append_item(env, result, item);
-          xmlrpc_DECREF(item);
-        }
-      } else {
-        xmlrpc_value* arg_item = object_to_xmlrpc(env, object.as_dict_obj());
-        xmlrpc_array_append_item(env, result, arg_item);
-        xmlrpc_DECREF(arg_item);
-      }
+      if (name->second.as_string() == "system.multicall")
+        throw xmlrpc_error(xmlrpc_request_refused_error,
+                           "Recursive system.multicall forbidden");
 
-      return result;
+      xmlrpc_prepare(
+        name->second.as_string(), args->second.as_list(), &*prepared);
+
+    } catch (xmlrpc_error& e) {
+      prepared->set_error(e);
     }
 
-    default:
-      return xmlrpc_int_new(env, 0);
+    ++prepared;
   }
 }
 
-xmlrpc_value*
-xmlrpc_call_command(xmlrpc_env* env, xmlrpc_value* args, void* voidServerInfo) {
-  CommandMap::iterator itr = commands.find((const char*)voidServerInfo);
-
-  if (itr == commands.end()) {
-    xmlrpc_env_set_fault(env,
-                         XMLRPC_PARSE_ERROR,
-                         ("Command \"" +
-                          std::string((const char*)voidServerInfo) +
-                          "\" does not exist.")
-                           .c_str());
-    return nullptr;
-  }
+// Each call yields either an array holding its result, or a fault
+// struct, as with xmlrpc-c.
+//
+// Global lock must be held.
+static torrent::Object
+xmlrpc_execute_multicall(std::vector<xmlrpc_prepared>& calls) {
+  torrent::Object             result  = torrent::Object::create_list();
+  torrent::Object::list_type& listRef = result.as_list();
 
-  try {
-    torrent::Object  object;
-    rpc::target_type target = rpc::make_target();
-
-    if (itr->second.m_flags & CommandMap::flag_no_target)
-      xmlrpc_to_object(env, args, command_base::target_generic, &target)
-        .swap(object);
-    else if (itr->second.m_flags & CommandMap::flag_file_target)
-      xmlrpc_to_object(env, args, command_base::target_file, &target)
-        .swap(object);
-    else if (itr->second.m_flags & CommandMap::flag_tracker_target)
-      xmlrpc_to_object(env, args, command_base::target_tracker, &target)
-        .swap(object);
-    else
-      xmlrpc_to_object(env, args, command_base::target_any, &target)
-        .swap(object);
+  listRef.reserve(calls.size());
 
-    if (env->fault_occurred)
-      return nullptr;
+  for (auto& call : calls) {
+    try {
+      torrent::Object value = xmlrpc_execute(call);
 
-    return object_to_xmlrpc(env,
-                            rpc::commands.call_command(itr, object, target));
+      listRef.push_back(torrent::Object::create_list());
+      listRef.back().as_list().push_back(torrent::Object());
+      listRef.back().as_list().back().swap(value);
 
-  } catch (xmlrpc_error& e) {
-    xmlrpc_env_set_fault(env, e.type(), e.what());
-    return nullptr;
-
-  } catch (torrent::local_error& e) {
-    xmlrpc_env_set_fault(env, XMLRPC_PARSE_ERROR, e.what());
-    return nullptr;
+    } catch (xmlrpc_error& e) {
+      listRef.push_back(xmlrpc_fault_object(e));
+    }
   }
-}
-
-void
-RpcXml::initialize() {
-  m_env = new xmlrpc_env;
-
-  xmlrpc_env_init((xmlrpc_env*)m_env);
-  m_registry = xmlrpc_registry_new((xmlrpc_env*)m_env);
-
-  xmlrpc_limit_set(XMLRPC_XML_SIZE_LIMIT_ID,
-                   std::numeric_limits<size_t>::max());
-  xmlrpc_registry_set_dialect(
-    (xmlrpc_env*)m_env, (xmlrpc_registry*)m_registry, xmlrpc_dialect_i8);
-}
-
-void
-RpcXml::cleanup() {
-  if (!is_valid())
-    return;
-
-  xmlrpc_registry_free((xmlrpc_registry*)m_registry);
-  xmlrpc_env_clean((xmlrpc_env*)m_env);
-
-  delete (xmlrpc_env*)m_env;
-}
 
-void xmlrpc_check_command(xmlrpc_env* const envP,
-	const char* const methodName,
-	xmlrpc_value* const paramArrayP,
-	void* const userData)
-{
-	if( !rpc.is_command_enabled( methodName ) )
-	{
-		xmlrpc_faultf(envP, "Command '%s' is not enabled for untrusted connections", methodName);
-	}
-  // Fix warning unused
-  (void) paramArrayP;
-  (void) userData;
+  return result;
 }
 
 bool
 RpcXml::process(const char* inBuffer, uint32_t length, res_callback callback, bool trusted) {
-  xmlrpc_env localEnv;
-  xmlrpc_env_init(&localEnv);
+  // Untrusted calls are refused by CommandMap::call_command.
+  (void)trusted;
 
-  xmlrpc_registry_set_preinvoke_method(&localEnv, (xmlrpc_registry*)m_registry,
-    (xmlrpc_preinvoke_method) (trusted ? nullptr : &xmlrpc_check_command), nullptr);
-  xmlrpc_mem_block* memblock = xmlrpc_registry_process_call(
-    &localEnv, (xmlrpc_registry*)m_registry, nullptr, inBuffer, length);
+  std::string                method;
+  torrent::Object::list_type params;
+  torrent::Object            result;
+  std::string                output;
 
-  if (localEnv.fault_occurred && localEnv.fault_code == XMLRPC_INTERNAL_ERROR)
-    throw torrent::internal_error("Internal error in XMLRPC.");
+  try {
+    xmlrpc_parse_call(inBuffer, inBuffer + length, &method, &params);
 
-  bool result = callback((const char*)xmlrpc_mem_block_contents(memblock),
-                         xmlrpc_mem_block_size(memblock));
+    // Calls are decoded before taking the global lock, and all the
+    // calls of a multicall share a single acquisition.
+    xmlrpc_prepared              call;
+    std::vector<xmlrpc_prepared> calls;
 
-  xmlrpc_mem_block_free(memblock);
-  xmlrpc_env_clean(&localEnv);
-  return result;
-}
+    if (method == "system.multicall")
+      xmlrpc_prepare_multicall(params, &calls);
+    else
+      xmlrpc_prepare(method, params, &call);
+
+    torrent::thread_base::acquire_global_lock();
+    torrent::main_thread()->interrupt();
+
+    try {
+      if (method == "system.multicall")
+        xmlrpc_execute_multicall(calls).swap(result);
+      else
+        xmlrpc_execute(call).swap(result);
+    } catch (...) {
+      torrent::thread_base::release_global_lock();
+      throw;
+    }
 
-void
-RpcXml::insert_command(const char* name, const char* parm, const char* doc) {
-  xmlrpc_env localEnv;
-  xmlrpc_env_init(&localEnv);
+    torrent::thread_base::release_global_lock();
 
-  xmlrpc_registry_add_method_w_doc(&localEnv,
-                                   (xmlrpc_registry*)m_registry,
-                                   nullptr,
-                                   name,
-                                   &xmlrpc_call_command,
-                                   const_cast<char*>(name),
-                                   parm,
-                                   doc);
+    xmlrpc_write_response(&output, result);
+
+  } catch (xmlrpc_error& e) {
+    output.clear();
+    xmlrpc_write_fault(&output, e.type(), e.what());
+  }
 
-  if (localEnv.fault_occurred)
-    throw torrent::internal_error("Fault occured while inserting xmlrpc call.");
+  ResponseBuffer buffer;
+  buffer.push_back(std::move(output));
 
-  xmlrpc_env_clean(&localEnv);
+  return callback(std::move(buffer));
 }
 
 }
@@ -1,8 +1,13 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <algorithm>
+#include <climits>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/un.h>
+#include <unistd.h>
 
 #include <torrent/connection_manager.h>
 #include <torrent/exceptions.h>
@@ -14,19 +19,44 @@
 #include "control.h"
 #include "globals.h"
 #include "rpc/parse_commands.h"
+#include "thread_worker.h"
 #include "utils/socket_fd.h"
 
 #include "rpc/scgi.h"
 
 namespace rpc {
 
+static thread_local SCgiTask* scgiCurrentTask = nullptr;
+
+SCgiLog::~SCgiLog() {
+  ::close(m_fd);
+}
+
+void
+SCgiLog::write(const struct iovec* iov, int count) const {
+  // Only entries with more segments than a single call takes get
+  // split.
+  while (count > 0) {
+    int size = std::min(count, IOV_MAX);
+
+    if (::writev(m_fd, iov, size) == -1)
+      return;
+
+    iov += size;
+    count -= size;
+  }
+}
+
 SCgi::~SCgi() {
   if (!get_fd().is_valid())
     return;
 
-  for (SCgiTask *itr = m_task, *last = m_task + max_tasks; itr != last; ++itr)
-    if (itr->is_open())
-      itr->close();
+  // Don't let the tasks being closed below re-enable the listener.
+  m_acceptPaused = false;
+
+  for (auto& task : m_tasks)
+    if (task.is_open())
+      task.close();
 
   deactivate();
 
@@ -87,7 +117,7 @@ SCgi::open(void* sa, unsigned int length) {
     if (!get_fd().set_nonblock() || !get_fd().set_reuse_address(true) ||
         !get_fd().bind(*reinterpret_cast<torrent::utils::socket_address*>(sa),
                        length) ||
-        !get_fd().listen(max_tasks))
+        !get_fd().listen(SOMAXCONN))
       throw torrent::resource_error(
         "Could not prepare socket for listening: " +
         torrent::utils::error_number::current().message());
@@ -116,24 +146,106 @@ SCgi::deactivate() {
   worker_thread->poll()->close(this);
 }
 
+void
+SCgi::set_max_tasks(unsigned int size) {
+  if (size == 0)
+    throw torrent::input_error("SCGI connection limit must be positive.");
+
+  // A paused listener picks up a raised limit when the next task is
+  // released, as the poll may only be modified by the listener thread.
+  m_maxTasks = size;
+}
+
+// Task lock must be held.
+SCgiTask*
+SCgi::acquire_task() {
+  if (m_activeTasks >= m_maxTasks)
+    return nullptr;
+
+  SCgiTask* task;
+
+  if (!m_freeTasks.empty()) {
+    task = m_freeTasks.back();
+    m_freeTasks.pop_back();
+  } else {
+    task = &m_tasks.emplace_back();
+  }
+
+  m_activeTasks++;
+  return task;
+}
+
+void
+SCgi::release_task(SCgiTask* task, bool rejected) {
+  if (rejected)
+    m_rejected++;
+
+  std::lock_guard<std::mutex> guard(m_taskLock);
+
+  m_freeTasks.push_back(task);
+  m_activeTasks--;
+
+  if (!m_acceptPaused || m_activeTasks >= m_maxTasks)
+    return;
+
+  if (task->thread() == worker_thread) {
+    m_acceptPaused = false;
+    worker_thread->poll()->insert_read(this);
+
+  } else if (!m_resumeQueued) {
+    m_resumeQueued = true;
+    worker_thread->queue_item(&ThreadWorker::msg_resume_accept);
+  }
+}
+
+void
+SCgi::resume_accept() {
+  std::lock_guard<std::mutex> guard(m_taskLock);
+
+  m_resumeQueued = false;
+
+  if (m_acceptPaused && m_activeTasks < m_maxTasks) {
+    m_acceptPaused = false;
+    worker_thread->poll()->insert_read(this);
+  }
+}
+
 void
 SCgi::event_read() {
   torrent::utils::socket_address sa;
   utils::SocketFd                fd;
 
-  while ((fd = get_fd().accept(&sa)).is_valid()) {
-    SCgiTask* task =
-      std::find_if(m_task, m_task + max_tasks, [](SCgiTask& task) {
-        return task.is_available();
-      });
+  while (true) {
+    SCgiTask* task;
+
+    {
+      std::lock_guard<std::mutex> guard(m_taskLock);
 
-    if (task == m_task + max_tasks) {
-      // Ergh... just closing for now.
-      fd.close();
-      continue;
+      if (m_activeTasks >= m_maxTasks) {
+        // Leave new connections in the listen backlog until a task is
+        // released, rather than accepting and dropping them.
+        worker_thread->poll()->remove_read(this);
+        m_acceptPaused = true;
+        m_acceptPausedCount++;
+        return;
+      }
+
+      if (!(fd = get_fd().accept(&sa)).is_valid())
+        return;
+
+      task = acquire_task();
     }
 
-    task->open(this, fd.get_fd());
+    m_accepted++;
+
+    // Connections are opened on the thread that serves them, as only
+    // it may modify its poll.
+    ThreadWorker* thread = worker_thread->next_thread();
+
+    if (thread == worker_thread)
+      task->open(this, thread, fd.get_fd());
+    else
+      thread->queue_connection(this, task, fd.get_fd());
   }
 }
 
@@ -150,10 +262,12 @@ SCgi::event_error() {
 bool
 SCgi::receive_call(SCgiTask* task, const char* buffer, uint32_t length, bool trusted) {
   bool       result   = false;
-  const auto callback = [task](const char* buffer, uint32_t length) {
-    return task->receive_write(buffer, length);
+  const auto callback = [task](ResponseBuffer&& response) {
+    return task->receive_write(std::move(response));
   };
 
+  scgiCurrentTask = task;
+
   switch (task->type()) {
     case SCgiTask::ContentType::JSON:
       result =
@@ -161,13 +275,17 @@ SCgi::receive_call(SCgiTask* task, const char* buffer, uint32_t length, bool tru
       break;
     case SCgiTask::ContentType::XML:
     default:
-      torrent::thread_base::acquire_global_lock();
-      torrent::main_thread()->interrupt();
-      result = rpc.dispatch(RpcManager::RPCType::XML, buffer, length, callback, trusted);
-      torrent::thread_base::release_global_lock();
+      result =
+        rpc.dispatch(RpcManager::RPCType::XML, buffer, length, callback, trusted);
   }
 
+  scgiCurrentTask = nullptr;
   return result;
 }
 
+SCgiTask*
+SCgi::current_task() {
+  return scgiCurrentTask;
+}
+
 }
@@ -1,20 +1,26 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 // Copyright (C) 2005-2011, Jari Sundell <jaris@ifi.uio.no>
 
+#include <algorithm>
 #include <cstdio>
 #include <string_view>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
 #include <torrent/exceptions.h>
 #include <torrent/poll.h>
 #include <torrent/utils/allocators.h>
 #include <torrent/utils/error_number.h>
 #include <torrent/utils/log.h>
+#include <torrent/utils/timer.h>
 
 #include "control.h"
 #include "globals.h"
+#include "thread_worker.h"
 #include "utils/socket_fd.h"
 
+#include "rpc/http_request.h"
 #include "rpc/scgi.h"
 
 // Test:
@@ -40,37 +46,55 @@ SCgiTask::realloc_buffer(uint32_t    size,
 }
 
 void
-SCgiTask::open(SCgi* parent, int fd) {
+SCgiTask::open(SCgi* parent, ThreadWorker* thread, int fd) {
   m_parent   = parent;
+  m_thread   = thread;
   m_fileDesc = fd;
   m_buffer   = torrent::utils::cacheline_allocator<char>::alloc_size(
     (m_bufferSize = default_buffer_size) + 1);
-  m_position = m_buffer;
-  m_body     = nullptr;
+  m_position  = m_buffer;
+  m_body      = nullptr;
+  m_keepAlive = false;
+  m_streaming = false;
+
+  m_thread->poll()->open(this);
+  m_thread->poll()->insert_read(this);
+  m_thread->poll()->insert_error(this);
 
-  worker_thread->poll()->open(this);
-  worker_thread->poll()->insert_read(this);
-  worker_thread->poll()->insert_error(this);
+  reset_timeout();
 
   //   scgiTimer = torrent::utils::timer::current();
 }
 
 void
-SCgiTask::close() {
+SCgiTask::close(bool rejected) {
   if (!get_fd().is_valid())
     return;
 
-  worker_thread->poll()->remove_read(this);
-  worker_thread->poll()->remove_write(this);
-  worker_thread->poll()->remove_error(this);
-  worker_thread->poll()->close(this);
+  m_thread->poll()->remove_read(this);
+  m_thread->poll()->remove_write(this);
+  m_thread->poll()->remove_error(this);
+  m_thread->poll()->close(this);
+
+  torrent::utils::priority_queue_erase(&m_thread->task_scheduler(),
+                                       &m_taskTimeout);
 
   get_fd().close();
   get_fd().clear();
 
+  if (m_streaming) {
+    m_parent->events().unsubscribe(this);
+    m_streaming = false;
+  }
+
   ::free(m_buffer);
   m_buffer = nullptr;
 
+  m_output.clear();
+  m_pending.clear();
+
+  m_parent->release_task(this, rejected);
+
   // Test
   //   char buffer[512];
   //   sprintf(buffer, "SCgi system call processed: %i",
@@ -91,8 +115,110 @@ char* memstr(char* haystack, char* needle, int size)
 	return(NULL);
 }
 
+void
+SCgiTask::reset_timeout() {
+  torrent::utils::priority_queue_erase(&m_thread->task_scheduler(),
+                                       &m_taskTimeout);
+  torrent::utils::priority_queue_insert(
+    &m_thread->task_scheduler(),
+    &m_taskTimeout,
+    cachedTime + torrent::utils::timer::from_seconds(idle_timeout));
+}
+
+// Prepare for the next request on a persistent connection, starting
+// with any pipelined data that was read along with the last one.
+void
+SCgiTask::restart() {
+  m_thread->poll()->remove_write(this);
+  m_thread->poll()->insert_read(this);
+
+  m_bufferSize =
+    std::max<unsigned int>(default_buffer_size, m_pending.size());
+
+  ::free(m_buffer);
+  m_buffer = torrent::utils::cacheline_allocator<char>::alloc_size(
+    m_bufferSize + 1);
+
+  std::memcpy(m_buffer, m_pending.data(), m_pending.size());
+  m_position  = m_buffer + m_pending.size();
+  *m_position = '\0';
+  m_body      = nullptr;
+  m_keepAlive = false;
+
+  m_pending.clear();
+
+  if (m_position != m_buffer)
+    parse_request();
+}
+
+int
+SCgiTask::parse_http_header() {
+  const std::string_view received(m_buffer,
+                                  std::distance(m_buffer, m_position));
+  HttpRequest            request;
+
+  const int status = http_parse_header(received, &request);
+
+  if (status == 0) {
+    // Browsers may send headers that don't fit the default buffer.
+    if (received.size() >= m_bufferSize) {
+      realloc_buffer(m_bufferSize * 2 + 1, m_buffer, received.size());
+
+      m_bufferSize *= 2;
+      m_position = m_buffer + received.size();
+    }
+
+    return 0;
+  }
+
+  if (status != 200)
+    return status;
+
+  // There is no proxy in front of the listener to vouch for the
+  // client, so HTTP connections are handled as untrusted.
+  m_type      = request.json ? ContentType::JSON : ContentType::XML;
+  m_trusted   = false;
+  m_keepAlive = request.keep_alive;
+
+  const unsigned int requestSize = request.header_size + request.content_length;
+
+  if (requestSize > m_bufferSize) {
+    realloc_buffer(requestSize + 1, m_buffer, received.size());
+    m_position = m_buffer + received.size();
+  }
+
+  m_body       = m_buffer + request.header_size;
+  m_bufferSize = requestSize;
+
+  if (request.expect_continue && received.size() < requestSize) {
+    static constexpr std::string_view continue_response =
+      "HTTP/1.1 100 Continue\r\n\r\n";
+
+    // Clients fall back to sending the body after a timeout, so a
+    // failed send is not fatal.
+    ssize_t __attribute__((unused)) result = ::send(
+      m_fileDesc, continue_response.data(), continue_response.size(), 0);
+  }
+
+  return status;
+}
+
 void
 SCgiTask::event_read() {
+  if (m_streaming) {
+    // Streams are one-way, anything the client sends is discarded
+    // while waiting for it to hang up.
+    char discard[256];
+    int  bytes = ::recv(m_fileDesc, discard, sizeof(discard), 0);
+
+    if (bytes == 0 ||
+        (bytes < 0 &&
+         !torrent::utils::error_number::current().is_blocked_momentary()))
+      close();
+
+    return;
+  }
+
   int bytes =
     ::recv(m_fileDesc, m_position, m_bufferSize - (m_position - m_buffer), 0);
 
@@ -104,11 +230,35 @@ SCgiTask::event_read() {
     return;
   }
 
+  reset_timeout();
+
   // The buffer has space to nul-terminate to ease the parsing below.
   m_position += bytes;
   *m_position = '\0';
 
-  if (m_body == nullptr) {
+  parse_request();
+}
+
+void
+SCgiTask::parse_request() {
+  if (m_body == nullptr && m_parent->protocol() == SCgi::Protocol::HTTP) {
+    const int status = parse_http_header();
+
+    if (status == 0)
+      return;
+
+    if (status != 200) {
+      const auto response = http_error_response(status);
+
+      // The connection is closed regardless of whether the client
+      // gets to see the reason.
+      ssize_t __attribute__((unused)) result =
+        ::send(m_fileDesc, response.data(), response.size(), 0);
+
+      goto event_read_failed;
+    }
+
+  } else if (m_body == nullptr) {
     // Don't bother caching the parsed values, as we're likely to
     // receive all the data we need the first time.
     char* current;
@@ -199,18 +349,23 @@ SCgiTask::event_read() {
     }
   }
 
-  if ((unsigned int)std::distance(m_buffer, m_position) != m_bufferSize)
+  if ((unsigned int)std::distance(m_buffer, m_position) < m_bufferSize)
     return;
 
-  worker_thread->poll()->remove_read(this);
-  worker_thread->poll()->insert_write(this);
+  // Keep pipelined requests until the response has been sent.
+  if ((unsigned int)std::distance(m_buffer, m_position) > m_bufferSize)
+    m_pending.assign(m_buffer + m_bufferSize, m_position);
+
+  m_thread->poll()->remove_read(this);
+  m_thread->poll()->insert_write(this);
+
+  if (auto log = m_parent->log()) {
+    struct iovec entry[] = {
+      { m_buffer, m_bufferSize },
+      { const_cast<char*>(SCgiLog::separator), sizeof(SCgiLog::separator) },
+    };
 
-  if (m_parent->log_fd() >= 0) {
-    ssize_t __attribute__((unused)) result;
-    // Clean up logging, this is just plain ugly...
-    //    write(m_logFd, "\n---\n", sizeof("\n---\n"));
-    result = write(m_parent->log_fd(), m_buffer, m_bufferSize);
-    result = write(m_parent->log_fd(), "\n---\n", sizeof("\n---\n"));
+    log->write(entry, 2);
   }
 
   lt_log_print_dump(torrent::LOG_RPC_DUMP,
@@ -230,12 +385,15 @@ SCgiTask::event_read() {
 event_read_failed:
   //   throw torrent::internal_error("SCgiTask::event_read() fault not
   //   handled.");
-  close();
+  close(true);
 }
 
 void
 SCgiTask::event_write() {
-  int bytes = ::send(m_fileDesc, m_position, m_bufferSize, 0);
+  struct iovec iov[max_iovecs];
+
+  int     count = m_output.fill_iovec(iov, max_iovecs);
+  ssize_t bytes = ::writev(m_fileDesc, iov, count);
 
   if (bytes == -1) {
     if (!torrent::utils::error_number::current().is_blocked_momentary())
@@ -244,11 +402,26 @@ SCgiTask::event_write() {
     return;
   }
 
-  m_position += bytes;
-  m_bufferSize -= bytes;
+  m_output.consume(bytes);
 
-  if (bytes == 0 || m_bufferSize == 0)
+  if (bytes == 0)
     return close();
+
+  if (!m_streaming)
+    reset_timeout();
+
+  if (!m_output.empty())
+    return;
+
+  if (m_streaming) {
+    // Wait for more notifications, watching for the client closing
+    // the connection.
+    m_thread->poll()->remove_write(this);
+    m_thread->poll()->insert_read(this);
+    return;
+  }
+
+  return m_keepAlive ? restart() : close();
 }
 
 void
@@ -257,44 +430,108 @@ SCgiTask::event_error() {
 }
 
 bool
-SCgiTask::receive_write(const char* buffer, uint32_t length) {
-  if (buffer == nullptr || length > (100 << 20))
+SCgiTask::receive_write(ResponseBuffer&& response) {
+  if (response.size() > (100 << 20))
     throw torrent::internal_error(
       "SCgiTask::receive_write(...) received bad input.");
 
-  auto buffer_size = std::max(m_bufferSize, default_buffer_size);
+  // The request has been fully processed, so the read buffer is no
+  // longer needed while the response is being sent.
+  ::free(m_buffer);
+  m_buffer   = nullptr;
+  m_position = nullptr;
+  m_body     = nullptr;
+
+  const auto status = m_parent->protocol() == SCgi::Protocol::HTTP
+                        ? "HTTP/1.1 200 OK"
+                        : "Status: 200 OK";
+  char headerBuffer[256];
+  int  headerSize;
+
+  if (m_streaming) {
+    // The stream lasts until either side closes the connection, so
+    // there's no length to announce.
+    torrent::utils::priority_queue_erase(&m_thread->task_scheduler(),
+                                         &m_taskTimeout);
+
+    m_keepAlive = false;
+    response.push_back("\n", 1);
+
+    headerSize = snprintf(
+      headerBuffer,
+      sizeof(headerBuffer),
+      "%s\r\nContent-Type: application/x-ndjson\r\n%s\r\n",
+      status,
+      m_parent->protocol() == SCgi::Protocol::HTTP ? "Connection: close\r\n"
+                                                   : "");
+  } else {
+    const auto contentType =
+      m_type == ContentType::JSON ? "application/json" : "text/xml";
+    const auto connection =
+      m_parent->protocol() != SCgi::Protocol::HTTP
+        ? ""
+        : (m_keepAlive ? "Connection: keep-alive\r\n"
+                       : "Connection: close\r\n");
+
+    headerSize =
+      snprintf(headerBuffer,
+               sizeof(headerBuffer),
+               "%s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s\r\n",
+               status,
+               contentType,
+               response.size(),
+               connection);
+  }
+
+  m_output = std::move(response);
+  m_output.push_front(std::string(headerBuffer, headerSize));
+
+  for (const auto& segment : m_output)
+    lt_log_print_dump(torrent::LOG_RPC_DUMP,
+                      segment.data(),
+                      segment.size(),
+                      "scgi",
+                      "RPC write.",
+                      0);
+
+  if (auto log = m_parent->log()) {
+    std::vector<struct iovec> entry;
 
-  if (length + 256 > buffer_size) {
-    buffer_size = length + 256;
-    realloc_buffer(buffer_size);
+    for (const auto& segment : m_output)
+      entry.push_back({ const_cast<char*>(segment.data()), segment.size() });
+
+    entry.push_back(
+      { const_cast<char*>(SCgiLog::separator), sizeof(SCgiLog::separator) });
+
+    log->write(entry.data(), entry.size());
   }
 
-  const auto header = m_type == ContentType::JSON
-                        ? "Status: 200 OK\r\nContent-Type: "
-                          "application/json\r\nContent-Length: %i\r\n\r\n"
-                        : "Status: 200 OK\r\nContent-Type: "
-                          "text/xml\r\nContent-Length: %i\r\n\r\n";
+  // Persistent connections wait for the poll, as finishing the write
+  // here could start processing a pipelined request from within this
+  // call.
+  if (!m_keepAlive)
+    event_write();
 
-  // Who ever bothers to check the return value?
-  int headerSize = snprintf(m_buffer, buffer_size, header, length);
+  return true;
+}
 
-  m_position   = m_buffer;
-  m_bufferSize = length + headerSize;
+bool
+SCgiTask::write_stream(std::string&& data) {
+  if (!is_open() || !m_streaming)
+    return true;
 
-  std::memcpy(m_buffer + headerSize, buffer, length);
+  if (m_output.size() + data.size() > EventStream::max_pending_size)
+    return false;
 
-  if (m_parent->log_fd() >= 0) {
-    ssize_t __attribute__((unused)) result;
-    // Clean up logging, this is just plain ugly...
-    //    write(m_logFd, "\n---\n", sizeof("\n---\n"));
-    result = write(m_parent->log_fd(), m_buffer, m_bufferSize);
-    result = write(m_parent->log_fd(), "\n---\n", sizeof("\n---\n"));
+  if (auto log = m_parent->log()) {
+    struct iovec entry = { data.data(), data.size() };
+    log->write(&entry, 1);
   }
 
-  lt_log_print_dump(
-    torrent::LOG_RPC_DUMP, m_buffer, m_bufferSize, "scgi", "RPC write.", 0);
+  m_output.push_back(std::move(data));
 
-  event_write();
+  m_thread->poll()->remove_read(this);
+  m_thread->poll()->insert_write(this);
   return true;
 }
 
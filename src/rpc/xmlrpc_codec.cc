@@ -0,0 +1,717 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+#include "rpc/xmlrpc_codec.h"
+
+namespace rpc {
+
+// Values nested deeper than this are refused, bounding the recursion
+// of the parser.
+static constexpr unsigned int xmlrpc_max_depth = 64;
+
+struct xmlrpc_tag {
+  std::string_view name;
+  bool             closing{ false };
+  bool             empty{ false };
+};
+
+// Minimal pull parser for the subset of XML used by XML-RPC. Elements
+// are read one tag at a time, attributes are skipped, and the XML
+// declaration, comments and doctype are ignored between tags.
+class xmlrpc_reader {
+public:
+  xmlrpc_reader(const char* first, const char* last)
+    : m_pos(first)
+    , m_last(last) {}
+
+  bool at_end();
+
+  void read_tag(xmlrpc_tag* tag);
+  void read_text(std::string* text);
+
+  void expect_open(std::string_view name, bool* empty = nullptr);
+  void expect_close(std::string_view name);
+
+private:
+  [[noreturn]] static void fail(const char* msg) {
+    throw xmlrpc_error(xmlrpc_parse_error, msg);
+  }
+
+  bool starts_with(const char* str) const {
+    size_t length = std::strlen(str);
+    return (size_t)(m_last - m_pos) >= length &&
+           std::memcmp(m_pos, str, length) == 0;
+  }
+
+  void skip_past(const char* str);
+  void skip_misc();
+  void read_entity(std::string* text);
+
+  const char* m_pos;
+  const char* m_last;
+};
+
+static bool
+xmlrpc_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void
+xmlrpc_append_utf8(std::string* text, uint32_t c) {
+  if (c < 0x80) {
+    text->push_back((char)c);
+  } else if (c < 0x800) {
+    text->push_back((char)(0xc0 | (c >> 6)));
+    text->push_back((char)(0x80 | (c & 0x3f)));
+  } else if (c < 0x10000) {
+    text->push_back((char)(0xe0 | (c >> 12)));
+    text->push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+    text->push_back((char)(0x80 | (c & 0x3f)));
+  } else {
+    text->push_back((char)(0xf0 | (c >> 18)));
+    text->push_back((char)(0x80 | ((c >> 12) & 0x3f)));
+    text->push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+    text->push_back((char)(0x80 | (c & 0x3f)));
+  }
+}
+
+void
+xmlrpc_reader::skip_past(const char* str) {
+  const char* found =
+    std::search(m_pos, m_last, str, str + std::strlen(str));
+
+  if (found == m_last)
+    fail("Unterminated markup.");
+
+  m_pos = found + std::strlen(str);
+}
+
+void
+xmlrpc_reader::skip_misc() {
+  while (true) {
+    while (m_pos != m_last && xmlrpc_is_space(*m_pos))
+      m_pos++;
+
+    if (starts_with("<?"))
+      skip_past("?>");
+    else if (starts_with("<!--"))
+      skip_past("-->");
+    else if (starts_with("<!DOCTYPE"))
+      skip_past(">");
+    else
+      return;
+  }
+}
+
+bool
+xmlrpc_reader::at_end() {
+  skip_misc();
+  return m_pos == m_last;
+}
+
+void
+xmlrpc_reader::read_tag(xmlrpc_tag* tag) {
+  skip_misc();
+
+  if (m_pos == m_last || *m_pos != '<')
+    fail("Expected an element.");
+
+  *tag = xmlrpc_tag();
+
+  if (++m_pos != m_last && *m_pos == '/') {
+    tag->closing = true;
+    m_pos++;
+  }
+
+  const char* first = m_pos;
+
+  while (m_pos != m_last && !xmlrpc_is_space(*m_pos) && *m_pos != '/' &&
+         *m_pos != '>')
+    m_pos++;
+
+  if (m_pos == first)
+    fail("Expected an element name.");
+
+  tag->name = std::string_view(first, m_pos - first);
+
+  // Skip attributes, taking care of '>' within quoted values.
+  char quote = '\0';
+
+  for (; m_pos != m_last; m_pos++) {
+    if (quote != '\0') {
+      if (*m_pos == quote)
+        quote = '\0';
+    } else if (*m_pos == '"' || *m_pos == '\'') {
+      quote = *m_pos;
+    } else if (*m_pos == '>') {
+      break;
+    }
+  }
+
+  if (m_pos == m_last)
+    fail("Unterminated element.");
+
+  tag->empty = *(m_pos - 1) == '/';
+  m_pos++;
+
+  if (tag->closing && tag->empty)
+    fail("Malformed closing element.");
+}
+
+void
+xmlrpc_reader::read_entity(std::string* text) {
+  const char* first = ++m_pos;
+  const char* last  = std::find(first, m_last, ';');
+
+  if (last == m_last || last == first)
+    fail("Unterminated entity.");
+
+  std::string_view name(first, last - first);
+  m_pos = last + 1;
+
+  if (name == "lt")
+    text->push_back('<');
+  else if (name == "gt")
+    text->push_back('>');
+  else if (name == "amp")
+    text->push_back('&');
+  else if (name == "quot")
+    text->push_back('"');
+  else if (name == "apos")
+    text->push_back('\'');
+  else if (name[0] == '#' && name.size() > 1) {
+    bool        hex    = name[1] == 'x' || name[1] == 'X';
+    const char* digits = first + (hex ? 2 : 1);
+    char*       end;
+
+    unsigned long c = std::strtoul(digits, &end, hex ? 16 : 10);
+
+    if (end != last || end == digits || c == 0 || c > 0x10ffff ||
+        (c >= 0xd800 && c < 0xe000))
+      fail("Invalid character reference.");
+
+    xmlrpc_append_utf8(text, c);
+  } else {
+    fail("Unknown entity.");
+  }
+}
+
+// Reads character data up to the next element, decoding entities and
+// CDATA sections, and skipping comments.
+void
+xmlrpc_reader::read_text(std::string* text) {
+  while (m_pos != m_last) {
+    const char* first = m_pos;
+
+    while (m_pos != m_last && *m_pos != '<' && *m_pos != '&')
+      m_pos++;
+
+    text->append(first, m_pos);
+
+    if (m_pos == m_last)
+      return;
+
+    if (*m_pos == '&') {
+      read_entity(text);
+
+    } else if (starts_with("<![CDATA[")) {
+      first = m_pos + 9;
+      skip_past("]]>");
+      text->append(first, m_pos - 3);
+
+    } else if (starts_with("<!--")) {
+      skip_past("-->");
+
+    } else {
+      return;
+    }
+  }
+}
+
+void
+xmlrpc_reader::expect_open(std::string_view name, bool* empty) {
+  xmlrpc_tag tag;
+  read_tag(&tag);
+
+  if (tag.closing || tag.name != name)
+    fail("Unexpected element.");
+
+  if (empty != nullptr)
+    *empty = tag.empty;
+  else if (tag.empty)
+    fail("Unexpected empty element.");
+}
+
+void
+xmlrpc_reader::expect_close(std::string_view name) {
+  xmlrpc_tag tag;
+  read_tag(&tag);
+
+  if (!tag.closing || tag.name != name)
+    fail("Unexpected element.");
+}
+
+static void
+xmlrpc_trim(std::string* text) {
+  size_t first = 0;
+  size_t last  = text->size();
+
+  while (first != last && xmlrpc_is_space((*text)[first]))
+    first++;
+
+  while (last != first && xmlrpc_is_space((*text)[last - 1]))
+    last--;
+
+  *text = text->substr(first, last - first);
+}
+
+static int64_t
+xmlrpc_parse_integer(std::string text) {
+  xmlrpc_trim(&text);
+
+  char* end;
+  errno         = 0;
+  int64_t value = ::strtoll(text.c_str(), &end, 10);
+
+  if (text.empty() || *end != '\0' || errno == ERANGE)
+    throw xmlrpc_error(xmlrpc_parse_error, "Invalid integer.");
+
+  return value;
+}
+
+static std::string
+xmlrpc_decode_base64(const std::string& text) {
+  std::string  result;
+  uint32_t     bits  = 0;
+  unsigned int count = 0;
+
+  for (char c : text) {
+    uint32_t value;
+
+    if (c >= 'A' && c <= 'Z')
+      value = c - 'A';
+    else if (c >= 'a' && c <= 'z')
+      value = c - 'a' + 26;
+    else if (c >= '0' && c <= '9')
+      value = c - '0' + 52;
+    else if (c == '+')
+      value = 62;
+    else if (c == '/')
+      value = 63;
+    else if (c == '=' || xmlrpc_is_space(c))
+      continue;
+    else
+      throw xmlrpc_error(xmlrpc_parse_error, "Invalid base64 data.");
+
+    bits = (bits << 6) | value;
+
+    if (++count == 4) {
+      result.push_back((char)(bits >> 16));
+      result.push_back((char)(bits >> 8));
+      result.push_back((char)bits);
+      bits  = 0;
+      count = 0;
+    }
+  }
+
+  if (count == 2) {
+    result.push_back((char)(bits >> 4));
+  } else if (count == 3) {
+    result.push_back((char)(bits >> 10));
+    result.push_back((char)(bits >> 2));
+  } else if (count == 1) {
+    throw xmlrpc_error(xmlrpc_parse_error, "Invalid base64 data.");
+  }
+
+  return result;
+}
+
+static torrent::Object
+xmlrpc_parse_value(xmlrpc_reader* reader, unsigned int depth);
+
+// Reads the content of a typed value, the opening tag having already
+// been read.
+static torrent::Object
+xmlrpc_parse_typed(xmlrpc_reader*    reader,
+                   const xmlrpc_tag& tag,
+                   unsigned int      depth) {
+  std::string text;
+
+  if (!tag.empty)
+    reader->read_text(&text);
+
+  if (tag.name == "string") {
+    if (!tag.empty)
+      reader->expect_close(tag.name);
+
+    return torrent::Object(std::move(text));
+
+  } else if (tag.name == "i4" || tag.name == "int" || tag.name == "i8" ||
+             tag.name == "ex:i8") {
+    if (!tag.empty)
+      reader->expect_close(tag.name);
+
+    return torrent::Object(xmlrpc_parse_integer(std::move(text)));
+
+  } else if (tag.name == "boolean") {
+    if (!tag.empty)
+      reader->expect_close(tag.name);
+
+    xmlrpc_trim(&text);
+
+    if (text != "0" && text != "1")
+      throw xmlrpc_error(xmlrpc_parse_error, "Invalid boolean.");
+
+    return torrent::Object((int64_t)(text == "1"));
+
+  } else if (tag.name == "base64") {
+    if (!tag.empty)
+      reader->expect_close(tag.name);
+
+    return torrent::Object(xmlrpc_decode_base64(text));
+
+  } else if (tag.name == "array") {
+    torrent::Object result = torrent::Object::create_list();
+
+    if (tag.empty)
+      return result;
+
+    bool empty;
+    reader->expect_open("data", &empty);
+
+    while (!empty) {
+      xmlrpc_tag item;
+      reader->read_tag(&item);
+
+      if (item.closing && item.name == "data")
+        break;
+
+      if (item.closing || item.name != "value")
+        throw xmlrpc_error(xmlrpc_parse_error, "Unexpected element.");
+
+      if (item.empty)
+        result.as_list().emplace_back(std::string());
+      else
+        result.as_list().push_back(xmlrpc_parse_value(reader, depth + 1));
+    }
+
+    reader->expect_close("array");
+    return result;
+
+  } else if (tag.name == "struct") {
+    torrent::Object result = torrent::Object::create_map();
+
+    if (tag.empty)
+      return result;
+
+    while (true) {
+      xmlrpc_tag member;
+      reader->read_tag(&member);
+
+      if (member.closing && member.name == "struct")
+        break;
+
+      if (member.closing || member.empty || member.name != "member")
+        throw xmlrpc_error(xmlrpc_parse_error, "Unexpected element.");
+
+      bool        empty;
+      std::string name;
+
+      reader->expect_open("name", &empty);
+
+      if (!empty) {
+        reader->read_text(&name);
+        reader->expect_close("name");
+      }
+
+      reader->expect_open("value", &empty);
+
+      if (empty)
+        result.as_map()[name] = std::string();
+      else
+        result.as_map()[name] = xmlrpc_parse_value(reader, depth + 1);
+
+      reader->expect_close("member");
+    }
+
+    return result;
+
+  } else {
+    // Doubles, dates and nil have no torrent::Object equivalent.
+    throw xmlrpc_error(xmlrpc_type_error, "Unsupported type found.");
+  }
+}
+
+// Reads a value up to and including its closing tag, the opening tag
+// having already been read. Values without a type are strings.
+static torrent::Object
+xmlrpc_parse_value(xmlrpc_reader* reader, unsigned int depth) {
+  if (depth > xmlrpc_max_depth)
+    throw xmlrpc_error(xmlrpc_limit_exceeded_error, "Nested too deeply.");
+
+  std::string text;
+  reader->read_text(&text);
+
+  xmlrpc_tag tag;
+  reader->read_tag(&tag);
+
+  if (tag.closing) {
+    if (tag.name != "value")
+      throw xmlrpc_error(xmlrpc_parse_error, "Unexpected element.");
+
+    return torrent::Object(std::move(text));
+  }
+
+  torrent::Object result = xmlrpc_parse_typed(reader, tag, depth);
+  reader->expect_close("value");
+
+  return result;
+}
+
+void
+xmlrpc_parse_call(const char*                 first,
+                  const char*                 last,
+                  std::string*                method,
+                  torrent::Object::list_type* params) {
+  xmlrpc_reader reader(first, last);
+  xmlrpc_tag    tag;
+  bool          empty;
+
+  reader.expect_open("methodCall");
+  reader.expect_open("methodName", &empty);
+
+  method->clear();
+
+  if (!empty) {
+    reader.read_text(method);
+    reader.expect_close("methodName");
+  }
+
+  xmlrpc_trim(method);
+
+  if (method->empty())
+    throw xmlrpc_error(xmlrpc_parse_error, "Missing method name.");
+
+  reader.read_tag(&tag);
+
+  if (!tag.closing && tag.name == "params") {
+    while (!tag.empty) {
+      reader.read_tag(&tag);
+
+      if (tag.closing && tag.name == "params")
+        break;
+
+      if (tag.closing || tag.empty || tag.name != "param")
+        throw xmlrpc_error(xmlrpc_parse_error, "Unexpected element.");
+
+      reader.expect_open("value", &empty);
+
+      if (empty)
+        params->emplace_back(std::string());
+      else
+        params->push_back(xmlrpc_parse_value(&reader, 0));
+
+      reader.expect_close("param");
+    }
+
+    reader.read_tag(&tag);
+  }
+
+  if (!tag.closing || tag.name != "methodCall")
+    throw xmlrpc_error(xmlrpc_parse_error, "Unexpected element.");
+
+  if (!reader.at_end())
+    throw xmlrpc_error(xmlrpc_parse_error, "Trailing data after methodCall.");
+}
+
+// Length of the UTF-8 sequence starting at 'first', or zero if it is
+// invalid, overlong or encodes a surrogate.
+static size_t
+xmlrpc_utf8_length(const unsigned char* first, const unsigned char* last) {
+  size_t        length;
+  unsigned char min = 0x80;
+  unsigned char max = 0xbf;
+
+  if (*first >= 0xc2 && *first <= 0xdf) {
+    length = 2;
+  } else if (*first >= 0xe0 && *first <= 0xef) {
+    length = 3;
+    min    = *first == 0xe0 ? 0xa0 : 0x80;
+    max    = *first == 0xed ? 0x9f : 0xbf;
+  } else if (*first >= 0xf0 && *first <= 0xf4) {
+    length = 4;
+    min    = *first == 0xf0 ? 0x90 : 0x80;
+    max    = *first == 0xf4 ? 0x8f : 0xbf;
+  } else {
+    return 0;
+  }
+
+  if ((size_t)(last - first) < length || first[1] < min || first[1] > max)
+    return 0;
+
+  for (size_t i = 2; i != length; i++)
+    if (first[i] < 0x80 || first[i] > 0xbf)
+      return 0;
+
+  return length;
+}
+
+static const char*
+xmlrpc_escape(unsigned char c) {
+  switch (c) {
+    case '<':
+      return "&lt;";
+    case '>':
+      return "&gt;";
+    case '&':
+      return "&amp;";
+    case '\r':
+      return "&#x0d;";
+    default:
+      return nullptr;
+  }
+}
+
+static void
+xmlrpc_write_sanitized(std::string*         output,
+                       const unsigned char* first,
+                       const unsigned char* last) {
+  for (; first != last; first++) {
+    const char* escaped = xmlrpc_escape(*first);
+
+    if (escaped != nullptr)
+      output->append(escaped);
+    else if ((*first < 0x20 && *first != '\n' && *first != '\t') ||
+             *first >= 0x80)
+      output->push_back('?');
+    else
+      output->push_back(*first);
+  }
+}
+
+// Escapes markup characters in a single pass, copying runs of plain
+// characters in one go. Strings that turn out not to be valid UTF-8
+// are rewritten with 'xmlrpc_write_sanitized'.
+static void
+xmlrpc_write_escaped(std::string* output, const std::string& str) {
+  const auto* first = reinterpret_cast<const unsigned char*>(str.data());
+  const auto* last  = first + str.size();
+  const auto* run   = first;
+  size_t      start = output->size();
+
+  for (const unsigned char* itr = first; itr != last;) {
+    if (*itr >= 0x80) {
+      size_t length = xmlrpc_utf8_length(itr, last);
+
+      if (length == 0) {
+        output->resize(start);
+        xmlrpc_write_sanitized(output, first, last);
+        return;
+      }
+
+      itr += length;
+      continue;
+    }
+
+    const char* escaped = xmlrpc_escape(*itr);
+
+    if (escaped == nullptr && (*itr >= 0x20 || *itr == '\n' || *itr == '\t')) {
+      itr++;
+      continue;
+    }
+
+    output->append(reinterpret_cast<const char*>(run), itr - run);
+    output->append(escaped != nullptr ? escaped : "?");
+    run = ++itr;
+  }
+
+  output->append(reinterpret_cast<const char*>(run), last - run);
+}
+
+void
+xmlrpc_write_value(std::string* output, const torrent::Object& object) {
+  switch (object.type()) {
+    case torrent::Object::TYPE_VALUE:
+      output->append("<value><i8>");
+      output->append(std::to_string(object.as_value()));
+      output->append("</i8></value>");
+      break;
+
+    case torrent::Object::TYPE_STRING:
+      output->append("<value><string>");
+      xmlrpc_write_escaped(output, object.as_string());
+      output->append("</string></value>");
+      break;
+
+    case torrent::Object::TYPE_LIST:
+      output->append("<value><array><data>");
+
+      for (const auto& item : object.as_list())
+        xmlrpc_write_value(output, item);
+
+      output->append("</data></array></value>");
+      break;
+
+    case torrent::Object::TYPE_MAP:
+      output->append("<value><struct>");
+
+      for (const auto& member : object.as_map()) {
+        output->append("<member><name>");
+        xmlrpc_write_escaped(output, member.first);
+        output->append("</name>");
+        xmlrpc_write_value(output, member.second);
+        output->append("</member>");
+      }
+
+      output->append("</struct></value>");
+      break;
+
+    case torrent::Object::TYPE_DICT_KEY:
+      output->append("<value><array><data>");
+      xmlrpc_write_value(output, object.as_dict_key());
+
+      if (object.as_dict_obj().is_list()) {
+        for (const auto& item : object.as_dict_obj().as_list())
+          xmlrpc_write_value(output, item);
+      } else {
+        xmlrpc_write_value(output, object.as_dict_obj());
+      }
+
+      output->append("</data></array></value>");
+      break;
+
+    default:
+      output->append("<value><i4>0</i4></value>");
+      break;
+  }
+}
+
+void
+xmlrpc_write_response(std::string* output, const torrent::Object& object) {
+  output->append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+                 "<methodResponse>\r\n<params>\r\n<param>");
+  xmlrpc_write_value(output, object);
+  output->append("</param>\r\n</params>\r\n</methodResponse>\r\n");
+}
+
+void
+xmlrpc_write_fault(std::string* output, int code, const std::string& message) {
+  output->append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n"
+                 "<methodResponse>\r\n<fault>\r\n<value><struct>"
+                 "<member><name>faultCode</name><value><i4>");
+  output->append(std::to_string(code));
+  output->append("</i4></value></member>"
+                 "<member><name>faultString</name><value><string>");
+  xmlrpc_write_escaped(output, message);
+  output->append("</string></value></member>"
+                 "</struct></value>\r\n</fault>\r\n</methodResponse>\r\n");
+}
+
+}
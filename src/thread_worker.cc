@@ -15,9 +15,14 @@
 #include "rpc/scgi.h"
 
 ThreadWorker::~ThreadWorker() {
+  // Closing the listener closes its tasks, which are registered with
+  // the polls of the helper threads.
   if (m_scgi) {
     delete m_scgi;
   }
+
+  for (auto helper : m_helpers)
+    delete helper;
 }
 
 void
@@ -36,15 +41,50 @@ ThreadWorker::set_scgi(rpc::SCgi* scgi) {
 
   change_rpc_log();
 
-  queue_item((thread_base_func)&start_scgi);
+  queue_item(&start_scgi);
   return true;
 }
 
+void
+ThreadWorker::create_helpers(unsigned int count) {
+  if (m_scgi != nullptr || !m_helpers.empty())
+    throw torrent::internal_error(
+      "ThreadWorker::create_helpers(...) called after the listener was set.");
+
+  while (m_helpers.size() != count) {
+    m_helpers.push_back(new ThreadWorker());
+    m_helpers.back()->init_thread();
+  }
+}
+
+ThreadWorker*
+ThreadWorker::next_thread() {
+  if (m_helpers.empty())
+    return this;
+
+  unsigned int index = m_nextThread++ % (m_helpers.size() + 1);
+
+  return index == 0 ? this : m_helpers[index - 1];
+}
+
+void
+ThreadWorker::queue_connection(rpc::SCgi* parent, rpc::SCgiTask* task, int fd) {
+  queue_item([parent, task, fd](ThreadBase* thread) {
+    task->open(parent, (ThreadWorker*)thread, fd);
+  });
+}
+
+void
+ThreadWorker::queue_deliver_events() {
+  if (!m_deliveryQueued.exchange(true))
+    queue_item(&msg_deliver_events);
+}
+
 void
 ThreadWorker::set_rpc_log(const std::string& filename) {
   m_rpcLog = filename;
 
-  queue_item((thread_base_func)&msg_change_rpc_log);
+  queue_item(&msg_change_rpc_log);
 }
 
 void
@@ -56,6 +96,9 @@ ThreadWorker::start_scgi(ThreadBase* baseThread) {
       "Tried to start SCGI but object was not present.");
 
   thread->scgi()->activate();
+
+  for (auto helper : thread->helpers())
+    helper->start_thread();
 }
 
 void
@@ -67,29 +110,52 @@ ThreadWorker::msg_change_rpc_log(ThreadBase* baseThread) {
   release_global_lock();
 }
 
+// Helpers deliver the events of the listener's subscribers whose
+// connections they serve.
+void
+ThreadWorker::msg_deliver_events(ThreadBase* baseThread) {
+  ThreadWorker* thread = (ThreadWorker*)baseThread;
+
+  thread->m_deliveryQueued = false;
+
+  if (worker_thread->scgi() != nullptr)
+    worker_thread->scgi()->events().deliver(thread);
+}
+
+void
+ThreadWorker::msg_resume_accept(ThreadBase* baseThread) {
+  ThreadWorker* thread = (ThreadWorker*)baseThread;
+
+  if (thread->scgi() != nullptr)
+    thread->scgi()->resume_accept();
+}
+
 void
 ThreadWorker::change_rpc_log() {
   if (scgi() == nullptr)
     return;
 
-  if (scgi()->log_fd() != -1) {
-    ::close(scgi()->log_fd());
-    scgi()->set_log_fd(-1);
+  // Threads still writing an entry hold on to the old log, which is
+  // closed once they're done.
+  if (scgi()->log() != nullptr) {
+    scgi()->set_log(nullptr);
     control->core()->push_log("Closed RPC log.");
   }
 
   if (m_rpcLog.empty())
     return;
 
-  scgi()->set_log_fd(open(torrent::utils::path_expand(m_rpcLog).c_str(),
-                          O_WRONLY | O_APPEND | O_CREAT,
-                          0644));
+  int fd = open(torrent::utils::path_expand(m_rpcLog).c_str(),
+                O_WRONLY | O_APPEND | O_CREAT,
+                0644);
 
-  if (scgi()->log_fd() == -1) {
+  if (fd == -1) {
     control->core()->push_log_std("Could not open RPC log file '" + m_rpcLog +
                                   "'.");
     return;
   }
 
+  scgi()->set_log(std::make_shared<rpc::SCgiLog>(fd));
+
   control->core()->push_log_std("Logging RPC events to '" + m_rpcLog + "'.");
 }
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+// Copyright (C) 2021, Contributors to the rTorrent project
+
+#include <array>
+
+#include "utils/crc32.h"
+
+namespace utils {
+
+static std::array<uint32_t, 256>
+crc32_make_table() {
+  std::array<uint32_t, 256> table{};
+
+  for (uint32_t i = 0; i != 256; ++i) {
+    uint32_t value = i;
+
+    for (int bit = 0; bit != 8; ++bit)
+      value = (value & 1) ? (value >> 1) ^ 0xedb88320 : value >> 1;
+
+    table[i] = value;
+  }
+
+  return table;
+}
+
+uint32_t
+crc32(const char* data, size_t length, uint32_t crc) {
+  static const std::array<uint32_t, 256> table = crc32_make_table();
+
+  crc = ~crc;
+
+  for (const char* last = data + length; data != last; ++data)
+    crc = table[(crc ^ static_cast<uint8_t>(*data)) & 0xff] ^ (crc >> 8);
+
+  return ~crc;
+}
+
+}
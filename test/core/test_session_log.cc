@@ -0,0 +1,369 @@
+#include <gtest/gtest.h>
+
+#include <csignal>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <torrent/exceptions.h>
+#include <torrent/object.h>
+
+#include "core/session_log.h"
+
+static const std::string test_hash_a(core::SessionLog::hash_size, 'a');
+static const std::string test_hash_b(core::SessionLog::hash_size, 'b');
+
+static off_t
+file_size(const std::string& filename) {
+  struct stat st;
+
+  if (::stat(filename.c_str(), &st) == -1)
+    return -1;
+
+  return st.st_size;
+}
+
+static std::string
+read_file(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+static void
+write_file(const std::string& filename, const std::string& data) {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+
+  file.write(data.data(), data.size());
+}
+
+static core::SessionLog::entry_list
+read_entries(const std::string& filename) {
+  core::SessionLog::entry_list entries;
+
+  if (!core::SessionLog::read(filename, &entries))
+    throw torrent::storage_error("could not read session log");
+
+  return entries;
+}
+
+// Makes writes past 'size' fail with EFBIG, as on a full disk, instead
+// of raising SIGXFSZ.
+class file_size_limit {
+public:
+  explicit file_size_limit(off_t size) {
+    ::getrlimit(RLIMIT_FSIZE, &m_previous);
+    m_handler = std::signal(SIGXFSZ, SIG_IGN);
+
+    struct rlimit limit = m_previous;
+    limit.rlim_cur      = size;
+    ::setrlimit(RLIMIT_FSIZE, &limit);
+  }
+
+  ~file_size_limit() {
+    ::setrlimit(RLIMIT_FSIZE, &m_previous);
+    std::signal(SIGXFSZ, m_handler);
+  }
+
+private:
+  struct rlimit m_previous;
+  void (*m_handler)(int);
+};
+
+class SessionLogTest : public ::testing::Test {
+public:
+  void SetUp() override {
+    const auto info = ::testing::UnitTest::GetInstance()->current_test_info();
+
+    m_filename = ::testing::TempDir() + "test_session_log." + info->name();
+
+    ::unlink(m_filename.c_str());
+  }
+
+  void TearDown() override {
+    ::unlink(m_filename.c_str());
+    ::unlink((m_filename + ".new").c_str());
+  }
+
+protected:
+  std::string m_filename;
+};
+
+TEST_F(SessionLogTest, test_failed_checkpoint) {
+  core::SessionLog log;
+  log.open(m_filename);
+
+  log.append(core::SessionLog::record_torrent, test_hash_a, "torrent a", 0);
+  log.append(core::SessionLog::record_torrent, test_hash_b, "torrent b", 0);
+  ASSERT_TRUE(log.checkpoint());
+
+  const off_t committed = file_size(m_filename);
+
+  log.append_erase(test_hash_a);
+
+  {
+    // Only part of the checkpoint gets written.
+    file_size_limit limit(committed + 10);
+    ASSERT_FALSE(log.checkpoint());
+  }
+
+  // The partial write is cut off, but the erase is kept and written by
+  // the next checkpoint.
+  ASSERT_TRUE(file_size(m_filename) == committed);
+  ASSERT_FALSE(log.has_torrent(test_hash_a));
+  ASSERT_TRUE(log.checkpoint());
+  ASSERT_TRUE(file_size(m_filename) > committed);
+
+  log.close();
+
+  core::SessionLog::entry_list entries;
+
+  ASSERT_TRUE(core::SessionLog::read(m_filename, &entries));
+  ASSERT_TRUE(entries.size() == 1);
+  ASSERT_TRUE(entries.front().hash == test_hash_b);
+  ASSERT_TRUE(entries.front().torrent.as_string() == "torrent b");
+}
+
+TEST_F(SessionLogTest, test_open) {
+  core::SessionLog log;
+  log.open(m_filename);
+
+  // A new log holds only the header, and nothing to write is a
+  // successful checkpoint.
+  ASSERT_TRUE(log.is_open());
+  ASSERT_TRUE(file_size(m_filename) == core::SessionLog::header_size);
+  ASSERT_TRUE(log.checkpoint());
+  ASSERT_TRUE(file_size(m_filename) == core::SessionLog::header_size);
+  ASSERT_TRUE(read_entries(m_filename).empty());
+
+  log.close();
+
+  ASSERT_FALSE(log.is_open());
+  ASSERT_FALSE(log.checkpoint());
+}
+
+TEST_F(SessionLogTest, test_invalid_header) {
+  write_file(m_filename, "d8:announce3:urle");
+
+  core::SessionLog::entry_list entries;
+  core::SessionLog             log;
+
+  ASSERT_FALSE(core::SessionLog::read(m_filename, &entries));
+  ASSERT_THROW(log.open(m_filename), torrent::storage_error);
+  ASSERT_FALSE(log.is_open());
+
+  // The file is left as is.
+  ASSERT_TRUE(read_file(m_filename) == "d8:announce3:urle");
+}
+
+TEST_F(SessionLogTest, test_read_latest) {
+  core::SessionLog log;
+  log.open(m_filename);
+
+  log.append(core::SessionLog::record_torrent, test_hash_b, "torrent b", 0);
+  log.append(core::SessionLog::record_rtorrent, test_hash_b, "rtorrent b", 0);
+  log.append(core::SessionLog::record_resume, test_hash_b, "resume b", 0);
+  log.append(core::SessionLog::record_torrent, test_hash_a, "torrent a", 0);
+  ASSERT_TRUE(log.checkpoint());
+
+  log.append(core::SessionLog::record_resume, test_hash_b, int64_t(2), 0);
+  ASSERT_TRUE(log.checkpoint());
+
+  // Downloads without a torrent record are skipped.
+  const std::string hash_c(core::SessionLog::hash_size, 'c');
+
+  log.append(core::SessionLog::record_resume, hash_c, "resume c", 0);
+  ASSERT_TRUE(log.checkpoint());
+
+  ASSERT_TRUE(log.has_torrent(test_hash_a));
+  ASSERT_FALSE(log.has_torrent(hash_c));
+
+  log.close();
+
+  auto entries = read_entries(m_filename);
+
+  // Entries come in info hash order, with the latest of each record.
+  ASSERT_TRUE(entries.size() == 2);
+  ASSERT_TRUE(entries[0].hash == test_hash_a);
+  ASSERT_TRUE(entries[0].torrent.as_string() == "torrent a");
+  ASSERT_TRUE(entries[0].rtorrent.is_empty());
+  ASSERT_TRUE(entries[0].resume.is_empty());
+  ASSERT_TRUE(entries[1].hash == test_hash_b);
+  ASSERT_TRUE(entries[1].torrent.as_string() == "torrent b");
+  ASSERT_TRUE(entries[1].rtorrent.as_string() == "rtorrent b");
+  ASSERT_TRUE(entries[1].resume.as_value() == 2);
+
+  // The index is rebuilt when reopened.
+  log.open(m_filename);
+
+  ASSERT_TRUE(log.has_torrent(test_hash_a));
+  ASSERT_TRUE(log.has_torrent(test_hash_b));
+  ASSERT_FALSE(log.has_torrent(hash_c));
+}
+
+TEST_F(SessionLogTest, test_uncommitted) {
+  core::SessionLog log;
+  log.open(m_filename);
+
+  log.append(core::SessionLog::record_torrent, test_hash_a, "torrent a", 0);
+  ASSERT_TRUE(log.checkpoint());
+
+  const off_t committed = file_size(m_filename);
+
+  log.append(core::SessionLog::record_torrent, test_hash_b, "torrent b", 0);
+  ASSERT_TRUE(log.checkpoint());
+
+  // Records not followed by a checkpoint are left out, and closing
+  // the log doesn't write them.
+  log.append(core::SessionLog::record_resume, test_hash_a, "resume a", 0);
+  log.close();
+
+  const std::string data = read_file(m_filename);
+
+  // A checkpoint interrupted part way through its last record.
+  write_file(m_filename, data.substr(0, data.size() - 1));
+
+  ASSERT_TRUE(read_entries(m_filename).size() == 1);
+
+  log.open(m_filename);
+
+  ASSERT_TRUE(file_size(m_filename) == committed);
+  ASSERT_TRUE(log.has_torrent(test_hash_a));
+  ASSERT_FALSE(log.has_torrent(test_hash_b));
+
+  // Appending continues after the last checkpoint.
+  log.append(core::SessionLog::record_torrent, test_hash_b, "torrent b", 0);
+  ASSERT_TRUE(log.checkpoint());
+  log.close();
+
+  auto entries = read_entries(m_filename);
+
+  ASSERT_TRUE(entries.size() == 2);
+  ASSERT_TRUE(entries[0].resume.is_empty());
+  ASSERT_TRUE(entries[1].torrent.as_string() == "torrent b");
+}
+
+TEST_F(SessionLogTest, test_corrupted) {
+  core::SessionLog log;
+  log.open(m_filename);
+
+  log.append(core::SessionLog::record_torrent, test_hash_a, "torrent a", 0);
+  ASSERT_TRUE(log.checkpoint());
+
+  const off_t committed = file_size(m_filename);
+
+  log.append(core::SessionLog::record_torrent, test_hash_b, "torrent b", 0);
+  ASSERT_TRUE(log.checkpoint());
+  log.close();
+
+  std::string data = read_file(m_filename);
+
+  // A flipped byte in the body of the first record after the
+  // committed part fails its CRC, dropping the whole checkpoint.
+  data[committed + 8 + 1] ^= 0x01;
+  write_file(m_filename, data);
+
+  auto entries = read_entries(m_filename);
+
+  ASSERT_TRUE(entries.size() == 1);
+  ASSERT_TRUE(entries[0].hash == test_hash_a);
+
+  log.open(m_filename);
+
+  ASSERT_TRUE(file_size(m_filename) == committed);
+  ASSERT_FALSE(log.has_torrent(test_hash_b));
+}
+
+TEST_F(SessionLogTest, test_erase) {
+  core::SessionLog log;
+  log.open(m_filename);
+
+  log.append(core::SessionLog::record_torrent, test_hash_a, "torrent a", 0);
+  log.append(core::SessionLog::record_resume, test_hash_a, "resume a", 0);
+  log.append(core::SessionLog::record_torrent, test_hash_b, "torrent b", 0);
+  ASSERT_TRUE(log.checkpoint());
+
+  log.append_erase(test_hash_a);
+  ASSERT_FALSE(log.has_torrent(test_hash_a));
+  ASSERT_TRUE(log.checkpoint());
+  log.close();
+
+  auto entries = read_entries(m_filename);
+
+  ASSERT_TRUE(entries.size() == 1);
+  ASSERT_TRUE(entries[0].hash == test_hash_b);
+
+  // Records of a download added again after being erased don't bring
+  // back the erased ones.
+  log.open(m_filename);
+
+  ASSERT_FALSE(log.has_torrent(test_hash_a));
+
+  log.append(core::SessionLog::record_torrent, test_hash_a, "torrent a2", 0);
+  ASSERT_TRUE(log.checkpoint());
+  log.close();
+
+  entries = read_entries(m_filename);
+
+  ASSERT_TRUE(entries.size() == 2);
+  ASSERT_TRUE(entries[0].torrent.as_string() == "torrent a2");
+  ASSERT_TRUE(entries[0].resume.is_empty());
+}
+
+TEST_F(SessionLogTest, test_compact) {
+  core::SessionLog log;
+  log.open(m_filename);
+
+  log.append(core::SessionLog::record_torrent, test_hash_a, "torrent a", 0);
+  log.append(core::SessionLog::record_torrent, test_hash_b, "torrent b", 0);
+  ASSERT_TRUE(log.checkpoint());
+
+  log.append_erase(test_hash_b);
+  ASSERT_TRUE(log.checkpoint());
+
+  // Superseded resume records pile up until compaction drops them.
+  const std::string resume(64 << 10, 'r');
+  const off_t       limit = core::SessionLog::compact_min_size + (128 << 10);
+
+  off_t previous  = file_size(m_filename);
+  bool  compacted = false;
+
+  for (int i = 0; i != 64; ++i) {
+    log.append(core::SessionLog::record_resume,
+               test_hash_a,
+               resume + std::to_string(i),
+               0);
+    ASSERT_TRUE(log.checkpoint());
+
+    const off_t size = file_size(m_filename);
+
+    ASSERT_TRUE(size < limit);
+
+    compacted = compacted || size < previous;
+    previous  = size;
+  }
+
+  ASSERT_TRUE(compacted);
+  ASSERT_TRUE(file_size(m_filename + ".new") == -1);
+
+  // Checkpoints after compaction are appended to the new file.
+  log.append(core::SessionLog::record_rtorrent, test_hash_a, "rtorrent a", 0);
+  ASSERT_TRUE(log.checkpoint());
+  log.close();
+
+  auto entries = read_entries(m_filename);
+
+  ASSERT_TRUE(entries.size() == 1);
+  ASSERT_TRUE(entries[0].torrent.as_string() == "torrent a");
+  ASSERT_TRUE(entries[0].rtorrent.as_string() == "rtorrent a");
+  ASSERT_TRUE(entries[0].resume.as_string() == resume + "63");
+
+  log.open(m_filename);
+
+  ASSERT_TRUE(log.has_torrent(test_hash_a));
+  ASSERT_FALSE(log.has_torrent(test_hash_b));
+}
@@ -0,0 +1,237 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "command_helpers.h"
+#include "control.h"
+#include "core/view_expression.h"
+#include "globals.h"
+#include "rpc/parse_commands.h"
+
+void
+initialize_command_logic();
+
+// Sort keys of the downloads used below. The downloads are only
+// passed around as targets, never dereferenced.
+static std::map<const void*, int64_t> test_sort_keys;
+static char                           test_downloads[64];
+
+static std::map<const void*, std::string> test_name_keys;
+
+static torrent::Object
+cmd_test_sort_key(rpc::target_type target, const torrent::Object&) {
+  return test_sort_keys[std::get<1>(target)];
+}
+
+static torrent::Object
+cmd_test_name_key(rpc::target_type target, const torrent::Object&) {
+  return test_name_keys[std::get<1>(target)];
+}
+
+static std::vector<core::Download*>
+make_downloads(std::initializer_list<int64_t> keys) {
+  static size_t next = 0;
+
+  std::vector<core::Download*> downloads;
+
+  for (int64_t key : keys) {
+    auto download = reinterpret_cast<core::Download*>(&test_downloads[next++]);
+
+    test_sort_keys[download] = key;
+    downloads.push_back(download);
+  }
+
+  return downloads;
+}
+
+class ViewExpressionTest : public ::testing::Test {
+public:
+  void SetUp() override {
+    if (control == nullptr) {
+      setlocale(LC_ALL, "");
+      cachedTime = torrent::utils::timer::current();
+      control    = new Control;
+    }
+
+    if (rpc::commands.find("less") == rpc::commands.end())
+      initialize_command_logic();
+
+    if (rpc::commands.find("test.sort_key") == rpc::commands.end()) {
+      CMD2_ANY("test.sort_key", &cmd_test_sort_key);
+      CMD2_ANY("test.name_key", &cmd_test_name_key);
+    }
+  }
+};
+
+// Evaluates the expression both through the compiled tree and through
+// the commands it was compiled from, which must agree on the result or
+// on throwing.
+static void
+assert_same_result(const char* expression, rpc::target_type target) {
+  SCOPED_TRACE(expression);
+
+  core::ViewExpression compiled;
+  compiled.set_command(expression);
+
+  torrent::Object expected;
+  torrent::Object result;
+  bool            expectedThrew = false;
+  bool            resultThrew   = false;
+
+  try {
+    expected = rpc::parse_command_single(target, expression);
+  } catch (torrent::input_error&) {
+    expectedThrew = true;
+  }
+
+  try {
+    result = compiled.evaluate(target);
+  } catch (torrent::input_error&) {
+    resultThrew = true;
+  }
+
+  ASSERT_TRUE(expectedThrew == resultThrew);
+  ASSERT_TRUE(expected.type() == result.type());
+
+  if (expected.is_value())
+    ASSERT_TRUE(expected.as_value() == result.as_value());
+  else if (expected.is_string())
+    ASSERT_TRUE(expected.as_string() == result.as_string());
+}
+
+static const char* test_logic_expressions[] = {
+  // 'and' and 'or', with values, strings and empty lists.
+  "and={cat=1,cat=1}",
+  "and={cat=1,cat=}",
+  "and={}",
+  "or={cat=,cat=}",
+  "or={cat=,cat=1}",
+  "or={}",
+
+  // 'not' calls command objects, anything else is a constant.
+  "not=cat=",
+  "not=$cat=",
+  "not={cat=}",
+  "not={}",
+
+  // Values and strings compare differently, mixing them throws.
+  "less={value=2,value=10}",
+  "less={cat=2,cat=10}",
+  "greater={value=2,value=10}",
+  "greater={cat=2,cat=10}",
+  "equal={value=3,value=3}",
+  "equal={cat=abc,cat=abd}",
+  "less={cat=1,value=1}",
+  "less={}",
+
+  // Fields of the target, or of each side of a target pair.
+  "less=test.sort_key=",
+  "greater=test.sort_key=",
+  "equal=test.sort_key=",
+  "less=test.name_key=",
+  "and={test.sort_key=,test.name_key=}",
+  "compare=ad,test.sort_key=,test.name_key=",
+  "compare=a",
+
+  // Missing commands throw when called, but not when skipped.
+  "test.missing=",
+  "and={test.missing=}",
+  "or={cat=1,test.missing=}",
+  "and={cat=,test.missing=}",
+  "less={test.missing=,cat=}",
+};
+
+TEST_F(ViewExpressionTest, test_logic_agrees) {
+  auto downloads = make_downloads({ 2, 1 });
+
+  test_name_keys[downloads[0]] = "a";
+  test_name_keys[downloads[1]] = "b";
+
+  for (const char* expression : test_logic_expressions) {
+    assert_same_result(expression, rpc::make_target());
+    assert_same_result(expression, rpc::make_target(downloads[0]));
+    assert_same_result(expression,
+                       rpc::make_target_pair(downloads[0], downloads[1]));
+    assert_same_result(expression,
+                       rpc::make_target_pair(downloads[1], downloads[0]));
+  }
+}
+
+TEST_F(ViewExpressionTest, test_sort_agrees) {
+  static const char* expressions[] = {
+    "less=test.sort_key=",
+    "greater=test.sort_key=",
+    "less=test.name_key=",
+    "compare=ad,test.sort_key=,test.name_key=",
+    "compare=d,test.name_key=",
+  };
+
+  auto        downloads = make_downloads({ 3, 1, 2, 3, 1, 2 });
+  std::string names[]   = { "c", "a", "b", "b", "c", "a" };
+
+  for (size_t i = 0; i < downloads.size(); i++)
+    test_name_keys[downloads[i]] = names[i];
+
+  for (const char* expression : expressions) {
+    SCOPED_TRACE(expression);
+
+    core::ViewExpression sort;
+    sort.set_command(expression);
+
+    auto expected = downloads;
+    auto result   = downloads;
+
+    std::stable_sort(expected.begin(),
+                     expected.end(),
+                     [expression](core::Download* d1, core::Download* d2) {
+                       return rpc::parse_command_single(
+                                rpc::make_target_pair(d1, d2), expression)
+                         .as_value();
+                     });
+
+    ASSERT_TRUE(sort.sort(result.begin(), result.end()));
+    ASSERT_TRUE(result == expected);
+
+    // Insertions find the position the comparator would.
+    for (auto download : downloads) {
+      auto first = expected.begin();
+      auto last  = expected.end();
+
+      ASSERT_TRUE(sort.upper_bound(first, last, download) ==
+                  sort.find_after(first, last, download));
+    }
+  }
+}
+
+TEST_F(ViewExpressionTest, test_insert_sorted) {
+  core::ViewExpression sort;
+  sort.set_command("less=test.sort_key=");
+
+  auto downloads = make_downloads({ 1, 3, 5, 7 });
+  auto inserted  = make_downloads({ 4 }).front();
+
+  auto itr = sort.upper_bound(downloads.begin(), downloads.end(), inserted);
+
+  ASSERT_TRUE(itr - downloads.begin() == 2);
+  ASSERT_TRUE(itr ==
+              sort.find_after(downloads.begin(), downloads.end(), inserted));
+}
+
+TEST_F(ViewExpressionTest, test_insert_after_filter) {
+  core::ViewExpression sort;
+  sort.set_command("less=test.sort_key=");
+
+  // A full filter pass appends the newly visible downloads, here those
+  // with keys 7 and 2, after the sorted ones.
+  auto downloads = make_downloads({ 1, 3, 5, 7, 2 });
+  auto inserted  = make_downloads({ 6 }).front();
+
+  // The range isn't in sort order, so a binary search would place the
+  // download at the end rather than before the first larger key.
+  auto itr = sort.find_after(downloads.begin(), downloads.end(), inserted);
+
+  ASSERT_TRUE(itr - downloads.begin() == 3);
+}
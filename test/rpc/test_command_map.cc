@@ -40,3 +40,24 @@ TEST_F(CommandMapTest, test_basics) {
   ASSERT_TRUE(m_map.call_command("test_b", (int64_t)1).as_value() == 2);
   ASSERT_TRUE(m_map.call_command("any_string", "").as_value() == 3);
 }
+
+TEST_F(CommandMapTest, test_lookup) {
+  CMD2_ANY("test_a", &cmd_test_map_a);
+  CMD2_ANY("test_b", &cmd_test_map_a);
+
+  // Keys are looked up by content, not by address.
+  const std::string key = "test_a";
+
+  ASSERT_TRUE(m_map.has(key));
+  ASSERT_TRUE(m_map.find(key.c_str()) != m_map.end());
+  ASSERT_TRUE(m_map.find("test_c") == m_map.end());
+
+  m_map.erase(m_map.find("test_a"));
+
+  ASSERT_TRUE(!m_map.has("test_a"));
+  ASSERT_TRUE(m_map.find("test_b")->first == std::string("test_b"));
+
+  CMD2_ANY("test_a", &cmd_test_map_a);
+
+  ASSERT_TRUE(m_map.call_command("test_a", (int64_t)4).as_value() == 4);
+}
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "rpc/event_stream.h"
+
+static const std::string test_notification =
+  "{\"jsonrpc\":\"2.0\",\"method\":\"event.download.finished\","
+  "\"params\":[\"0123456789ABCDEF0123456789ABCDEF01234567\"]}\n";
+
+TEST(EventQueueTest, test_coalescing) {
+  rpc::EventQueue queue;
+
+  // Only the first event wakes the thread, the rest are written along
+  // with it.
+  ASSERT_TRUE(queue.empty());
+  ASSERT_TRUE(queue.push(test_notification));
+  ASSERT_FALSE(queue.push(test_notification));
+  ASSERT_FALSE(queue.push(test_notification));
+
+  ASSERT_TRUE(queue.take() ==
+              test_notification + test_notification + test_notification);
+  ASSERT_TRUE(queue.empty());
+
+  // Once taken, the next event wakes the thread again.
+  ASSERT_TRUE(queue.push(test_notification));
+  ASSERT_TRUE(queue.take() == test_notification);
+}
+
+TEST(EventQueueTest, test_back_pressure) {
+  rpc::EventQueue queue;
+
+  while (!queue.is_overflowed())
+    queue.push(test_notification);
+
+  // The queue stops growing once past the limit, but stays overflowed
+  // so the subscriber gets dropped on delivery.
+  const size_t size = queue.size();
+
+  ASSERT_TRUE(size <= rpc::EventQueue::max_size + test_notification.size());
+
+  for (int i = 0; i < 100; i++)
+    ASSERT_FALSE(queue.push(test_notification));
+
+  ASSERT_TRUE(queue.size() == size);
+  ASSERT_TRUE(queue.is_overflowed());
+
+  queue.take();
+
+  ASSERT_TRUE(queue.empty());
+  ASSERT_FALSE(queue.is_overflowed());
+}
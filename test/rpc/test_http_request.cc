@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "rpc/http_request.h"
+
+static const std::string test_body =
+  "<?xml version=\"1.0\"?><methodCall><methodName>system.pid</methodName>"
+  "</methodCall>";
+
+static std::string
+make_request(const std::string& headers, const std::string& body = test_body) {
+  return "POST /RPC2 HTTP/1.1\r\n" + headers + "\r\n" + body;
+}
+
+TEST(HttpRequestTest, test_basic) {
+  const auto request =
+    make_request("Content-Type: text/xml\r\nContent-Length: " +
+                 std::to_string(test_body.size()) + "\r\n");
+
+  rpc::HttpRequest header;
+
+  ASSERT_TRUE(rpc::http_parse_header(request, &header) == 200);
+  ASSERT_TRUE(header.content_length == test_body.size());
+  ASSERT_TRUE(header.header_size + header.content_length == request.size());
+  ASSERT_TRUE(header.keep_alive);
+  ASSERT_FALSE(header.json);
+
+  // Headers may arrive in pieces.
+  for (size_t i = 0; i < header.header_size - 1; i++)
+    ASSERT_TRUE(rpc::http_parse_header(request.substr(0, i), &header) == 0);
+}
+
+TEST(HttpRequestTest, test_pipelining) {
+  const auto first = make_request(
+    "Content-Length: " + std::to_string(test_body.size()) + "\r\n");
+  const auto second = make_request(
+    "Content-Type: application/json\r\nContent-Length: 2\r\n"
+    "Connection: close\r\n",
+    "[]");
+
+  const std::string received = first + second;
+  rpc::HttpRequest  header;
+
+  // Each request ends where its Content-Length says, the rest belongs
+  // to the next one.
+  ASSERT_TRUE(rpc::http_parse_header(received, &header) == 200);
+  ASSERT_TRUE(header.header_size + header.content_length == first.size());
+  ASSERT_TRUE(header.keep_alive);
+
+  ASSERT_TRUE(rpc::http_parse_header(received.substr(first.size()), &header) ==
+              200);
+  ASSERT_TRUE(header.content_length == 2);
+  ASSERT_TRUE(header.json);
+  ASSERT_FALSE(header.keep_alive);
+}
+
+TEST(HttpRequestTest, test_length_required) {
+  rpc::HttpRequest header;
+
+  // Neither a missing Content-Length nor a chunked body are accepted.
+  ASSERT_TRUE(rpc::http_parse_header(make_request(""), &header) == 411);
+  ASSERT_TRUE(
+    rpc::http_parse_header(make_request("Transfer-Encoding: chunked\r\n",
+                                        "4\r\ntest\r\n0\r\n\r\n"),
+                           &header) == 411);
+}
+
+TEST(HttpRequestTest, test_errors) {
+  rpc::HttpRequest header;
+
+  ASSERT_TRUE(rpc::http_parse_header("GET / HTTP/1.1\r\n\r\n", &header) ==
+              400);
+  ASSERT_TRUE(rpc::http_parse_header(
+                "POST / HTTP/2\r\nContent-Length: 2\r\n\r\n[]", &header) ==
+              400);
+  ASSERT_TRUE(
+    rpc::http_parse_header(make_request("Content-Length: 0\r\n", ""),
+                           &header) == 400);
+  ASSERT_TRUE(
+    rpc::http_parse_header(make_request("Content-Length: 12x\r\n"), &header) ==
+    400);
+  ASSERT_TRUE(rpc::http_parse_header(make_request("No colon\r\n"), &header) ==
+              400);
+  ASSERT_TRUE(rpc::http_parse_header(
+                make_request("Content-Type: text/plain\r\n"
+                             "Content-Length: 2\r\n",
+                             "[]"),
+                &header) == 415);
+
+  // Oversized headers and bodies.
+  ASSERT_TRUE(rpc::http_parse_header(
+                std::string(rpc::HttpRequest::max_header_size, 'x'), &header) ==
+              413);
+  ASSERT_TRUE(
+    rpc::http_parse_header(make_request("Content-Length: 2000000000\r\n"),
+                           &header) == 413);
+  ASSERT_TRUE(rpc::http_parse_header(
+                make_request("Content-Length: 99999999999999999999\r\n"),
+                &header) == 413);
+
+  ASSERT_TRUE(rpc::http_error_response(411).substr(0, 13) == "HTTP/1.1 411 ");
+  ASSERT_TRUE(rpc::http_error_response(413).find("Connection: close\r\n") !=
+              std::string_view::npos);
+}
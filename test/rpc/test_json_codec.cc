@@ -0,0 +1,129 @@
+#include "buildinfo.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "rpc/json_codec.h"
+
+#ifdef HAVE_JSON
+#include "utils/jsonrpc/server.h"
+#endif
+
+static std::string
+write_object(const torrent::Object& object) {
+  std::string output;
+  rpc::json_write_object(&output, object);
+  return output;
+}
+
+TEST(JsonCodecTest, test_write_object) {
+  torrent::Object list = torrent::Object::create_list();
+  list.as_list().push_back(int64_t(-42));
+  list.as_list().push_back(std::string("a\"b\\c\n\x01"));
+  list.as_list().push_back(torrent::Object::create_list());
+
+  ASSERT_TRUE(write_object(list) == "[-42,\"a\\\"b\\\\c\\n\\u0001\",[]]");
+
+  torrent::Object map = torrent::Object::create_map();
+  map.as_map()["b"] = int64_t(1);
+  map.as_map()["a"] = std::string("\xc3\xa9");
+
+  ASSERT_TRUE(write_object(map) == "{\"a\":\"\xc3\xa9\",\"b\":1}");
+  ASSERT_TRUE(write_object(torrent::Object()) == "0");
+}
+
+TEST(JsonCodecTest, test_write_invalid_utf8) {
+  ASSERT_TRUE(write_object(std::string("a\xff")) == "\"a\xef\xbf\xbd\"");
+  ASSERT_TRUE(write_object(std::string("\xe2\x82" "b")) ==
+              "\"\xef\xbf\xbd" "b\"");
+  ASSERT_TRUE(write_object(std::string("\xe0\x80")) ==
+              "\"\xef\xbf\xbd\xef\xbf\xbd\"");
+}
+
+#ifdef HAVE_JSON
+
+TEST(JsonCodecTest, test_write_matches_dump) {
+  const char* strings[] = { "",         "plain",        "\t\r\b\f\x1f\x7f",
+                            "\xf0\x9f\x98\x80", "\xed\xa0\x80", "\xf4\x90\x80\x80",
+                            "\xc3",     "a\xe2\x82\xac" "b\xe2\x82" };
+
+  for (const char* str : strings) {
+    std::string output;
+    rpc::json_write_string(&output, str);
+
+    ASSERT_TRUE(output == nlohmann::json(std::string(str))
+                            .dump(-1, ' ', false,
+                                  nlohmann::json::error_handler_t::replace));
+  }
+}
+
+static jsonrpccxx::JsonRpcServer::JsonRpcCall
+echo_params(const std::string& method, torrent::Object& params) {
+  if (method != "echo")
+    throw jsonrpccxx::JsonRpcException(-32601, "method not found: " + method);
+
+  torrent::Object result;
+  result.swap(params);
+
+  return [result]() -> jsonrpccxx::JsonRpcServer::JsonRpcResult {
+    return [result](std::string* output) {
+      rpc::json_write_object(output, result);
+    };
+  };
+}
+
+static std::string
+handle(const std::string& request) {
+  jsonrpccxx::JsonRpc2Server server(&echo_params);
+  return server.HandleRequest(request);
+}
+
+TEST(JsonCodecTest, test_server_request) {
+  ASSERT_TRUE(handle(R"({"jsonrpc":"2.0","id":1,"method":"echo",)"
+                     R"("params":["", 5, -1, true, "s", [1, ["x"]]]})") ==
+              R"({"id":1,"jsonrpc":"2.0","result":["",5,-1,1,"s",[1,["x"]]]})");
+
+  ASSERT_TRUE(handle(R"({"jsonrpc":"2.0","id":"a","method":"echo"})") ==
+              R"({"id":"a","jsonrpc":"2.0","result":[]})");
+
+  // Unsupported values are left empty for the handler to reject.
+  ASSERT_TRUE(handle(R"({"jsonrpc":"2.0","id":null,"method":"echo",)"
+                     R"("params":[null,1.5,{"a":[1]}]})") ==
+              R"({"id":null,"jsonrpc":"2.0","result":[0,0,0]})");
+}
+
+TEST(JsonCodecTest, test_server_batch) {
+  ASSERT_TRUE(handle("[]") == "[]");
+
+  ASSERT_TRUE(
+    handle(R"([{"jsonrpc":"2.0","id":1,"method":"echo","params":[1]},)"
+           R"(5,{"jsonrpc":"2.0","id":2,"method":"nope","params":[]},)"
+           R"({"jsonrpc":"2.0","id":3,"method":"echo","params":{"a":1}}])") ==
+    R"([{"id":1,"jsonrpc":"2.0","result":[1]},)"
+    R"({"error":{"code":-32600,"message":"invalid request: missing jsonrpc field set to \"2.0\""},"id":null,"jsonrpc":"2.0"},)"
+    R"({"error":{"code":-32601,"message":"method not found: nope"},"id":2,"jsonrpc":"2.0"},)"
+    R"({"error":{"code":-32602,"message":"invalid parameter: procedure doesn't support named parameter"},"id":3,"jsonrpc":"2.0"}])");
+}
+
+TEST(JsonCodecTest, test_server_errors) {
+  ASSERT_TRUE(handle("5") ==
+              R"({"error":{"code":-32600,"message":"invalid request: )"
+              R"(expected array or object"},"id":null,"jsonrpc":"2.0"})");
+
+  ASSERT_TRUE(handle("{\"jsonrpc\":").find("\"code\":-32700") !=
+              std::string::npos);
+
+  ASSERT_TRUE(handle(R"({"jsonrpc":"2.0","method":"echo"})") ==
+              R"({"error":{"code":-32600,"message":"invalid request: id )"
+              R"(field must be a number, string or null"},"id":null,)"
+              R"("jsonrpc":"2.0"})");
+
+  ASSERT_TRUE(handle(R"({"jsonrpc":"2.0","id":[1],"method":"echo"})")
+                .find(R"("id":null)") != std::string::npos);
+
+  ASSERT_TRUE(handle(R"({"jsonrpc":"2.0","id":1,"method":"echo","params":5})")
+                .find("\"code\":-32600") != std::string::npos);
+}
+
+#endif
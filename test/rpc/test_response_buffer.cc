@@ -0,0 +1,58 @@
+#include "test/rpc/response_buffer_test.h"
+
+#include <sys/uio.h>
+
+#include <torrent/exceptions.h>
+
+static std::string
+iovec_to_string(const struct iovec* iov, int count) {
+  std::string result;
+
+  for (int i = 0; i < count; i++)
+    result.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+
+  return result;
+}
+
+TEST_F(ResponseBufferTest, test_basics) {
+  ASSERT_TRUE(m_buffer.empty());
+
+  m_buffer.push_back(std::string("body"));
+  m_buffer.push_back(std::string());
+  m_buffer.push_back("tail", 4);
+  m_buffer.push_front(std::string("head:"));
+
+  ASSERT_TRUE(m_buffer.size() == 13);
+  ASSERT_TRUE(std::distance(m_buffer.begin(), m_buffer.end()) == 3);
+
+  struct iovec iov[4];
+  int          count = m_buffer.fill_iovec(iov, 4);
+
+  ASSERT_TRUE(count == 3);
+  ASSERT_TRUE(iovec_to_string(iov, count) == "head:bodytail");
+
+  m_buffer.clear();
+  ASSERT_TRUE(m_buffer.empty());
+}
+
+TEST_F(ResponseBufferTest, test_consume) {
+  m_buffer.push_back(std::string("abc"));
+  m_buffer.push_back(std::string("defg"));
+  m_buffer.push_back(std::string("hi"));
+
+  struct iovec iov[2];
+
+  m_buffer.consume(2);
+  ASSERT_TRUE(m_buffer.size() == 7);
+  ASSERT_THROW(m_buffer.push_front(std::string("x")), torrent::internal_error);
+  ASSERT_TRUE(iovec_to_string(iov, m_buffer.fill_iovec(iov, 2)) == "cdefg");
+
+  m_buffer.consume(5);
+  ASSERT_TRUE(iovec_to_string(iov, m_buffer.fill_iovec(iov, 2)) == "hi");
+
+  ASSERT_THROW(m_buffer.consume(3), torrent::internal_error);
+
+  m_buffer.consume(2);
+  ASSERT_TRUE(m_buffer.empty());
+  ASSERT_TRUE(m_buffer.fill_iovec(iov, 2) == 0);
+}
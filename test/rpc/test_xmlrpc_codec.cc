@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "rpc/xmlrpc_codec.h"
+
+static void
+parse_call(const std::string&          xml,
+           std::string*                method,
+           torrent::Object::list_type* params) {
+  rpc::xmlrpc_parse_call(xml.data(), xml.data() + xml.size(), method, params);
+}
+
+static int
+parse_error(const std::string& xml) {
+  std::string                method;
+  torrent::Object::list_type params;
+
+  try {
+    parse_call(xml, &method, &params);
+  } catch (rpc::xmlrpc_error& e) {
+    return e.type();
+  }
+
+  return 0;
+}
+
+static std::string
+write_value(const torrent::Object& object) {
+  std::string output;
+  rpc::xmlrpc_write_value(&output, object);
+  return output;
+}
+
+TEST(XmlrpcCodecTest, test_parse_call) {
+  std::string                method;
+  torrent::Object::list_type params;
+
+  parse_call("<?xml version=\"1.0\"?>\n"
+             "<methodCall><methodName>d.multicall2</methodName><params>"
+             "<param><value><string></string></value></param>"
+             "<param><value>main</value></param>"
+             "<param><value><i4>-5</i4></value></param>"
+             "<param><value><i8>8589934592</i8></value></param>"
+             "<param><value><boolean>1</boolean></value></param>"
+             "<param><value><base64>aGVsbG8=</base64></value></param>"
+             "<param><value><array><data>"
+             "<value><int>1</int></value><value/>"
+             "</data></array></value></param>"
+             "<param><value><struct><member><name>key</name>"
+             "<value><string>a &amp; b</string></value>"
+             "</member></struct></value></param>"
+             "</params></methodCall>\n",
+             &method,
+             &params);
+
+  ASSERT_TRUE(method == "d.multicall2");
+  ASSERT_TRUE(params.size() == 8);
+  ASSERT_TRUE(params[0].as_string().empty());
+  ASSERT_TRUE(params[1].as_string() == "main");
+  ASSERT_TRUE(params[2].as_value() == -5);
+  ASSERT_TRUE(params[3].as_value() == 8589934592);
+  ASSERT_TRUE(params[4].as_value() == 1);
+  ASSERT_TRUE(params[5].as_string() == "hello");
+  ASSERT_TRUE(params[6].as_list().size() == 2);
+  ASSERT_TRUE(params[6].as_list().front().as_value() == 1);
+  ASSERT_TRUE(params[6].as_list().back().as_string().empty());
+  ASSERT_TRUE(params[7].get_key_string("key") == "a & b");
+}
+
+TEST(XmlrpcCodecTest, test_parse_text) {
+  std::string                method;
+  torrent::Object::list_type params;
+
+  parse_call("<methodCall>\r\n  <methodName> system.listMethods </methodName>"
+             "</methodCall>",
+             &method,
+             &params);
+
+  ASSERT_TRUE(method == "system.listMethods");
+  ASSERT_TRUE(params.empty());
+
+  parse_call("<methodCall><methodName>x</methodName><params><param><value>"
+             "<string>&lt;&#65;&#x42;<![CDATA[<&>]]><!-- c -->&#xe9;</string>"
+             "</value></param></params></methodCall>",
+             &method,
+             &params);
+
+  ASSERT_TRUE(params.front().as_string() == "<AB<&>\xc3\xa9");
+}
+
+TEST(XmlrpcCodecTest, test_parse_errors) {
+  ASSERT_TRUE(parse_error("") == rpc::xmlrpc_parse_error);
+  ASSERT_TRUE(parse_error("<methodCall><methodName>x</methodName>") ==
+              rpc::xmlrpc_parse_error);
+  ASSERT_TRUE(parse_error("<methodCall><methodName>x</methodName><params>"
+                          "<param><value><i4>1x</i4></value></param>"
+                          "</params></methodCall>") == rpc::xmlrpc_parse_error);
+  ASSERT_TRUE(parse_error("<methodCall><methodName>x</methodName><params>"
+                          "<param><value><double>1.5</double></value></param>"
+                          "</params></methodCall>") == rpc::xmlrpc_type_error);
+  ASSERT_TRUE(parse_error("<methodCall><methodName>&bogus;</methodName>"
+                          "</methodCall>") == rpc::xmlrpc_parse_error);
+
+  std::string nested;
+
+  for (int i = 0; i != 100; i++)
+    nested += "<value><array><data>";
+
+  ASSERT_TRUE(parse_error("<methodCall><methodName>x</methodName><params>"
+                          "<param>" +
+                          nested + "</param></params></methodCall>") ==
+              rpc::xmlrpc_limit_exceeded_error);
+}
+
+TEST(XmlrpcCodecTest, test_write_value) {
+  torrent::Object list = torrent::Object::create_list();
+  list.as_list().push_back(int64_t(-1));
+  list.as_list().push_back(std::string("a<b>&c\r\n"));
+
+  ASSERT_TRUE(write_value(list) ==
+              "<value><array><data><value><i8>-1</i8></value>"
+              "<value><string>a&lt;b&gt;&amp;c&#x0d;\n</string></value>"
+              "</data></array></value>");
+
+  torrent::Object map = torrent::Object::create_map();
+  map.as_map()["x"] = std::string("\xc3\xa9");
+
+  ASSERT_TRUE(write_value(map) ==
+              "<value><struct><member><name>x</name>"
+              "<value><string>\xc3\xa9</string></value>"
+              "</member></struct></value>");
+
+  ASSERT_TRUE(write_value(torrent::Object()) == "<value><i4>0</i4></value>");
+}
+
+TEST(XmlrpcCodecTest, test_write_invalid_utf8) {
+  ASSERT_TRUE(write_value(std::string("a\x01")) ==
+              "<value><string>a?</string></value>");
+  ASSERT_TRUE(write_value(std::string("\xc3\xa9<\xff\x01\t")) ==
+              "<value><string>??&lt;??\t</string></value>");
+  ASSERT_TRUE(write_value(std::string("\xed\xa0\x80")) ==
+              "<value><string>???"
+              "</string></value>");
+}
+
+TEST(XmlrpcCodecTest, test_round_trip) {
+  torrent::Object result = torrent::Object::create_list();
+  result.as_list().push_back(std::string("name \xe2\x9c\x93 & <more>"));
+  result.as_list().push_back(int64_t(1) << 40);
+
+  std::string output;
+  rpc::xmlrpc_write_response(&output, result);
+
+  // Responses have the same value encoding as calls.
+  std::string call = output;
+  call.replace(call.find("<methodResponse>"), 16, "<methodCall>");
+  call.replace(call.find("</methodResponse>"), 17, "</methodCall>");
+  call.insert(call.find("<methodCall>") + 12, "<methodName>r</methodName>");
+
+  std::string                method;
+  torrent::Object::list_type params;
+  parse_call(call, &method, &params);
+
+  ASSERT_TRUE(params.size() == 1);
+  ASSERT_TRUE(params.front().as_list().size() == 2);
+  ASSERT_TRUE(params.front().as_list().front().as_string() ==
+              result.as_list().front().as_string());
+  ASSERT_TRUE(params.front().as_list().back().as_value() == int64_t(1) << 40);
+}
+
+TEST(XmlrpcCodecTest, test_write_fault) {
+  std::string output;
+  rpc::xmlrpc_write_fault(&output, -506, "Method 'x<' not defined");
+
+  ASSERT_TRUE(output.find("<fault>") != std::string::npos);
+  ASSERT_TRUE(output.find("<name>faultCode</name><value><i4>-506</i4>") !=
+              std::string::npos);
+  ASSERT_TRUE(output.find("<string>Method 'x&lt;' not defined</string>") !=
+              std::string::npos);
+}
@@ -0,0 +1,21 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "utils/crc32.h"
+
+TEST(Crc32Test, test_known_values) {
+  ASSERT_TRUE(utils::crc32("", 0) == 0);
+  ASSERT_TRUE(utils::crc32("123456789", 9) == 0xcbf43926);
+  ASSERT_TRUE(utils::crc32("The quick brown fox jumps over the lazy dog", 43) ==
+              0x414fa339);
+}
+
+TEST(Crc32Test, test_continued) {
+  std::string data = "d8:announce3:url4:infod4:name4:testee";
+
+  uint32_t crc = utils::crc32(data.data(), 10);
+  crc          = utils::crc32(data.data() + 10, data.size() - 10, crc);
+
+  ASSERT_TRUE(crc == utils::crc32(data.data(), data.size()));
+}
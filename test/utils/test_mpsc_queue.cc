@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "utils/mpsc_queue.h"
+
+TEST(MpscQueueTest, test_order) {
+  utils::mpsc_queue<int> queue;
+  int                    value;
+
+  ASSERT_TRUE(queue.empty());
+  ASSERT_TRUE(!queue.pop(&value));
+
+  for (int i = 0; i < 100; i++)
+    queue.push(i);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(!queue.empty());
+    ASSERT_TRUE(queue.pop(&value) && value == i);
+  }
+
+  ASSERT_TRUE(queue.empty());
+}
+
+TEST(MpscQueueTest, test_closures) {
+  utils::mpsc_queue<std::function<void()>> queue;
+  std::function<void()>                    item;
+
+  auto counter = std::make_shared<int>(0);
+
+  queue.push([counter] { (*counter)++; });
+  queue.push([counter] { (*counter) += 2; });
+
+  while (queue.pop(&item))
+    item();
+
+  ASSERT_TRUE(*counter == 3);
+
+  // Popped closures aren't kept alive by the queue.
+  item = nullptr;
+  ASSERT_TRUE(counter.use_count() == 1);
+
+  // Nor are those still queued once it is destroyed.
+  {
+    utils::mpsc_queue<std::function<void()>> pending;
+    pending.push([counter] {});
+  }
+
+  ASSERT_TRUE(counter.use_count() == 1);
+}
+
+TEST(MpscQueueTest, test_producers) {
+  static constexpr int producers = 4;
+  static constexpr int items     = 10000;
+
+  utils::mpsc_queue<int>   queue;
+  std::vector<std::thread> threads;
+
+  for (int p = 0; p < producers; p++)
+    threads.emplace_back([&queue, p] {
+      for (int i = 0; i < items; i++)
+        queue.push(p * items + i);
+    });
+
+  // Items of each producer arrive in the order they were pushed.
+  std::vector<int> next(producers, 0);
+  int              received = 0;
+  int              value;
+
+  while (received != producers * items) {
+    if (!queue.pop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    ASSERT_TRUE(value % items == next[value / items]++);
+    received++;
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+
+  ASSERT_TRUE(queue.empty());
+}